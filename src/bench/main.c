@@ -0,0 +1,316 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+
+// Prints one CSV row per (mode, sink, threads, level, message) combination:
+//   bench [max_threads] [messages_per_thread]
+// Latencies are per log call, throughput includes logger_free (the async
+// writer draining the ring).
+
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_MESSAGES 20000
+#define TTY_MESSAGES_DIVISOR 10
+#define LONG_MESSAGE_SIZE 1024
+
+typedef enum Mode {
+  MODE_SYNC,
+  MODE_ASYNC,
+  MODE_BATCHED,
+  MODE_SHARDED,
+  MODE_RECORDER, // sync, filtered records only go to the flight recorder
+  MODE_DIRECT,
+  MODE_MMAP, // file sink only
+  MODE_NET, // socket sink only, batched per 64 KB
+  MODE_COMPRESS // file sink only, default blocks
+} Mode;
+
+typedef enum SinkType {
+  SINK_TTY,
+  SINK_FILE,
+  SINK_DEV_NULL,
+  SINK_PIPE,
+  SINK_SOCKET // Unix datagram socket drained by a local receiver
+} SinkType;
+
+static const char* MODE_NAMES[] = { "sync", "async", "batched", "sharded", "recorder", "direct", "mmap", "net", "compress" };
+static const char* SINK_NAMES[] = { "tty", "file", "devnull", "pipe", "socket" };
+
+typedef struct Sink {
+  FILE* stream;
+  int pipe_read;
+  int socket;
+  bool stop;
+  pthread_t drainer;
+  char path[64];
+} Sink;
+
+typedef struct Run {
+  Logger* logger;
+  bool enabled;
+  bool long_message;
+  size_t messages;
+  uint64_t* latencies;
+  pthread_barrier_t* start;
+} Run;
+
+static char long_message[LONG_MESSAGE_SIZE];
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+//####################
+// SINKS
+//####################
+
+static void* drain_pipe(void* arg) {
+  Sink* sink = (Sink*)arg;
+  char buff[65536];
+  while (read(sink->pipe_read, buff, sizeof(buff)) > 0);
+  return NULL;
+}
+
+static void* drain_socket(void* arg) {
+  Sink* sink = (Sink*)arg;
+  char buff[65536];
+  // the receive timeout lets the drainer notice stop
+  while (!__atomic_load_n(&sink->stop, __ATOMIC_ACQUIRE) || recv(sink->socket, buff, sizeof(buff), MSG_DONTWAIT) > 0) {
+    recv(sink->socket, buff, sizeof(buff), 0);
+  }
+  return NULL;
+}
+
+static int socket_open(Sink* sink) {
+  snprintf(sink->path, sizeof(sink->path), "/tmp/c_logger_bench_%d.sock", (int)getpid());
+  unlink(sink->path);
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+  strcpy(address.sun_path, sink->path);
+
+  sink->socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (sink->socket < 0) return -1;
+  struct timeval timeout = { 0, 100000 };
+  setsockopt(sink->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (bind(sink->socket, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(sink->socket);
+    sink->socket = -1;
+    return -1;
+  }
+  pthread_create(&sink->drainer, NULL, drain_socket, sink);
+  return 0;
+}
+
+// Returns -1 when the sink is unavailable here (e.g. no controlling tty).
+static int sink_open(Sink* sink, SinkType type) {
+  memset(sink, 0, sizeof(Sink));
+  sink->pipe_read = -1;
+  sink->socket = -1;
+
+  switch (type) {
+    case SINK_TTY:
+      sink->stream = fopen("/dev/tty", "w");
+      break;
+    case SINK_FILE: {
+      snprintf(sink->path, sizeof(sink->path), "/tmp/c_logger_bench_XXXXXX");
+      int fd = mkstemp(sink->path);
+      if (fd >= 0) sink->stream = fdopen(fd, "w");
+      break;
+    }
+    case SINK_DEV_NULL:
+      sink->stream = fopen("/dev/null", "w");
+      break;
+    case SINK_PIPE: {
+      int fds[2];
+      if (pipe(fds) != 0) return -1;
+      sink->pipe_read = fds[0];
+      sink->stream = fdopen(fds[1], "w");
+      pthread_create(&sink->drainer, NULL, drain_pipe, sink);
+      break;
+    }
+    case SINK_SOCKET:
+      return socket_open(sink);
+  }
+  return sink->stream ? 0 : -1;
+}
+
+static void sink_close(Sink* sink) {
+  if (sink->socket >= 0) {
+    __atomic_store_n(&sink->stop, true, __ATOMIC_RELEASE);
+    pthread_join(sink->drainer, NULL);
+    close(sink->socket);
+  }
+  if (sink->stream) fclose(sink->stream);
+  if (sink->pipe_read >= 0) {
+    pthread_join(sink->drainer, NULL);
+    close(sink->pipe_read);
+  }
+  if (sink->path[0]) unlink(sink->path);
+}
+
+//####################
+// RUNS
+//####################
+
+static void* run_thread(void* arg) {
+  Run* run = (Run*)arg;
+  pthread_barrier_wait(run->start);
+
+  for (size_t i = 0; i < run->messages; ++i) {
+    uint64_t start = now_ns();
+    if (run->enabled) {
+      if (run->long_message) {
+        log_info(run->logger, "%s %zu\n", long_message, i);
+      } else {
+        log_info(run->logger, "short message %zu\n", i);
+      }
+    } else {
+      if (run->long_message) {
+        log_debug(run->logger, "%s %zu\n", long_message, i);
+      } else {
+        log_debug(run->logger, "short message %zu\n", i);
+      }
+    }
+    run->latencies[i] = now_ns() - start;
+  }
+  return NULL;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t* sorted, size_t count, double p) {
+  size_t index = (size_t)(p * (double)(count - 1));
+  return sorted[index];
+}
+
+static void bench(Mode mode, SinkType type, int threads, bool enabled, bool long_msg, size_t messages) {
+  Sink sink;
+  if (sink_open(&sink, type) != 0) {
+    fprintf(stderr, "skipping %s sink: unavailable\n", SINK_NAMES[type]);
+    return;
+  }
+
+  Logger* logger = NULL;
+  LogNetSink* net = NULL;
+  LogCompressSink* compress = NULL;
+  switch (mode) {
+    case MODE_SYNC:
+      logger = logger_new(INFO, sink.stream, sink.stream);
+      break;
+    case MODE_ASYNC:
+      logger = logger_new_async(INFO, sink.stream, sink.stream, 0);
+      break;
+    case MODE_BATCHED:
+      logger = logger_new_batched(INFO, sink.stream, sink.stream, 0, (BatchPolicy){ 0, 0 });
+      break;
+    case MODE_SHARDED:
+      logger = logger_new_sharded(INFO, sink.stream, sink.stream, 0, 0);
+      break;
+    case MODE_RECORDER:
+      logger = logger_new(INFO, sink.stream, sink.stream);
+      logger_set_flight_recorder(logger, 0, VERBOSE);
+      break;
+    case MODE_DIRECT:
+      logger = logger_new_direct(INFO, fileno(sink.stream), fileno(sink.stream), 0);
+      break;
+    case MODE_MMAP:
+      logger = logger_new_mmap(INFO, sink.path, 0, 0);
+      break;
+    case MODE_NET: {
+      NetSinkPolicy policy = { LOG_TRANSPORT_UNIX_DGRAM, sink.path, false, 0, NULL, 0, 0 };
+      net = log_net_sink_new(&policy);
+      logger = logger_new_sinks();
+      logger_add_net_sink(logger, net, INFO, NULL);
+      logger_set_flush_policy(logger, (FlushPolicy){ FLUSH_EVERY_N_BYTES, 65536, FATAL, false });
+      break;
+    }
+    case MODE_COMPRESS:
+      compress = log_compress_sink_new(sink.path, 0, 0);
+      logger = logger_new_sinks();
+      logger_add_compress_sink(logger, compress, INFO, NULL);
+      break;
+  }
+
+  size_t total = messages * (size_t)threads;
+  uint64_t* latencies = (uint64_t*)malloc(total * sizeof(uint64_t));
+  pthread_t* ids = (pthread_t*)malloc((size_t)threads * sizeof(pthread_t));
+  Run* runs = (Run*)malloc((size_t)threads * sizeof(Run));
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, (unsigned)threads + 1);
+
+  for (int i = 0; i < threads; ++i) {
+    runs[i] = (Run){ logger, enabled, long_msg, messages, latencies + (size_t)i * messages, &start };
+    pthread_create(&ids[i], NULL, run_thread, &runs[i]);
+  }
+  // taken before releasing the threads, they may finish before we are rescheduled
+  uint64_t begin = now_ns();
+  pthread_barrier_wait(&start);
+  for (int i = 0; i < threads; ++i) {
+    pthread_join(ids[i], NULL);
+  }
+  logger_free(logger);
+  if (compress) log_compress_sink_free(compress);
+  uint64_t elapsed = now_ns() - begin;
+  if (net) {
+    // a receiver slower than the loggers costs records, not latency
+    uint64_t dropped = log_net_sink_dropped(net);
+    if (dropped) fprintf(stderr, "net: %llu records dropped\n", (unsigned long long)dropped);
+    log_net_sink_free(net);
+  }
+
+  qsort(latencies, total, sizeof(uint64_t), compare_u64);
+  double seconds = (double)elapsed / 1e9;
+  printf("%s,%s,%d,%s,%s,%zu,%.6f,%.0f,%llu,%llu,%llu,%llu\n",
+    MODE_NAMES[mode], SINK_NAMES[type], threads, enabled ? "enabled" : "filtered", long_msg ? "long" : "short",
+    total, seconds, (double)total / seconds,
+    (unsigned long long)percentile(latencies, total, 0.50),
+    (unsigned long long)percentile(latencies, total, 0.99),
+    (unsigned long long)percentile(latencies, total, 0.999),
+    (unsigned long long)latencies[total - 1]);
+  fflush(stdout);
+
+  pthread_barrier_destroy(&start);
+  free(runs);
+  free(ids);
+  free(latencies);
+  sink_close(&sink);
+}
+
+int main(int argc, char** argv) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : DEFAULT_MAX_THREADS;
+  size_t messages = argc > 2 ? (size_t)atol(argv[2]) : DEFAULT_MESSAGES;
+  if (max_threads < 1 || messages < 1) {
+    fprintf(stderr, "usage: %s [max_threads] [messages_per_thread]\n", argv[0]);
+    return 1;
+  }
+
+  memset(long_message, 'x', LONG_MESSAGE_SIZE - 1);
+  long_message[LONG_MESSAGE_SIZE - 1] = '\0';
+
+  printf("mode,sink,threads,level,message,records,seconds,msgs_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+  for (int mode = MODE_SYNC; mode <= MODE_COMPRESS; ++mode) {
+    for (int type = SINK_TTY; type <= SINK_SOCKET; ++type) {
+      if ((mode == MODE_MMAP || mode == MODE_COMPRESS) && type != SINK_FILE) continue;
+      if ((mode == MODE_NET) != (type == SINK_SOCKET)) continue;
+      size_t count = type == SINK_TTY ? messages / TTY_MESSAGES_DIVISOR + 1 : messages;
+      for (int threads = 1; threads <= max_threads; threads *= 2) {
+        for (int enabled = 1; enabled >= 0; --enabled) {
+          bench((Mode)mode, (SinkType)type, threads, enabled, false, count);
+          bench((Mode)mode, (SinkType)type, threads, enabled, true, count);
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,21 @@
+#include <stdio.h>
+
+#include "../lib/c_logger.h"
+
+// Turns a LOG_BINARY file back into text: decode [file] (stdin by default)
+int main(int argc, char** argv) {
+  FILE* bin = stdin;
+  if (argc > 1) {
+    bin = fopen(argv[1], "rb");
+    if (bin == NULL) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+
+  int result = logger_decode_binary(bin, stdout);
+  if (result != 0) fprintf(stderr, "Malformed or truncated binary log\n");
+
+  if (bin != stdin) fclose(bin);
+  return result == 0 ? 0 : 1;
+}
@@ -0,0 +1,21 @@
+#include <stdio.h>
+
+#include "../lib/c_logger.h"
+
+// Turns a compressed log back into text: decompress [file] (stdin by default)
+int main(int argc, char** argv) {
+  FILE* in = stdin;
+  if (argc > 1) {
+    in = fopen(argv[1], "rb");
+    if (in == NULL) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+
+  int result = log_decompress(in, stdout);
+  if (result != 0) fprintf(stderr, "Skipped torn or damaged blocks\n");
+
+  if (in != stdin) fclose(in);
+  return result == 0 ? 0 : 1;
+}
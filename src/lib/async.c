@@ -0,0 +1,361 @@
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "./logger_internal.h"
+
+//####################
+// ASYNC
+//####################
+
+// Bounded multi-producer / single-consumer ring. Each slot carries a sequence
+// number: producers claim a position with a CAS on enqueue_pos, format the
+// record straight into the slot and publish it by bumping the sequence; the
+// writer thread is the only consumer.
+
+#define CACHE_LINE 64
+#define SPINS_BEFORE_SLEEP 128
+#define WRITER_IDLE_WAIT_MS 100
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+typedef struct AsyncSlot {
+  size_t seq;
+  LogLevel level;
+  size_t len;
+  char* heap; // set when the record did not fit in data
+  char data[ASYNC_SLOT_SIZE];
+} __attribute__((aligned(CACHE_LINE))) AsyncSlot;
+
+struct AsyncQueue {
+  size_t enqueue_pos __attribute__((aligned(CACHE_LINE)));
+  size_t dequeue_pos __attribute__((aligned(CACHE_LINE)));
+  int sleeping __attribute__((aligned(CACHE_LINE)));
+  int stop;
+  size_t mask;
+  AsyncSlot* slots;
+  Logger* logger;
+  BatchPolicy batch;
+  struct iovec* iov; // batched writers only
+  pthread_t writer;
+  pthread_mutex_t wait_lock;
+  pthread_cond_t wait_cond;
+};
+
+static size_t next_pow2(size_t n) {
+  size_t p = 2;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+static bool queue_has_pending(AsyncQueue* queue) {
+  AsyncSlot* slot = &queue->slots[queue->dequeue_pos & queue->mask];
+  return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == queue->dequeue_pos + 1;
+}
+
+static void write_slot(AsyncQueue* queue, AsyncSlot* slot) {
+  logger_write(queue->logger, slot->level, slot->heap ? slot->heap : slot->data, slot->len);
+  free(slot->heap);
+  slot->heap = NULL;
+}
+
+// Writes every published record, returns how many were written.
+static size_t drain(AsyncQueue* queue) {
+  size_t written = 0;
+  while (queue_has_pending(queue)) {
+    size_t pos = queue->dequeue_pos;
+    AsyncSlot* slot = &queue->slots[pos & queue->mask];
+    write_slot(queue, slot);
+    __atomic_store_n(&slot->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    queue->dequeue_pos = pos + 1;
+    ++written;
+  }
+  return written;
+}
+
+//------------------------------
+// Batched writes
+//------------------------------
+
+// Published records from dequeue_pos on, up to limit.
+static size_t count_pending(AsyncQueue* queue, size_t limit) {
+  size_t count = 0;
+  while (count < limit) {
+    size_t pos = queue->dequeue_pos + count;
+    AsyncSlot* slot = &queue->slots[pos & queue->mask];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) break;
+    ++count;
+  }
+  return count;
+}
+
+// Returns the bytes written.
+static size_t write_batch(int fd, struct iovec* iov, int count) {
+  size_t total = 0;
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, count);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "Failed to write log batch: %s\n", strerror(errno));
+      return total;
+    }
+    total += (size_t)written;
+    // short write: skip what went through and resume mid-record
+    while (count > 0 && (size_t)written >= iov->iov_len) {
+      written -= (ssize_t)iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = (char*)iov->iov_base + written;
+      iov->iov_len -= (size_t)written;
+    }
+  }
+  return total;
+}
+
+// Writes up to batch.max_records records with one writev per run of records
+// going to the same descriptor, returns how many were written.
+static size_t drain_batch(AsyncQueue* queue) {
+  size_t count = count_pending(queue, queue->batch.max_records);
+  if (count == 0) return 0;
+  if (count < queue->batch.max_records && queue->batch.max_latency_us > 0) {
+    // let the batch fill, bounded by the latency the caller accepts
+    struct timespec wait = {
+      .tv_sec = queue->batch.max_latency_us / 1000000,
+      .tv_nsec = (long)(queue->batch.max_latency_us % 1000000) * 1000L
+    };
+    nanosleep(&wait, NULL);
+    count = count_pending(queue, queue->batch.max_records);
+  }
+
+  Logger* logger = queue->logger;
+  logger_lock(logger);
+  // anything still in the stdio buffers goes first
+  flush_streams(logger);
+  int fd = -1;
+  int iov_count = 0;
+  size_t bytes = 0;
+  for (size_t i = 0; i < count; ++i) {
+    AsyncSlot* slot = &queue->slots[(queue->dequeue_pos + i) & queue->mask];
+    int target = fileno(logger_stream(logger, slot->level));
+    if (target != fd && iov_count > 0) {
+      bytes += write_batch(fd, queue->iov, iov_count);
+      iov_count = 0;
+    }
+    fd = target;
+    queue->iov[iov_count].iov_base = slot->heap ? slot->heap : slot->data;
+    queue->iov[iov_count].iov_len = slot->len;
+    ++iov_count;
+  }
+  if (iov_count > 0) bytes += write_batch(fd, queue->iov, iov_count);
+  if (logger->stats) stats_bytes(logger->stats, bytes);
+  logger_unlock(logger);
+
+  for (size_t i = 0; i < count; ++i) {
+    size_t pos = queue->dequeue_pos;
+    AsyncSlot* slot = &queue->slots[pos & queue->mask];
+    free(slot->heap);
+    slot->heap = NULL;
+    __atomic_store_n(&slot->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    queue->dequeue_pos = pos + 1;
+  }
+  return count;
+}
+
+static size_t drain_any(AsyncQueue* queue) {
+  return queue->iov ? drain_batch(queue) : drain(queue);
+}
+
+static void writer_wait(AsyncQueue* queue) {
+  pthread_mutex_lock(&queue->wait_lock);
+  __atomic_store_n(&queue->sleeping, 1, __ATOMIC_SEQ_CST);
+  if (!queue_has_pending(queue) && !__atomic_load_n(&queue->stop, __ATOMIC_ACQUIRE)) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += WRITER_IDLE_WAIT_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&queue->wait_cond, &queue->wait_lock, &deadline);
+  }
+  __atomic_store_n(&queue->sleeping, 0, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&queue->wait_lock);
+}
+
+static void* writer_main(void* arg) {
+  AsyncQueue* queue = (AsyncQueue*)arg;
+  int idle = 0;
+
+  while (true) {
+    if (drain_any(queue) > 0) {
+      idle = 0;
+      continue;
+    }
+    if (__atomic_load_n(&queue->stop, __ATOMIC_ACQUIRE)) {
+      // producers are gone once stop is set, one last pass catches stragglers
+      while (drain_any(queue) > 0);
+      break;
+    }
+    if (++idle < SPINS_BEFORE_SLEEP) {
+      sched_yield();
+      continue;
+    }
+    writer_wait(queue);
+    idle = 0;
+  }
+  return NULL;
+}
+
+static void wake_writer(AsyncQueue* queue) {
+  // pairs with the store to sleeping in writer_wait: either the writer sees
+  // the published slot or we see it asleep
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(&queue->sleeping, __ATOMIC_RELAXED)) return;
+
+  pthread_mutex_lock(&queue->wait_lock);
+  pthread_cond_signal(&queue->wait_cond);
+  pthread_mutex_unlock(&queue->wait_lock);
+}
+
+AsyncQueue* async_queue_new(Logger* logger, size_t capacity, const BatchPolicy* batch) {
+  assert(logger != NULL);
+
+  AsyncQueue* queue = NULL;
+  if (posix_memalign((void**)&queue, CACHE_LINE, sizeof(AsyncQueue)) != 0) return NULL;
+  memset(queue, 0, sizeof(AsyncQueue));
+
+  size_t size = next_pow2(capacity ? capacity : ASYNC_DEFAULT_CAPACITY);
+  if (posix_memalign((void**)&queue->slots, CACHE_LINE, size * sizeof(AsyncSlot)) != 0) {
+    free(queue);
+    return NULL;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    queue->slots[i].seq = i;
+    queue->slots[i].heap = NULL;
+  }
+  queue->mask = size - 1;
+  queue->logger = logger;
+  if (batch) {
+    queue->batch = *batch;
+    if (queue->batch.max_records == 0) queue->batch.max_records = BATCH_DEFAULT_RECORDS;
+    if (queue->batch.max_latency_us == 0) queue->batch.max_latency_us = BATCH_DEFAULT_LATENCY_US;
+    if (queue->batch.max_records > size) queue->batch.max_records = size;
+    if (queue->batch.max_records > IOV_MAX) queue->batch.max_records = IOV_MAX;
+    queue->iov = (struct iovec*)malloc(queue->batch.max_records * sizeof(struct iovec));
+    if (!queue->iov) {
+      free(queue->slots);
+      free(queue);
+      return NULL;
+    }
+  }
+  pthread_mutex_init(&queue->wait_lock, NULL);
+  pthread_cond_init(&queue->wait_cond, NULL);
+
+  if (pthread_create(&queue->writer, NULL, writer_main, queue) != 0) {
+    pthread_cond_destroy(&queue->wait_cond);
+    pthread_mutex_destroy(&queue->wait_lock);
+    free(queue->iov);
+    free(queue->slots);
+    free(queue);
+    return NULL;
+  }
+  return queue;
+}
+
+void async_queue_free(AsyncQueue* queue) {
+  assert(queue != NULL);
+
+  pthread_mutex_lock(&queue->wait_lock);
+  __atomic_store_n(&queue->stop, 1, __ATOMIC_RELEASE);
+  pthread_cond_signal(&queue->wait_cond);
+  pthread_mutex_unlock(&queue->wait_lock);
+  pthread_join(queue->writer, NULL);
+
+  pthread_cond_destroy(&queue->wait_cond);
+  pthread_mutex_destroy(&queue->wait_lock);
+  free(queue->iov);
+  free(queue->slots);
+  free(queue);
+}
+
+static AsyncSlot* claim_slot(AsyncQueue* queue) {
+  size_t pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+  while (true) {
+    AsyncSlot* slot = &queue->slots[pos & queue->mask];
+    size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return slot;
+      }
+    } else if (diff < 0) {
+      // full: the writer is behind, back off until it frees a slot
+      wake_writer(queue);
+      sched_yield();
+      pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    } else {
+      pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+void async_queue_push(AsyncQueue* queue, LogLevel level, const char* message, va_list args) {
+  assert(queue != NULL && message != NULL);
+
+  AsyncSlot* slot = claim_slot(queue);
+  size_t pos = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+  va_list copy;
+  va_copy(copy, args);
+  int len = logger_render(queue->logger, level, slot->data, ASYNC_SLOT_SIZE, message, args);
+  if (len >= ASYNC_SLOT_SIZE) {
+    slot->heap = (char*)malloc((size_t)len + 1);
+    if (slot->heap) {
+      logger_render(queue->logger, level, slot->heap, (size_t)len + 1, message, copy);
+    } else {
+      len = ASYNC_SLOT_SIZE - 1;
+    }
+  }
+  va_end(copy);
+
+  slot->level = level;
+  slot->len = len < 0 ? 0 : (size_t)len;
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  wake_writer(queue);
+}
+
+void async_queue_push_line(AsyncQueue* queue, LogLevel level, const char* line, size_t len) {
+  assert(queue != NULL && line != NULL);
+
+  AsyncSlot* slot = claim_slot(queue);
+  size_t pos = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+  if (len < ASYNC_SLOT_SIZE) {
+    memcpy(slot->data, line, len);
+  } else {
+    slot->heap = (char*)malloc(len);
+    if (slot->heap) {
+      memcpy(slot->heap, line, len);
+    } else {
+      len = ASYNC_SLOT_SIZE - 1;
+      memcpy(slot->data, line, len);
+    }
+  }
+
+  slot->level = level;
+  slot->len = len;
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  wake_writer(queue);
+}
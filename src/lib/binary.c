@@ -0,0 +1,540 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "./logger_internal.h"
+
+//####################
+// BINARY
+//####################
+
+// File layout (native endianness, decoded on the same architecture):
+//   "CLOGBIN3" | u32 format count | per format: u32 length, format bytes
+//   records:   BinaryHeader | category bytes | payload
+// Packed payloads hold one 8 byte slot per integer/pointer/double argument,
+// sizeof(long double) bytes for long doubles, and u32 length + bytes for
+// strings (UINT32_MAX for NULL). Text records hold the formatted message.
+// The category name (category_len bytes, no terminator) is counted in size;
+// the decoder puts it back after the timestamp, as the text logger does.
+
+#define BINARY_MAGIC "CLOGBIN3"
+#define BINARY_MAGIC_LEN 8
+#define BINARY_TEXT_ID UINT32_MAX
+#define BINARY_NULL_STRING UINT32_MAX
+#define SPEC_MAX_LEN 64
+
+typedef struct BinaryHeader {
+  uint32_t id;
+  uint32_t size;
+  int64_t sec;
+  uint32_t nsec;
+  uint16_t level;
+  uint8_t precision;
+  uint8_t category_len;
+  uint64_t sample;
+} BinaryHeader;
+
+typedef enum ArgType {
+  ARG_INT = 1,
+  ARG_LONG,
+  ARG_LLONG,
+  ARG_SIZE,
+  ARG_INTMAX,
+  ARG_PTRDIFF,
+  ARG_DOUBLE,
+  ARG_LDOUBLE,
+  ARG_STRING,
+  ARG_POINTER
+} ArgType;
+
+#define PRECISION_NONE -1
+#define PRECISION_STAR -2
+
+typedef struct FormatSpec {
+  size_t len; // from '%' through the conversion character
+  bool width_star;
+  bool precision_star;
+  int precision;
+  char length[3];
+  char conversion;
+} FormatSpec;
+
+extern LogFormat __start_c_logger_formats[] __attribute__((weak));
+extern LogFormat __stop_c_logger_formats[] __attribute__((weak));
+
+static bool is_registered(const LogFormat* format) {
+  return __start_c_logger_formats != NULL
+    && format >= __start_c_logger_formats
+    && format < __stop_c_logger_formats;
+}
+
+//------------------------------
+// FORMAT PARSING
+//------------------------------
+
+// Parses the conversion at p ('%'). Returns false on a truncated conversion.
+static bool parse_spec(const char* p, FormatSpec* spec) {
+  const char* start = p++;
+  memset(spec, 0, sizeof(FormatSpec));
+  spec->precision = PRECISION_NONE;
+
+  while (*p && strchr("-+ #0'", *p)) ++p;
+  if (*p == '*') {
+    spec->width_star = true;
+    ++p;
+  } else {
+    while (*p >= '0' && *p <= '9') ++p;
+  }
+  if (*p == '.') {
+    ++p;
+    if (*p == '*') {
+      spec->precision_star = true;
+      spec->precision = PRECISION_STAR;
+      ++p;
+    } else {
+      spec->precision = 0;
+      while (*p >= '0' && *p <= '9') spec->precision = spec->precision * 10 + (*p++ - '0');
+    }
+  }
+  size_t n = 0;
+  while (*p && strchr("hlLqjzt", *p) && n < sizeof(spec->length) - 1) spec->length[n++] = *p++;
+  if (!*p) return false;
+
+  spec->conversion = *p++;
+  spec->len = (size_t)(p - start);
+  return true;
+}
+
+// Argument type of a conversion, 0 for "%%", -1 for what cannot be packed.
+static int spec_arg_type(const FormatSpec* spec) {
+  const char* l = spec->length;
+  switch (spec->conversion) {
+    case '%':
+      return 0;
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+      if (strcmp(l, "") == 0 || strcmp(l, "h") == 0 || strcmp(l, "hh") == 0) return ARG_INT;
+      if (strcmp(l, "l") == 0) return ARG_LONG;
+      if (strcmp(l, "ll") == 0 || strcmp(l, "q") == 0) return ARG_LLONG;
+      if (strcmp(l, "z") == 0) return ARG_SIZE;
+      if (strcmp(l, "j") == 0) return ARG_INTMAX;
+      if (strcmp(l, "t") == 0) return ARG_PTRDIFF;
+      return -1;
+    case 'c':
+      return l[0] == '\0' ? ARG_INT : -1;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      if (l[0] == '\0' || strcmp(l, "l") == 0) return ARG_DOUBLE;
+      if (strcmp(l, "L") == 0) return ARG_LDOUBLE;
+      return -1;
+    case 's':
+      return l[0] == '\0' ? ARG_STRING : -1;
+    case 'p':
+      return ARG_POINTER;
+    default:
+      return -1;
+  }
+}
+
+static void parse_format(LogFormat* format) {
+  int count = 0;
+  const char* p = format->format;
+
+  while ((p = strchr(p, '%')) != NULL) {
+    FormatSpec spec;
+    if (!parse_spec(p, &spec)) goto unsupported;
+    p += spec.len;
+
+    int type = spec_arg_type(&spec);
+    if (type < 0) goto unsupported;
+    if (type == 0) continue;
+
+    int needed = 1 + spec.width_star + spec.precision_star;
+    if (count + needed > LOG_FORMAT_MAX_ARGS) goto unsupported;
+    if (spec.width_star) {
+      format->arg_types[count] = ARG_INT;
+      format->arg_precisions[count++] = PRECISION_NONE;
+    }
+    if (spec.precision_star) {
+      format->arg_types[count] = ARG_INT;
+      format->arg_precisions[count++] = PRECISION_NONE;
+    }
+    format->arg_types[count] = (unsigned char)type;
+    format->arg_precisions[count++] = spec.precision;
+  }
+  // racing first calls parse the same thing, arg_count publishes the result
+  __atomic_store_n(&format->arg_count, count, __ATOMIC_RELEASE);
+  return;
+
+unsupported:
+  __atomic_store_n(&format->arg_count, LOG_FORMAT_UNSUPPORTED, __ATOMIC_RELEASE);
+}
+
+//------------------------------
+// PACKING
+//------------------------------
+
+static void put(char* buff, size_t size, size_t* offset, const void* value, size_t len) {
+  if (*offset + len <= size) memcpy(buff + *offset, value, len);
+  *offset += len;
+}
+
+static void put_u64(char* buff, size_t size, size_t* offset, uint64_t value) {
+  put(buff, size, offset, &value, sizeof(value));
+}
+
+// Packs the arguments after offset, returns the total size needed; only writes
+// what fits in size.
+static size_t pack_args(const LogFormat* format, char* buff, size_t size, size_t offset, va_list args) {
+  int last_int = -1;
+
+  for (int i = 0; i < format->arg_count; ++i) {
+    switch (format->arg_types[i]) {
+      case ARG_INT: {
+        int value = va_arg(args, int);
+        last_int = value;
+        put_u64(buff, size, &offset, (uint64_t)(int64_t)value);
+        break;
+      }
+      case ARG_LONG:
+        put_u64(buff, size, &offset, (uint64_t)va_arg(args, long));
+        break;
+      case ARG_LLONG:
+        put_u64(buff, size, &offset, (uint64_t)va_arg(args, long long));
+        break;
+      case ARG_SIZE:
+        put_u64(buff, size, &offset, (uint64_t)va_arg(args, size_t));
+        break;
+      case ARG_INTMAX:
+        put_u64(buff, size, &offset, (uint64_t)va_arg(args, intmax_t));
+        break;
+      case ARG_PTRDIFF:
+        put_u64(buff, size, &offset, (uint64_t)va_arg(args, ptrdiff_t));
+        break;
+      case ARG_POINTER:
+        put_u64(buff, size, &offset, (uint64_t)(uintptr_t)va_arg(args, void*));
+        break;
+      case ARG_DOUBLE: {
+        double value = va_arg(args, double);
+        put(buff, size, &offset, &value, sizeof(value));
+        break;
+      }
+      case ARG_LDOUBLE: {
+        long double value = va_arg(args, long double);
+        put(buff, size, &offset, &value, sizeof(value));
+        break;
+      }
+      case ARG_STRING: {
+        const char* value = va_arg(args, const char*);
+        uint32_t len = BINARY_NULL_STRING;
+        if (value) {
+          int precision = format->arg_precisions[i];
+          if (precision == PRECISION_STAR) precision = last_int;
+          len = (uint32_t)(precision >= 0 ? strnlen(value, (size_t)precision) : strlen(value));
+        }
+        put(buff, size, &offset, &len, sizeof(len));
+        if (value) put(buff, size, &offset, value, len);
+        break;
+      }
+    }
+  }
+  return offset;
+}
+
+static void fill_header(const Logger* logger, BinaryHeader* header, uint32_t id, size_t size, LogLevel level) {
+  struct timespec now;
+  clock_gettime(logger->ts_clock, &now);
+
+  header->id = id;
+  header->size = (uint32_t)size;
+  header->sec = (int64_t)now.tv_sec;
+  header->nsec = (uint32_t)now.tv_nsec;
+  header->level = (uint16_t)level;
+  header->precision = (uint8_t)logger->ts_precision;
+  header->category_len = 0;
+  header->sample = logger_record_sample;
+}
+
+static void write_packed(const Logger* logger, LogFormat* format, va_list args) {
+  va_list copy;
+  va_copy(copy, args);
+
+  char* buff = logger_buffer(BUFF_SIZE_RECORD);
+  size_t size = BUFF_SIZE_RECORD;
+  size_t len = pack_args(format, buff, size, sizeof(BinaryHeader), args);
+  if (len > size) {
+    buff = logger_buffer(len);
+    if (buff) pack_args(format, buff, len, sizeof(BinaryHeader), copy);
+  }
+  va_end(copy);
+  if (!buff) return;
+
+  BinaryHeader header;
+  fill_header(logger, &header, (uint32_t)(format - __start_c_logger_formats), len - sizeof(BinaryHeader), format->level);
+  memcpy(buff, &header, sizeof(header));
+  logger_write(logger, format->level, buff, len);
+}
+
+void binary_write_text(const Logger* logger, LogLevel level, const char* message, va_list args) {
+  assert(logger != NULL && message != NULL);
+
+  va_list copy;
+  va_copy(copy, args);
+
+  const char* category = logger_record_category;
+  size_t category_len = category ? strnlen(category, LOG_CATEGORY_NAME_SIZE - 1) : 0;
+
+  char* buff = logger_buffer(BUFF_SIZE_RECORD);
+  size_t offset = sizeof(BinaryHeader) + category_len;
+  int body = format_vsnprintf(buff + offset, BUFF_SIZE_RECORD - offset, message, args);
+  if (body >= 0 && offset + (size_t)body >= BUFF_SIZE_RECORD) {
+    buff = logger_buffer(offset + (size_t)body + 1);
+    if (buff) format_vsnprintf(buff + offset, (size_t)body + 1, message, copy);
+  }
+  va_end(copy);
+  if (!buff || body < 0) return;
+
+  BinaryHeader header;
+  fill_header(logger, &header, BINARY_TEXT_ID, category_len + (size_t)body, level);
+  header.category_len = (uint8_t)category_len;
+  memcpy(buff, &header, sizeof(header));
+  memcpy(buff + sizeof(header), category, category_len);
+  logger_write(logger, level, buff, offset + (size_t)body);
+}
+
+void binary_write_line(const Logger* logger, LogLevel level, char* line, size_t len) {
+  assert(logger != NULL && line != NULL);
+  _Static_assert(sizeof(BinaryHeader) <= LOGGER_LINE_HEADROOM, "binary header must fit the line headroom");
+
+  BinaryHeader header;
+  fill_header(logger, &header, BINARY_TEXT_ID, len, level);
+  char* record = line - sizeof(BinaryHeader);
+  memcpy(record, &header, sizeof(header));
+  logger_write(logger, level, record, sizeof(BinaryHeader) + len);
+}
+
+Logger* logger_new_binary(LogLevel level, FILE* bin) {
+  assert(bin != NULL);
+
+  Logger* logger = logger_new(level, bin, bin);
+  if (!logger) return NULL;
+  logger->binary = true;
+
+  uint32_t count = (uint32_t)(__stop_c_logger_formats - __start_c_logger_formats);
+  fwrite(BINARY_MAGIC, 1, BINARY_MAGIC_LEN, bin);
+  fwrite(&count, sizeof(count), 1, bin);
+  for (uint32_t i = 0; i < count; ++i) {
+    const char* text = __start_c_logger_formats[i].format;
+    uint32_t len = (uint32_t)strlen(text);
+    fwrite(&len, sizeof(len), 1, bin);
+    fwrite(text, 1, len, bin);
+  }
+  fflush(bin);
+  return logger;
+}
+
+void log_binary(const Logger* logger, LogFormat* format, ...) {
+  assert(logger != NULL && format != NULL && format->format != NULL);
+
+  if (!logger_admit(logger, logger_get_level(logger), format->level, 1)) return;
+
+  if (__atomic_load_n(&format->arg_count, __ATOMIC_ACQUIRE) == LOG_FORMAT_UNPARSED) parse_format(format);
+
+  va_list args;
+  va_start(args, format);
+  if (logger->binary && is_registered(format) && format->arg_count != LOG_FORMAT_UNSUPPORTED) {
+    write_packed(logger, format, args);
+    if (logger->stats) stats_emitted(logger->stats, format->level);
+  } else {
+    logger_log(logger, format->level, format->format, args);
+  }
+  va_end(args);
+}
+
+//------------------------------
+// DECODING
+//------------------------------
+
+typedef struct Payload {
+  const char* data;
+  size_t size;
+  size_t offset;
+} Payload;
+
+static bool take(Payload* payload, void* value, size_t len) {
+  if (payload->offset + len > payload->size) return false;
+  memcpy(value, payload->data + payload->offset, len);
+  payload->offset += len;
+  return true;
+}
+
+#define PRINT_SPEC(out, spec, stars, star, value) \
+  ((stars) == 0 ? fprintf((out), (spec), (value)) \
+    : (stars) == 1 ? fprintf((out), (spec), (star)[0], (value)) \
+    : fprintf((out), (spec), (star)[0], (star)[1], (value)))
+
+// Prints one conversion, consuming its (and its '*') arguments from payload.
+static bool print_spec(FILE* out, const FormatSpec* spec, const char* text, int type, Payload* payload) {
+  char conversion[SPEC_MAX_LEN];
+  if (spec->len >= SPEC_MAX_LEN) return false;
+  memcpy(conversion, text, spec->len);
+  conversion[spec->len] = '\0';
+
+  int stars = 0;
+  int star[2];
+  for (int i = 0; i < spec->width_star + spec->precision_star; ++i) {
+    uint64_t value;
+    if (!take(payload, &value, sizeof(value))) return false;
+    star[stars++] = (int)(int64_t)value;
+  }
+
+  uint64_t value = 0;
+  switch (type) {
+    case ARG_DOUBLE: {
+      double d;
+      if (!take(payload, &d, sizeof(d))) return false;
+      PRINT_SPEC(out, conversion, stars, star, d);
+      return true;
+    }
+    case ARG_LDOUBLE: {
+      long double d;
+      if (!take(payload, &d, sizeof(d))) return false;
+      PRINT_SPEC(out, conversion, stars, star, d);
+      return true;
+    }
+    case ARG_STRING: {
+      uint32_t len;
+      if (!take(payload, &len, sizeof(len))) return false;
+      if (len == BINARY_NULL_STRING) {
+        PRINT_SPEC(out, conversion, stars, star, (const char*)NULL);
+        return true;
+      }
+      if (payload->offset + len > payload->size) return false;
+      char* copy = strndup(payload->data + payload->offset, len);
+      if (!copy) return false;
+      payload->offset += len;
+      PRINT_SPEC(out, conversion, stars, star, copy);
+      free(copy);
+      return true;
+    }
+    default:
+      if (!take(payload, &value, sizeof(value))) return false;
+      break;
+  }
+
+  switch (type) {
+    case ARG_INT: PRINT_SPEC(out, conversion, stars, star, (int)(int64_t)value); break;
+    case ARG_LONG: PRINT_SPEC(out, conversion, stars, star, (long)value); break;
+    case ARG_LLONG: PRINT_SPEC(out, conversion, stars, star, (long long)value); break;
+    case ARG_SIZE: PRINT_SPEC(out, conversion, stars, star, (size_t)value); break;
+    case ARG_INTMAX: PRINT_SPEC(out, conversion, stars, star, (intmax_t)value); break;
+    case ARG_PTRDIFF: PRINT_SPEC(out, conversion, stars, star, (ptrdiff_t)value); break;
+    case ARG_POINTER: PRINT_SPEC(out, conversion, stars, star, (void*)(uintptr_t)value); break;
+    default: return false;
+  }
+  return true;
+}
+
+static bool print_packed(FILE* out, const char* format, Payload* payload) {
+  const char* p = format;
+  const char* percent;
+
+  while ((percent = strchr(p, '%')) != NULL) {
+    fwrite(p, 1, (size_t)(percent - p), out);
+
+    FormatSpec spec;
+    if (!parse_spec(percent, &spec)) return false;
+    int type = spec_arg_type(&spec);
+    if (type < 0) return false;
+    if (type == 0) {
+      fputc('%', out);
+    } else if (!print_spec(out, &spec, percent, type, payload)) {
+      return false;
+    }
+    p = percent + spec.len;
+  }
+  fputs(p, out);
+  return true;
+}
+
+static void free_formats(char** formats, uint32_t count) {
+  for (uint32_t i = 0; i < count; ++i) free(formats[i]);
+  free(formats);
+}
+
+int logger_decode_binary(FILE* bin, FILE* out) {
+  assert(bin != NULL && out != NULL);
+
+  char magic[BINARY_MAGIC_LEN];
+  uint32_t count;
+  if (fread(magic, 1, BINARY_MAGIC_LEN, bin) != BINARY_MAGIC_LEN || memcmp(magic, BINARY_MAGIC, BINARY_MAGIC_LEN) != 0) return -1;
+  if (fread(&count, sizeof(count), 1, bin) != 1) return -1;
+
+  char** formats = (char**)calloc(count ? count : 1, sizeof(char*));
+  if (!formats) return -1;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t len;
+    if (fread(&len, sizeof(len), 1, bin) != 1 || !(formats[i] = (char*)malloc((size_t)len + 1))) {
+      free_formats(formats, count);
+      return -1;
+    }
+    if (fread(formats[i], 1, len, bin) != len) {
+      free_formats(formats, count);
+      return -1;
+    }
+    formats[i][len] = '\0';
+  }
+
+  int result = 0;
+  char* data = NULL;
+  size_t capacity = 0;
+  BinaryHeader header;
+  size_t got;
+  while ((got = fread(&header, 1, sizeof(header), bin)) == sizeof(header)) {
+    if (header.level > VERBOSE || (header.id != BINARY_TEXT_ID && header.id >= count)
+      || header.category_len >= LOG_CATEGORY_NAME_SIZE || header.category_len > header.size) {
+      result = -1;
+      break;
+    }
+    if (header.size > capacity) {
+      char* grown = (char*)realloc(data, header.size);
+      if (!grown) {
+        result = -1;
+        break;
+      }
+      data = grown;
+      capacity = header.size;
+    }
+    if (fread(data, 1, header.size, bin) != header.size) {
+      result = -1;
+      break;
+    }
+
+    struct timespec time = { .tv_sec = (time_t)header.sec, .tv_nsec = (long)header.nsec };
+    char stamp[BUFF_SIZE_TIMESTAMP];
+    timestamp_format(stamp, &time, (TimestampPrecision)header.precision);
+    char category[LOG_CATEGORY_NAME_SIZE];
+    memcpy(category, data, header.category_len);
+    category[header.category_len] = '\0';
+    char tags[BUFF_SIZE_TAGS];
+    logger_record_tags(tags, sizeof(tags), header.category_len ? category : NULL, header.sample);
+    fprintf(out, "%s(%s)%s -- ", logger_level_tag((LogLevel)header.level), stamp, tags);
+
+    if (header.id == BINARY_TEXT_ID) {
+      fwrite(data + header.category_len, 1, header.size - header.category_len, out);
+    } else {
+      Payload payload = { .data = data, .size = header.size, .offset = header.category_len };
+      if (!print_packed(out, formats[header.id], &payload)) {
+        result = -1;
+        break;
+      }
+    }
+  }
+  if (result == 0 && (got != 0 || !feof(bin))) result = -1;
+
+  free(data);
+  free_formats(formats, count);
+  return result;
+}
@@ -2,8 +2,10 @@
 #define C_LOGGER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <time.h>
 
 //####################
 // ANSI COLOR CODES
@@ -38,6 +40,19 @@
 #define BUFF_SIZE_TIMESTAMP 32
 void timestamp(char* buff, size_t size);
 
+// Digits appended to the "%Y-%m-%d %H:%M:%S" timestamp.
+typedef enum TimestampPrecision {
+  TS_SECONDS = 0,
+  TS_MILLIS = 1,
+  TS_MICROS = 2
+} TimestampPrecision;
+
+#ifdef CLOCK_REALTIME_COARSE
+#define TIMESTAMP_DEFAULT_CLOCK CLOCK_REALTIME_COARSE
+#else
+#define TIMESTAMP_DEFAULT_CLOCK CLOCK_REALTIME
+#endif
+
 typedef enum LogLevel {
   FATAL = 0,
   ERROR = 1,
@@ -48,22 +63,841 @@ typedef enum LogLevel {
   VERBOSE = 6
 } LogLevel;
 
+// Async mode: records are formatted by the caller into a slot of a bounded
+// lock-free ring and written to out/err by a background thread.
+#define ASYNC_DEFAULT_CAPACITY 1024
+#define ASYNC_SLOT_SIZE 512
+
+typedef struct AsyncQueue AsyncQueue;
+
+// Sharded mode: every logging thread appends to a ring of its own and a merger
+// thread writes the records in timestamp order. Records are held back for the
+// reorder window so that late publishers can still be merged in order.
+#define SHARD_DEFAULT_CAPACITY 1024
+#define SHARD_DEFAULT_WINDOW_US 1000
+
+typedef struct ShardSet ShardSet;
+
+// Direct mode: records are rendered on the caller's stack and handed to the
+// kernel with a single write(2), without stdio or the logger lock. Records
+// longer than the logger's limit (at most DIRECT_MAX_RECORD) fall back to a
+// write under the lock.
+#define DIRECT_MAX_RECORD 4096
+
+// Shared-memory mode: producer-only loggers in several processes copy their
+// rendered records into a ring shared through shm_open, drained by a single
+// collector, see SHARED MEMORY. Records longer than a slot are truncated.
+#define SHM_DEFAULT_CAPACITY 4096
+#define SHM_SLOT_SIZE 1000
+#define SHM_DEFAULT_INTERVAL_MS 10
+
+typedef struct LogShm LogShm;
+
+// Flight recorder: the last records at every level kept in memory, see FLIGHT
+// RECORDER. Records longer than a slot are truncated.
+#define RECORDER_DEFAULT_RECORDS 256
+#define RECORDER_SLOT_SIZE 256
+
+typedef struct FlightRecorder FlightRecorder;
+
+// Compiled record layout, see PATTERNS.
+typedef struct LogPattern LogPattern;
+
+// Per-thread counters summed by logger_stats, see STATISTICS.
+typedef struct StatsSet StatsSet;
+
+// Batched writer: the async writer gathers up to max_records pending records
+// into iovecs and hands them to the kernel with one writev per stream,
+// waiting at most max_latency_us for a batch to fill. 0 selects the defaults.
+#define BATCH_DEFAULT_RECORDS 512
+#define BATCH_DEFAULT_LATENCY_US 1000
+
+typedef struct BatchPolicy {
+  size_t max_records; // capped at the ring capacity and IOV_MAX
+  unsigned max_latency_us;
+} BatchPolicy;
+
+// When out/err are flushed. Severity comparisons follow LogLevel, so
+// "at or above ERROR" means FATAL and ERROR.
+typedef enum FlushMode {
+  FLUSH_ALWAYS = 0,          // after every record
+  FLUSH_EVERY_N_RECORDS = 1, // threshold = records
+  FLUSH_EVERY_N_BYTES = 2,   // threshold = bytes
+  FLUSH_INTERVAL = 3,        // threshold = milliseconds, flushed by a timer thread
+  FLUSH_ON_LEVEL = 4         // records at or above level
+} FlushMode;
+
+typedef struct FlushPolicy {
+  FlushMode mode;
+  size_t threshold;
+  LogLevel level;
+  bool sync_errors; // fdatasync after FATAL/ERROR records
+} FlushPolicy;
+
+typedef struct FlushTimer FlushTimer;
+
+// Memory-mapped file sink: threads reserve space with an atomic bump pointer
+// and memcpy the record, no mutex and no syscall on the write path.
+#define MMAP_DEFAULT_CHUNK_SIZE ((size_t)64 << 20)
+#define MMAP_DEFAULT_MAX_SIZE ((size_t)64 << 30)
+
+typedef struct MmapSink MmapSink;
+
+// Rotation by size, by interval or both (0 disables a trigger). The next file
+// is opened ahead of time by a background thread, which also renames the old
+// one to path.1 (shifting older ones up to path.<retention>) and gzips it when
+// compress is set. If the next file is not ready yet the current one keeps
+// growing, so log calls never wait on rotation.
+typedef struct RotationPolicy {
+  size_t max_bytes;
+  unsigned interval_sec;
+  unsigned retention; // rotated files kept, 0 deletes them
+  bool compress;
+} RotationPolicy;
+
+typedef struct Rotator Rotator;
+
+// A record as handed to sinks: the message is formatted once and shared by
+// every sink, each sink's formatter only adds its own prefix around it.
+typedef struct LogRecord {
+  LogLevel level;
+  struct timespec time;
+  TimestampPrecision precision;
+  const char* message;
+  size_t message_len;
+  const char* category; // NULL outside categories
+  uint64_t sample; // calls this record stands for, 1 when not sampled
+} LogRecord;
+
+// Renders a record into buff, snprintf semantics.
+typedef int (*LogFormatter)(const LogRecord* record, char* buff, size_t size);
+
+// Sink vtable; write and flush are called with the logger lock held, close
+// from logger_free. flush and close may be NULL.
+typedef struct LogSinkOps {
+  void (*write)(void* ctx, const LogRecord* record, const char* line, size_t len);
+  void (*flush)(void* ctx);
+  void (*close)(void* ctx);
+} LogSinkOps;
+
+#define LOGGER_MAX_SINKS 8
+
+typedef struct LogSink {
+  const LogSinkOps* ops;
+  void* ctx;
+  LogLevel level;
+  LogFormatter formatter;
+} LogSink;
+
+// Encoding of the records written by log_kv.
+typedef enum LogEncoding {
+  LOG_ENCODING_JSON,
+  LOG_ENCODING_LOGFMT
+} LogEncoding;
+
+#define LOG_CATEGORY_NAME_SIZE 32
+
+// Named part of a program ("net", "db") logging through a logger with a level
+// of its own. Handles live until logger_free.
+typedef struct LogCategory {
+  LogLevel level;
+  struct Logger* logger;
+  struct LogCategory* next;
+  char name[LOG_CATEGORY_NAME_SIZE];
+} LogCategory;
+
 typedef struct Logger {
   pthread_mutex_t lock;
   LogLevel level;
   FILE* out;
   FILE* err;
+  AsyncQueue* async;
+  ShardSet* shards;
+  bool binary;
+  TimestampPrecision ts_precision;
+  clockid_t ts_clock;
+  FlushPolicy flush;
+  size_t pending_records;
+  size_t pending_bytes;
+  FlushTimer* flush_timer;
+  MmapSink* mmap;
+  Rotator* rotator;
+  LogSink sinks[LOGGER_MAX_SINKS];
+  size_t sink_count;
+  LogEncoding kv_encoding;
+  unsigned sample_rate[VERBOSE + 1]; // keep 1 in sample_rate[level] records, 0 and 1 keep all
+  LogCategory* categories;
+  FlightRecorder* recorder;
+  LogLevel record_level; // most verbose level the recorder keeps, FATAL without one
+  StatsSet* stats;
+  int direct_out; // descriptors of a direct logger, -1 otherwise
+  int direct_err;
+  size_t direct_max;
+  LogPattern* pattern; // NULL for LOG_PATTERN_DEFAULT
+  LogShm* shm; // ring a shared-memory producer writes to
+  bool colored_out; // out/err are terminals, detected at creation
+  bool colored_err;
 } Logger;
 
 Logger* logger_new(LogLevel level, FILE* out, FILE* err);
+// capacity is rounded up to a power of two, 0 selects ASYNC_DEFAULT_CAPACITY.
+Logger* logger_new_async(LogLevel level, FILE* out, FILE* err, size_t capacity);
+// Each thread logs into its own ring of capacity records (rounded up to a
+// power of two, 0 selects SHARD_DEFAULT_CAPACITY); 0 selects the default
+// reorder window. Rings of threads that exited are reused.
+Logger* logger_new_sharded(LogLevel level, FILE* out, FILE* err, size_t capacity, unsigned window_us);
+// Async logger writing batches straight to the descriptors of out/err,
+// bypassing their stdio buffers and the flush policy.
+Logger* logger_new_batched(LogLevel level, FILE* out, FILE* err, size_t capacity, BatchPolicy policy);
+// Appends every record to path; chunk_size and max_size of 0 select the
+// defaults. The file grows chunk_size at a time and records past max_size are
+// dropped; logger_free trims the preallocated tail.
+Logger* logger_new_mmap(LogLevel level, const char* path, size_t chunk_size, size_t max_size);
+// Appends every record to path, rotating it according to policy.
+Logger* logger_new_rotating(LogLevel level, const char* path, RotationPolicy policy);
+// Logger without out/err that only writes to the sinks attached to it.
+Logger* logger_new_sinks(void);
+// Writes every record with one write(2) to out_fd (INFO and below) or err_fd.
+// Open them with O_APPEND: appends of a single write then do not interleave,
+// across threads and processes alike, up to PIPE_BUF bytes for pipes and in
+// practice for any record on local files. Records over max_record bytes (0
+// and anything larger select DIRECT_MAX_RECORD) are written under the logger
+// lock, which only orders them within the process. The descriptors are not
+// closed by logger_free.
+Logger* logger_new_direct(LogLevel level, int out_fd, int err_fd, size_t max_record);
+// Producer-only logger copying rendered records into shm, typically created in
+// each worker after fork. shm is not owned by the logger.
+Logger* logger_new_shm(LogLevel level, LogShm* shm);
 void logger_free(Logger* logger);
 
-void log_fatal(const Logger* logger, const char* message, ...);
-void log_error(const Logger* logger, const char* message, ...);
-void log_warn(const Logger* logger, const char* message, ...);
-void log_info(const Logger* logger, const char* message, ...);
-void log_debug(const Logger* logger, const char* message, ...);
-void log_trace(const Logger* logger, const char* message, ...);
-void log_verbose(const Logger* logger, const char* message, ...);
+// The coarse default clock ticks every few ms; use CLOCK_REALTIME with TS_MICROS.
+void logger_set_timestamp(Logger* logger, TimestampPrecision precision, clockid_t clock);
+
+// Returns 0 on success, -1 if the timer thread could not be started.
+int logger_set_flush_policy(Logger* logger, FlushPolicy policy);
+
+// JSON by default.
+void logger_set_kv_encoding(Logger* logger, LogEncoding encoding);
+
+// Keeps a random 1 in one_in records of level (0 and 1 keep all of them).
+// Sampled records carry the factor they stand for, see SAMPLING.
+void logger_set_sampling(Logger* logger, LogLevel level, unsigned one_in);
+
+// Lets the compiler check the arguments against the format, as for printf.
+#define LOG_PRINTF(format_index, first_arg) __attribute__((format(printf, format_index, first_arg)))
+
+void log_fatal(const Logger* logger, const char* message, ...) LOG_PRINTF(2, 3);
+void log_error(const Logger* logger, const char* message, ...) LOG_PRINTF(2, 3);
+void log_warn(const Logger* logger, const char* message, ...) LOG_PRINTF(2, 3);
+void log_info(const Logger* logger, const char* message, ...) LOG_PRINTF(2, 3);
+void log_debug(const Logger* logger, const char* message, ...) LOG_PRINTF(2, 3);
+void log_trace(const Logger* logger, const char* message, ...) LOG_PRINTF(2, 3);
+void log_verbose(const Logger* logger, const char* message, ...) LOG_PRINTF(2, 3);
+
+// level may be changed while other threads log; the check on their side is a
+// relaxed atomic load.
+void logger_set_level(Logger* logger, LogLevel level);
+
+static inline LogLevel logger_get_level(const Logger* logger) {
+  return __atomic_load_n(&logger->level, __ATOMIC_RELAXED);
+}
+
+// Whether a record of level is written or kept by the flight recorder.
+static inline bool logger_enabled(const Logger* logger, LogLevel level) {
+  return logger_get_level(logger) >= level || logger->record_level >= level;
+}
+
+//####################
+// SINKS
+//####################
+
+// Sinks receive every record that passes both the logger's level and their
+// own, rendered by their formatter (NULL selects log_formatter_plain).
+// Loggers without out/err raise their level to the most verbose sink's. Attach
+// sinks before logging; async, sharded, binary and direct loggers do not take
+// sinks.
+// Returns 0 on success, -1 when the logger cannot take another sink.
+int logger_add_sink(Logger* logger, const LogSinkOps* ops, void* ctx, LogLevel level, LogFormatter formatter);
+// stream is flushed according to the flush policy, never closed.
+int logger_add_stream_sink(Logger* logger, FILE* stream, LogLevel level, LogFormatter formatter);
+
+// "[LEVEL] (timestamp) -- message"
+int log_formatter_plain(const LogRecord* record, char* buff, size_t size);
+// log_formatter_plain with the ANSI colored level tag
+int log_formatter_color(const LogRecord* record, char* buff, size_t size);
+// The message alone
+int log_formatter_message(const LogRecord* record, char* buff, size_t size);
+
+// In-memory ring keeping the most recent capacity bytes of output.
+typedef struct LogRing LogRing;
+
+LogRing* log_ring_new(size_t capacity);
+void log_ring_free(LogRing* ring);
+// Copies the retained output, oldest first, returns the bytes copied.
+size_t log_ring_read(LogRing* ring, char* buff, size_t size);
+// The ring is not owned by the logger and outlives it.
+int logger_add_ring_sink(Logger* logger, LogRing* ring, LogLevel level, LogFormatter formatter);
+
+//####################
+// SHARED MEMORY
+//####################
+
+// A pre-forking parent creates the ring, workers inherit it and log through
+// logger_new_shm: a record costs its rendering and one copy, no lock and no
+// system call. One collector (a thread of the parent or any process that
+// opens the ring) writes the records to a real logger, oldest first. A worker
+// dying mid-record never stalls the others: the collector skips its slot once
+// the process is gone (and reaped). Records that find the ring full are
+// dropped and counted.
+
+// Creates, or replaces, the ring /name with capacity slots (rounded up to a
+// power of two, 0 selects SHM_DEFAULT_CAPACITY). Returns NULL on error.
+LogShm* log_shm_create(const char* name, size_t capacity);
+// Maps a ring created by another process. Returns NULL on error.
+LogShm* log_shm_open(const char* name);
+// Stops this process's collector, unmaps the ring and, in the process that
+// created it, removes its name. Loggers writing to it must be freed first.
+void log_shm_close(LogShm* shm);
+// Writes the published records to target, returns how many. Only one process
+// may collect a given ring.
+size_t log_shm_drain(LogShm* shm, const Logger* target);
+// Drains in a background thread, polling every interval_ms (0 selects
+// SHM_DEFAULT_INTERVAL_MS) while idle. target must outlive the collector.
+int log_shm_start_collector(LogShm* shm, Logger* target, unsigned interval_ms);
+// Stops the collector after a last drain.
+void log_shm_stop_collector(LogShm* shm);
+// Records dropped on a full ring or lost with a dead writer.
+uint64_t log_shm_dropped(const LogShm* shm);
+
+//####################
+// NETWORK SINK
+//####################
+
+#define NET_DEFAULT_DATAGRAM_SIZE 16384
+#define NET_DEFAULT_BUFFER_SIZE (1024 * 1024)
+
+typedef enum LogTransport {
+  LOG_TRANSPORT_UNIX_DGRAM,  // address is a socket path, e.g. /dev/log
+  LOG_TRANSPORT_UNIX_STREAM,
+  LOG_TRANSPORT_UDP          // address is "port" (on localhost) or "host:port"
+} LogTransport;
+
+typedef struct NetSinkPolicy {
+  LogTransport transport;
+  const char* address;
+  bool syslog;           // RFC 5424 framing, octet counted on streams (RFC 6587)
+  int facility;          // syslog facility, 0 (kernel only) selects 1 (user)
+  const char* app_name;  // syslog APP-NAME, NULL for the program name
+  size_t datagram_size;  // records are packed into datagrams up to this size
+  size_t buffer_size;    // records queued while the receiver lags
+} NetSinkPolicy;
+
+// Sends records to a local agent over a socket that never blocks the logger.
+// Records are queued and sent on the logger's flushes or once a datagram's
+// worth is queued, so a flush policy other than FLUSH_ALWAYS batches them:
+// datagram transports send many datagrams per sendmmsg call. Records the
+// receiver does not take yet stay queued, those that do not fit in
+// buffer_size bytes are dropped. Stream transports reconnect on the next
+// flush, at most once a second. Sizes of 0 select the defaults.
+typedef struct LogNetSink LogNetSink;
+
+// Returns NULL if the address cannot be resolved or the socket not created.
+LogNetSink* log_net_sink_new(const NetSinkPolicy* policy);
+// Sends what is still queued, once and without waiting, then closes it.
+void log_net_sink_free(LogNetSink* sink);
+// Records dropped because the queue was full or the receiver rejected them.
+uint64_t log_net_sink_dropped(const LogNetSink* sink);
+// The sink is not owned by the logger and must outlive it.
+int logger_add_net_sink(Logger* logger, LogNetSink* sink, LogLevel level, LogFormatter formatter);
+
+//####################
+// COMPRESSED FILE SINK
+//####################
+
+#define COMPRESS_DEFAULT_BLOCK_SIZE (256 * 1024)
+#define COMPRESS_MAX_BLOCK_SIZE (16 * 1024 * 1024)
+#define COMPRESS_DEFAULT_INTERVAL_MS 1000
+
+// Appends records to a file as independently compressed blocks of up to
+// block_size bytes. A background thread compresses a full block while writers
+// fill the other one, and writes a partial block once it is interval_ms old;
+// the logger's flush policy does not cut blocks. After a crash the file holds
+// whole blocks and at most one torn block, which log_decompress skips. Sizes
+// of 0 select the defaults.
+typedef struct LogCompressSink LogCompressSink;
+
+// Returns NULL if the file cannot be opened or the thread started.
+LogCompressSink* log_compress_sink_new(const char* path, size_t block_size, unsigned interval_ms);
+// Compresses and writes what is left, then closes the file.
+void log_compress_sink_free(LogCompressSink* sink);
+// The sink is not owned by the logger and must outlive it.
+int logger_add_compress_sink(Logger* logger, LogCompressSink* sink, LogLevel level, LogFormatter formatter);
+// Writes the text of a compressed log (or `make decompress`). Returns 0 on
+// success, -1 if a block was torn or damaged: the blocks around it are still
+// written, those after it only when in can seek.
+int log_decompress(FILE* in, FILE* out);
+
+//####################
+// INDEXED FILE SINK
+//####################
+
+#define INDEX_DEFAULT_BYTES (64 * 1024)
+#define INDEX_DEFAULT_INTERVAL_MS 1000
+
+// Appends records to path and keeps a sparse sidecar index in path.idx: one
+// entry per run of every_bytes bytes or every_ms milliseconds of records,
+// holding the run's offset, first and last timestamps and the levels in it.
+// log_index_query (or `make query`) uses it to read only the runs of a time
+// range and level instead of the whole file. Sizes of 0 select the defaults.
+typedef struct LogIndexSink LogIndexSink;
+
+// Returns NULL if either file cannot be opened. Both are appended to.
+LogIndexSink* log_index_sink_new(const char* path, size_t every_bytes, unsigned every_ms);
+// Indexes the last run, then closes both files.
+void log_index_sink_free(LogIndexSink* sink);
+// The sink is not owned by the logger and must outlive it.
+int logger_add_index_sink(Logger* logger, LogIndexSink* sink, LogLevel level, LogFormatter formatter);
+
+typedef struct LogQuery {
+  struct timespec from; // record timestamps, zero for no bound
+  struct timespec to;
+  LogLevel level;       // runs without a record at or above level are skipped
+} LogQuery;
+
+// Writes the runs of path that overlap the query to out, whole, followed by
+// the records not indexed yet when the range reaches past the last entry.
+// Returns the number of runs written, -1 if path or its index cannot be read.
+int log_index_query(const char* path, const LogQuery* query, FILE* out);
+
+//####################
+// LEVEL MACROS
+//####################
+
+// LOG_FATAL ... LOG_VERBOSE check the logger's level (and its flight
+// recorder's) inline, before any argument is evaluated. Statements more
+// verbose than C_LOGGER_MIN_LEVEL (a LogLevel, set at build time) compile to
+// nothing.
+#ifndef C_LOGGER_MIN_LEVEL
+#define C_LOGGER_MIN_LEVEL VERBOSE
+#endif
+
+#define LOG_LIKELY(x) __builtin_expect(!!(x), 1)
+#define LOG_UNLIKELY(x) __builtin_expect(!!(x), 0)
+
+// Records the call site for the %F and %l pattern fields around call.
+#define LOG_SITE_(call) do { \
+  log_site_file = __FILE__; \
+  log_site_line = __LINE__; \
+  call; \
+  log_site_file = NULL; \
+} while (0)
+
+#define LOG_AT_(logger, lvl, expect, fn, fmt, ...) do { \
+  if ((lvl) <= C_LOGGER_MIN_LEVEL) { \
+    const Logger* log_logger_ = (logger); \
+    if (expect(logger_enabled(log_logger_, (lvl)))) { \
+      LOG_SITE_(fn(log_logger_, (fmt), ##__VA_ARGS__)); \
+    } \
+  } \
+} while (0)
+
+#define LOG_FATAL(logger, fmt, ...) LOG_AT_(logger, FATAL, LOG_LIKELY, log_fatal, fmt, ##__VA_ARGS__)
+#define LOG_ERROR(logger, fmt, ...) LOG_AT_(logger, ERROR, LOG_LIKELY, log_error, fmt, ##__VA_ARGS__)
+#define LOG_WARN(logger, fmt, ...) LOG_AT_(logger, WARN, LOG_LIKELY, log_warn, fmt, ##__VA_ARGS__)
+#define LOG_INFO(logger, fmt, ...) LOG_AT_(logger, INFO, LOG_LIKELY, log_info, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(logger, fmt, ...) LOG_AT_(logger, DEBUG, LOG_UNLIKELY, log_debug, fmt, ##__VA_ARGS__)
+#define LOG_TRACE(logger, fmt, ...) LOG_AT_(logger, TRACE, LOG_UNLIKELY, log_trace, fmt, ##__VA_ARGS__)
+#define LOG_VERBOSE(logger, fmt, ...) LOG_AT_(logger, VERBOSE, LOG_UNLIKELY, log_verbose, fmt, ##__VA_ARGS__)
+
+
+//####################
+// BINARY
+//####################
+
+// Deferred formatting: LOG_BINARY records a format id, the raw timestamp and
+// the packed arguments; logger_decode_binary (or `make decode`) turns the file
+// back into the text log_* would have written. Every call site owns a static
+// LogFormat placed in the LOG_FORMAT_SECTION ELF section, which is the format
+// table written at the head of the file. Requires linking the library
+// statically (libc_logger.o / libc_logger.a); call sites outside the table,
+// and formats that cannot be packed (%n, %m, wide strings, more than
+// LOG_FORMAT_MAX_ARGS arguments), are written as preformatted text records.
+
+#define LOG_FORMAT_SECTION "c_logger_formats"
+#define LOG_FORMAT_MAX_ARGS 16
+#define LOG_FORMAT_UNPARSED -1
+#define LOG_FORMAT_UNSUPPORTED -2
+
+// Over-aligned so the compiler never pads between section entries, which the
+// library walks as an array.
+typedef struct __attribute__((aligned(64))) LogFormat {
+  LogLevel level;
+  const char* format;
+  const char* file;
+  int line;
+  // filled in by the library on first use
+  int arg_count;
+  unsigned char arg_types[LOG_FORMAT_MAX_ARGS];
+  int arg_precisions[LOG_FORMAT_MAX_ARGS];
+} LogFormat;
+
+static inline LOG_PRINTF(1, 2) void log_format_check(const char* format, ...) {
+  (void)format;
+}
+
+#define LOG_BINARY(logger, lvl, fmt, ...) do { \
+  if ((lvl) <= C_LOGGER_MIN_LEVEL) { \
+    static LogFormat log_format_ __attribute__((section(LOG_FORMAT_SECTION), used)) = { \
+      (lvl), (fmt), __FILE__, __LINE__, LOG_FORMAT_UNPARSED, {0}, {0} \
+    }; \
+    if (0) log_format_check((fmt), ##__VA_ARGS__); \
+    const Logger* log_logger_ = (logger); \
+    if (logger_get_level(log_logger_) >= (lvl)) log_binary(log_logger_, &log_format_, ##__VA_ARGS__); \
+  } \
+} while (0)
+
+// Writes the format table to bin; the logger takes no ownership of bin.
+Logger* logger_new_binary(LogLevel level, FILE* bin);
+void log_binary(const Logger* logger, LogFormat* format, ...);
+// Returns 0 on success, -1 on a malformed or truncated file.
+int logger_decode_binary(FILE* bin, FILE* out);
+
+//####################
+// STRUCTURED
+//####################
+
+typedef enum LogFieldType {
+  LOG_FIELD_STR,
+  LOG_FIELD_INT,
+  LOG_FIELD_UINT,
+  LOG_FIELD_FLOAT,
+  LOG_FIELD_BOOL
+} LogFieldType;
+
+typedef struct LogField {
+  const char* key;
+  LogFieldType type;
+  union {
+    const char* str; // NULL is encoded as null
+    long long i;
+    unsigned long long u;
+    double f;
+    bool b;
+  } value;
+} LogField;
+
+#define KV_STR(k, v) ((LogField){ .key = (k), .type = LOG_FIELD_STR, .value = { .str = (v) } })
+#define KV_INT(k, v) ((LogField){ .key = (k), .type = LOG_FIELD_INT, .value = { .i = (long long)(v) } })
+#define KV_UINT(k, v) ((LogField){ .key = (k), .type = LOG_FIELD_UINT, .value = { .u = (unsigned long long)(v) } })
+#define KV_FLOAT(k, v) ((LogField){ .key = (k), .type = LOG_FIELD_FLOAT, .value = { .f = (double)(v) } })
+#define KV_BOOL(k, v) ((LogField){ .key = (k), .type = LOG_FIELD_BOOL, .value = { .b = (v) } })
+
+// Writes one record holding time, level, msg and the fields, encoded as the
+// logger's kv_encoding and terminated by a newline:
+//   {"time":"...","level":"INFO","msg":"...","user":"bob","latency_us":12}
+//   time="..." level=INFO msg=... user=bob latency_us=12
+// The record is encoded straight into the thread's record buffer, without
+// allocating. Keys are written as given in logfmt. Floats are written in the
+// shortest form that reads back to the same double.
+void log_kv(const Logger* logger, LogLevel level, const char* message, const LogField* fields, size_t count);
+
+#define LOG_KV_AT_(logger, lvl, expect, message, ...) do { \
+  if ((lvl) <= C_LOGGER_MIN_LEVEL) { \
+    const Logger* log_logger_ = (logger); \
+    if (expect(logger_get_level(log_logger_) >= (lvl))) { \
+      const LogField log_fields_[] = { __VA_ARGS__ }; \
+      log_kv(log_logger_, (lvl), (message), log_fields_, sizeof(log_fields_) / sizeof(LogField)); \
+    } \
+  } \
+} while (0)
+
+#define log_fatal_kv(logger, message, ...) LOG_KV_AT_(logger, FATAL, LOG_LIKELY, message, __VA_ARGS__)
+#define log_error_kv(logger, message, ...) LOG_KV_AT_(logger, ERROR, LOG_LIKELY, message, __VA_ARGS__)
+#define log_warn_kv(logger, message, ...) LOG_KV_AT_(logger, WARN, LOG_LIKELY, message, __VA_ARGS__)
+#define log_info_kv(logger, message, ...) LOG_KV_AT_(logger, INFO, LOG_LIKELY, message, __VA_ARGS__)
+#define log_debug_kv(logger, message, ...) LOG_KV_AT_(logger, DEBUG, LOG_UNLIKELY, message, __VA_ARGS__)
+#define log_trace_kv(logger, message, ...) LOG_KV_AT_(logger, TRACE, LOG_UNLIKELY, message, __VA_ARGS__)
+#define log_verbose_kv(logger, message, ...) LOG_KV_AT_(logger, VERBOSE, LOG_UNLIKELY, message, __VA_ARGS__)
+
+//####################
+// RATE LIMITING
+//####################
+
+// Call-site limiters. Each LOG_RATE_LIMITED / LOG_DEDUP statement owns a static
+// site struct; the check is a lock-free atomic on it, so a suppressed call
+// returns before formatting anything or touching the logger lock. Suppressed
+// counts are reported as a record of their own, at the site's level, the next
+// time the site logs. Counts left when a site goes quiet are reported by a
+// background thread (within a second of the bucket refilling or the window
+// ending) and by logger_free.
+
+// Token bucket of burst records refilled at per_sec records per second.
+typedef struct LogRateLimit {
+  const char* file;
+  int line;
+  uint64_t interval_ns;
+  uint64_t tolerance_ns;
+  uint64_t next_ns; // theoretical arrival time of the next record
+  uint64_t suppressed;
+  // where counts pending when the site goes quiet are reported
+  const Logger* logger;
+  LogLevel level;
+  bool watched;
+  struct LogRateLimit* next_watched;
+} LogRateLimit;
+
+// Collapses consecutive identical messages into "last message repeated N
+// times", reported when the message changes or every window_ms.
+typedef struct LogDedup {
+  const char* file;
+  int line;
+  uint64_t window_ns;
+  uint64_t last_hash;
+  uint64_t repeats;
+  uint64_t reported_ns;
+  const Logger* logger;
+  LogLevel level;
+  bool watched;
+  struct LogDedup* next_watched;
+} LogDedup;
+
+#define LOG_RATE_LIMIT_INIT(per_sec, burst) { \
+  .file = __FILE__, .line = __LINE__, .interval_ns = 1000000000ULL / (per_sec), \
+  .tolerance_ns = ((burst) - 1) * (1000000000ULL / (per_sec)) \
+}
+#define LOG_DEDUP_INIT(window_ms) { .file = __FILE__, .line = __LINE__, .window_ns = (uint64_t)(window_ms) * 1000000ULL }
+
+// Takes a token, counting the call as suppressed (and to be reported to
+// logger at level) when there is none.
+bool log_rate_limit_allow(const Logger* logger, LogLevel level, LogRateLimit* limit);
+// Logs a record admitted by log_rate_limit_allow, reporting what was suppressed before it.
+void log_rate_limited(const Logger* logger, LogLevel level, LogRateLimit* limit, const char* message, ...) LOG_PRINTF(4, 5);
+void log_dedup(const Logger* logger, LogLevel level, LogDedup* dedup, const char* message, ...) LOG_PRINTF(4, 5);
+
+#define LOG_RATE_LIMITED(logger, lvl, per_sec, burst, fmt, ...) do { \
+  if ((lvl) <= C_LOGGER_MIN_LEVEL) { \
+    static LogRateLimit log_limit_ = LOG_RATE_LIMIT_INIT(per_sec, burst); \
+    const Logger* log_logger_ = (logger); \
+    if (logger_get_level(log_logger_) >= (lvl) && log_rate_limit_allow(log_logger_, (lvl), &log_limit_)) { \
+      log_rate_limited(log_logger_, (lvl), &log_limit_, (fmt), ##__VA_ARGS__); \
+    } \
+  } \
+} while (0)
+
+#define LOG_DEDUP(logger, lvl, window_ms, fmt, ...) do { \
+  if ((lvl) <= C_LOGGER_MIN_LEVEL) { \
+    static LogDedup log_dedup_ = LOG_DEDUP_INIT(window_ms); \
+    const Logger* log_logger_ = (logger); \
+    if (logger_get_level(log_logger_) >= (lvl)) log_dedup(log_logger_, (lvl), &log_dedup_, (fmt), ##__VA_ARGS__); \
+  } \
+} while (0)
+
+//####################
+// SAMPLING
+//####################
+
+// Per-call-site sampling. Calls that are not sampled return after an atomic
+// on the site's static counter, before any timestamp or formatting work.
+// Every record carries the number of calls it stands for (its sampling factor,
+// times the level's rate from logger_set_sampling): text records show it as
+// "sample=N" after the timestamp, structured records as a "sample" field and
+// binary records in their header.
+
+typedef struct LogInterval {
+  uint64_t interval_ns;
+  uint64_t last_ns;
+  uint64_t skipped;
+} LogInterval;
+
+// Returns the calls since the site last logged (this one included) when
+// interval_ns has passed since then, 0 otherwise.
+uint64_t log_interval_due(LogInterval* interval);
+// log_* for a record standing for factor calls.
+void log_sampled(const Logger* logger, LogLevel level, uint64_t factor, const char* message, ...) LOG_PRINTF(4, 5);
+
+// Every n-th call, starting with the first.
+#define LOG_EVERY_N(logger, lvl, n, fmt, ...) do { \
+  if ((lvl) <= C_LOGGER_MIN_LEVEL) { \
+    static uint64_t log_count_ = 0; \
+    const Logger* log_logger_ = (logger); \
+    if (logger_get_level(log_logger_) >= (lvl) && __atomic_fetch_add(&log_count_, 1, __ATOMIC_RELAXED) % (n) == 0) { \
+      log_sampled(log_logger_, (lvl), (n), (fmt), ##__VA_ARGS__); \
+    } \
+  } \
+} while (0)
+
+// The first n calls only.
+#define LOG_FIRST_N(logger, lvl, n, fmt, ...) do { \
+  if ((lvl) <= C_LOGGER_MIN_LEVEL) { \
+    static uint64_t log_count_ = 0; \
+    const Logger* log_logger_ = (logger); \
+    if (logger_get_level(log_logger_) >= (lvl) && __atomic_load_n(&log_count_, __ATOMIC_RELAXED) < (uint64_t)(n) && \
+        __atomic_fetch_add(&log_count_, 1, __ATOMIC_RELAXED) < (uint64_t)(n)) { \
+      log_sampled(log_logger_, (lvl), 1, (fmt), ##__VA_ARGS__); \
+    } \
+  } \
+} while (0)
+
+// At most one call every ms milliseconds, standing for the calls skipped since.
+#define LOG_EVERY_MS(logger, lvl, ms, fmt, ...) do { \
+  if ((lvl) <= C_LOGGER_MIN_LEVEL) { \
+    static LogInterval log_interval_ = { (uint64_t)(ms) * 1000000ULL, 0, 0 }; \
+    const Logger* log_logger_ = (logger); \
+    uint64_t log_factor_; \
+    if (logger_get_level(log_logger_) >= (lvl) && (log_factor_ = log_interval_due(&log_interval_)) > 0) { \
+      log_sampled(log_logger_, (lvl), log_factor_, (fmt), ##__VA_ARGS__); \
+    } \
+  } \
+} while (0)
+
+//####################
+// CATEGORIES
+//####################
+
+// Handle of the category called name, created on first use with the level
+// given to it by the last level spec or else the logger's current level.
+// Returns NULL if it could not be allocated. Resolve handles once and keep
+// them: lookups take the logger lock, the level check on a handle does not.
+LogCategory* logger_category(Logger* logger, const char* name);
+void log_category_set_level(LogCategory* category, LogLevel level);
+void log_category(const LogCategory* category, LogLevel level, const char* message, ...) LOG_PRINTF(3, 4);
+
+static inline LogLevel log_category_get_level(const LogCategory* category) {
+  return __atomic_load_n(&category->level, __ATOMIC_RELAXED);
+}
+
+// Applies a level spec such as "info,net=debug,db=warn": a bare level sets
+// the logger's own, name=level sets a category's (creating it). Levels are
+// names (case-insensitive) or 0-6. Returns 0 on success, -1 on a malformed
+// spec, in which case nothing is applied.
+int logger_set_levels(Logger* logger, const char* spec);
+// Applies the spec held by env_var then the one in the file at path; either
+// may be NULL, unset or missing. Returns -1 if a spec present was malformed.
+int logger_load_levels(Logger* logger, const char* env_var, const char* path);
+// Calls logger_load_levels(logger, env_var, path) on every SIGHUP, from a
+// background thread. One logger per process can own SIGHUP until it is freed.
+// Returns 0 on success, -1 on error.
+int logger_reload_on_sighup(Logger* logger, const char* env_var, const char* path);
+
+#define LOG_CAT_AT_(category, lvl, expect, fmt, ...) do { \
+  if ((lvl) <= C_LOGGER_MIN_LEVEL) { \
+    const LogCategory* log_category_ = (category); \
+    if (expect(log_category_get_level(log_category_) >= (lvl))) { \
+      LOG_SITE_(log_category(log_category_, (lvl), (fmt), ##__VA_ARGS__)); \
+    } \
+  } \
+} while (0)
+
+#define LOG_CAT_FATAL(category, fmt, ...) LOG_CAT_AT_(category, FATAL, LOG_LIKELY, fmt, ##__VA_ARGS__)
+#define LOG_CAT_ERROR(category, fmt, ...) LOG_CAT_AT_(category, ERROR, LOG_LIKELY, fmt, ##__VA_ARGS__)
+#define LOG_CAT_WARN(category, fmt, ...) LOG_CAT_AT_(category, WARN, LOG_LIKELY, fmt, ##__VA_ARGS__)
+#define LOG_CAT_INFO(category, fmt, ...) LOG_CAT_AT_(category, INFO, LOG_LIKELY, fmt, ##__VA_ARGS__)
+#define LOG_CAT_DEBUG(category, fmt, ...) LOG_CAT_AT_(category, DEBUG, LOG_UNLIKELY, fmt, ##__VA_ARGS__)
+#define LOG_CAT_TRACE(category, fmt, ...) LOG_CAT_AT_(category, TRACE, LOG_UNLIKELY, fmt, ##__VA_ARGS__)
+#define LOG_CAT_VERBOSE(category, fmt, ...) LOG_CAT_AT_(category, VERBOSE, LOG_UNLIKELY, fmt, ##__VA_ARGS__)
+
+// Resolves the category once per call site and caches the handle in a
+// static: a call site must always log to the same logger.
+#define LOG_IN(logger, name, lvl, fmt, ...) do { \
+  if ((lvl) <= C_LOGGER_MIN_LEVEL) { \
+    static LogCategory* log_cached_ = NULL; \
+    LogCategory* log_category_ = __atomic_load_n(&log_cached_, __ATOMIC_ACQUIRE); \
+    if (!log_category_) { \
+      log_category_ = logger_category((logger), (name)); \
+      __atomic_store_n(&log_cached_, log_category_, __ATOMIC_RELEASE); \
+    } \
+    if (log_category_ && log_category_get_level(log_category_) >= (lvl)) { \
+      LOG_SITE_(log_category(log_category_, (lvl), (fmt), ##__VA_ARGS__)); \
+    } \
+  } \
+} while (0)
+
+//####################
+// FLIGHT RECORDER
+//####################
+
+// Keeps the last records (rounded up to a power of two, 0 selects
+// RECORDER_DEFAULT_RECORDS) of level and above passed to log_fatal ...
+// log_verbose and LOG_FATAL ... LOG_VERBOSE, whatever the logger's own level.
+// Keeping a record the logger filters out costs a vsnprintf into the ring: no
+// lock, no stdio and no I/O. log_fatal dumps the ring to err after writing its
+// record. Set it once, before logging. Returns 0 on success, -1 on error.
+int logger_set_flight_recorder(Logger* logger, size_t records, LogLevel level);
+// Writes the recorded records, oldest first, straight to the descriptor of err
+// (stderr for loggers without one).
+void logger_dump_flight_recorder(const Logger* logger);
+// Dumps the flight recorder from SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT
+// handlers, then lets the previous disposition of the signal run. The dump
+// only uses async-signal-safe calls and goes to the descriptor err had when
+// the handlers were installed. One logger per process can own them until it
+// is freed. The handlers run on an alternate signal stack installed for the
+// calling thread (unless it has one), so stack overflows are dumped too; other
+// threads that may overflow their stack need their own sigaltstack. Returns 0
+// on success, -1 on error.
+int logger_dump_on_crash(Logger* logger);
+
+//####################
+// STATISTICS
+//####################
+
+// log_* calls past the level check by duration: bucket i counts the calls
+// that took less than 2^(i + 6) ns (64 ns ... 2 ms), the last one the rest.
+#define LOGGER_STATS_BUCKETS 16
+
+typedef struct LoggerStats {
+  uint64_t emitted[VERBOSE + 1];
+  uint64_t filtered[VERBOSE + 1]; // below the level or sampled out
+  uint64_t bytes;
+  uint64_t flushes;
+  uint64_t lock_contended; // acquisitions of the logger lock that had to wait
+  uint64_t lock_wait_ns;
+  uint64_t calls;
+  uint64_t call_ns;
+  uint64_t latency[LOGGER_STATS_BUCKETS];
+} LoggerStats;
+
+// Starts counting. Every thread updates counters of its own, without atomic
+// read-modify-writes; logger_stats sums them. Records filtered by the LOG_*
+// macros never reach the logger and are not counted. Enable before logging.
+// Returns 0 on success, -1 on error.
+int logger_enable_stats(Logger* logger);
+// Totals since logger_enable_stats, all zero if it was not called.
+void logger_stats(const Logger* logger, LoggerStats* stats);
+// Prometheus text exposition format, metrics prefixed with "c_logger_".
+// Returns 0 on success, -1 on a write error.
+int logger_stats_write_prometheus(const LoggerStats* stats, FILE* stream);
+// Writes the logger's stats to path in the Prometheus text format, replacing
+// the file atomically (e.g. for node_exporter's textfile collector).
+int logger_stats_export(const Logger* logger, const char* path);
+
+//####################
+// PATTERNS
+//####################
+
+// Layout of the records written to out/err, compiled once by
+// logger_set_pattern. Fields take an optional width ("%-5L" pads on the
+// right, "%5L" on the left):
+//   %d        timestamp at the logger's precision
+//   %d{fmt}   strftime format, plus %ms, %us and %ns for the sub-second digits
+//   %L        level name
+//   %t        thread id
+//   %F, %l    file and line of the LOG_* statement, empty for direct log_* calls
+//   %c        category
+//   %X        " [category] sample=N" tags, as in the default layout
+//   %m        message (at most once)
+//   %n        newline
+//   %^, %$    start and end of the level's color, when the stream is a terminal
+//   %%        percent sign
+// Binary, structured and flight recorder records keep their own layout.
+#define LOG_PATTERN_DEFAULT "%^[%L] %$(%d)%X -- %m"
+
+// Set before logging. Returns 0 on success, -1 on a malformed pattern, in
+// which case the previous one is kept.
+int logger_set_pattern(Logger* logger, const char* pattern);
+
+// Call site of the record being logged, set around the call by the LOG_* and
+// LOG_CAT_* macros.
+extern __thread const char* log_site_file;
+extern __thread int log_site_line;
 
 #endif
@@ -0,0 +1,463 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// COMPRESSED FILE SINK
+//####################
+
+// File layout (native endianness, decoded on the same architecture):
+//   blocks: BlockHeader | payload
+// The payload is the block compressed as LZ77 sequences (LZ4 style: a token
+// with the literal and match lengths, the literals, a 2-byte offset), or the
+// raw bytes when size == raw_size because compression did not pay. Each block
+// is written with one writev and decompresses on its own, so a crash costs at
+// most the block being written; the checksum lets the reader skip it.
+//
+// Writers append to the active block under the sink lock. A full block is
+// handed to the compressor thread and writers continue in the other one; they
+// only wait when the compressor is a whole block behind.
+
+#define COMPRESS_MAGIC "CLZ1"
+#define COMPRESS_MAGIC_LEN 4
+
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5 // the last bytes of a block are always literals
+#define LZ_MATCH_LIMIT 12  // no match starts in the last bytes of a block
+#define LZ_MAX_OFFSET 65535
+#define LZ_SKIP_SHIFT 6    // incompressible input is scanned with growing steps
+
+typedef struct BlockHeader {
+  char magic[COMPRESS_MAGIC_LEN];
+  uint32_t raw_size;
+  uint32_t size;     // payload bytes
+  uint32_t checksum; // FNV-1a of the payload
+} BlockHeader;
+
+struct LogCompressSink {
+  int fd;
+  size_t block_size;
+  unsigned interval_ms;
+  char* blocks[2];
+  int active;     // block writers fill
+  size_t filled;  // bytes in the active block
+  size_t pending; // bytes of the other block waiting for the compressor, 0 when free
+  bool stop;
+  uint8_t* out;
+  uint32_t* table;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t compressor;
+};
+
+//------------------------------
+// LZ
+//------------------------------
+
+static size_t lz_bound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+static uint32_t read32(const uint8_t* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint32_t lz_hash(uint32_t value) {
+  return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t* put_length(uint8_t* op, size_t len) {
+  for (; len >= 255; len -= 255) *op++ = 255;
+  *op++ = (uint8_t)len;
+  return op;
+}
+
+static uint8_t* put_literals(uint8_t* op, const uint8_t* literals, size_t len, unsigned match_token) {
+  *op++ = (uint8_t)(((len < 15 ? len : 15) << 4) | match_token);
+  if (len >= 15) op = put_length(op, len - 15);
+  memcpy(op, literals, len);
+  return op + len;
+}
+
+static size_t match_length(const uint8_t* p, const uint8_t* match, const uint8_t* limit) {
+  const uint8_t* start = p;
+  while (p + sizeof(uint64_t) <= limit) {
+    uint64_t a, b;
+    memcpy(&a, p, sizeof(a));
+    memcpy(&b, match, sizeof(b));
+    if (a != b) return (size_t)(p - start) + (size_t)__builtin_ctzll(a ^ b) / 8;
+    p += sizeof(uint64_t);
+    match += sizeof(uint64_t);
+  }
+  while (p < limit && *p == *match) {
+    ++p;
+    ++match;
+  }
+  return (size_t)(p - start);
+}
+
+// Returns the compressed size, dst holds lz_bound(size) bytes.
+static size_t lz_compress(const uint8_t* src, size_t size, uint8_t* dst, uint32_t* table) {
+  const uint8_t* end = src + size;
+  const uint8_t* anchor = src;
+  uint8_t* op = dst;
+
+  if (size > LZ_MATCH_LIMIT) {
+    const uint8_t* limit = end - LZ_MATCH_LIMIT;
+    const uint8_t* match_limit = end - LZ_LAST_LITERALS;
+    memset(table, 0, sizeof(uint32_t) << LZ_HASH_BITS);
+
+    const uint8_t* ip = src;
+    while (ip < limit) {
+      uint32_t sequence = read32(ip);
+      uint32_t hash = lz_hash(sequence);
+      const uint8_t* match = src + table[hash];
+      table[hash] = (uint32_t)(ip - src);
+      if (match >= ip || ip - match > LZ_MAX_OFFSET || read32(match) != sequence) {
+        ip += 1 + ((size_t)(ip - anchor) >> LZ_SKIP_SHIFT);
+        continue;
+      }
+
+      while (ip > anchor && match > src && ip[-1] == match[-1]) {
+        --ip;
+        --match;
+      }
+      size_t len = LZ_MIN_MATCH + match_length(ip + LZ_MIN_MATCH, match + LZ_MIN_MATCH, match_limit);
+      size_t extra = len - LZ_MIN_MATCH;
+      size_t offset = (size_t)(ip - match);
+
+      op = put_literals(op, anchor, (size_t)(ip - anchor), extra < 15 ? (unsigned)extra : 15);
+      *op++ = (uint8_t)(offset & 0xff);
+      *op++ = (uint8_t)(offset >> 8);
+      if (extra >= 15) op = put_length(op, extra - 15);
+
+      ip += len;
+      anchor = ip;
+      if (ip < limit) table[lz_hash(read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+    }
+  }
+
+  op = put_literals(op, anchor, (size_t)(end - anchor), 0);
+  return (size_t)(op - dst);
+}
+
+static bool take_length(const uint8_t** ip, const uint8_t* end, size_t* len) {
+  uint8_t byte;
+  do {
+    if (*ip >= end) return false;
+    byte = *(*ip)++;
+    *len += byte;
+  } while (byte == 255);
+  return true;
+}
+
+static bool lz_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t raw_size) {
+  const uint8_t* ip = src;
+  const uint8_t* end = src + size;
+  uint8_t* op = dst;
+  uint8_t* op_end = dst + raw_size;
+
+  while (ip < end) {
+    unsigned token = *ip++;
+    size_t len = token >> 4;
+    if (len == 15 && !take_length(&ip, end, &len)) return false;
+    if (len > (size_t)(end - ip) || len > (size_t)(op_end - op)) return false;
+    memcpy(op, ip, len);
+    ip += len;
+    op += len;
+    // the last sequence has no match
+    if (ip == end) break;
+
+    if (end - ip < 2) return false;
+    size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+    ip += 2;
+    if (offset == 0 || offset > (size_t)(op - dst)) return false;
+    len = token & 15;
+    if (len == 15 && !take_length(&ip, end, &len)) return false;
+    len += LZ_MIN_MATCH;
+    if (len > (size_t)(op_end - op)) return false;
+
+    const uint8_t* match = op - offset;
+    if (offset >= len) {
+      memcpy(op, match, len);
+    } else {
+      // overlapping matches repeat the last offset bytes
+      for (size_t i = 0; i < len; ++i) op[i] = match[i];
+    }
+    op += len;
+  }
+  return op == op_end;
+}
+
+static uint32_t checksum(const uint8_t* data, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; ++i) hash = (hash ^ data[i]) * 16777619u;
+  return hash;
+}
+
+//------------------------------
+// SINK
+//------------------------------
+
+static void write_block(LogCompressSink* sink, const char* block, size_t raw_size) {
+  size_t size = lz_compress((const uint8_t*)block, raw_size, sink->out, sink->table);
+  const uint8_t* payload = sink->out;
+  if (size >= raw_size) {
+    payload = (const uint8_t*)block;
+    size = raw_size;
+  }
+
+  BlockHeader header;
+  memcpy(header.magic, COMPRESS_MAGIC, COMPRESS_MAGIC_LEN);
+  header.raw_size = (uint32_t)raw_size;
+  header.size = (uint32_t)size;
+  header.checksum = checksum(payload, size);
+
+  struct iovec iov[2] = {
+    { &header, sizeof(header) },
+    { (void*)payload, size }
+  };
+  size_t left = sizeof(header) + size;
+  int count = 2;
+  struct iovec* current = iov;
+  while (left > 0) {
+    ssize_t written = writev(sink->fd, current, count);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "Failed to write compressed log: %s\n", strerror(errno));
+      return;
+    }
+    left -= (size_t)written;
+    while (count > 0 && (size_t)written >= current->iov_len) {
+      written -= (ssize_t)current->iov_len;
+      ++current;
+      --count;
+    }
+    if (count > 0) {
+      current->iov_base = (char*)current->iov_base + written;
+      current->iov_len -= (size_t)written;
+    }
+  }
+}
+
+// Called with the lock held.
+static void hand_off(LogCompressSink* sink) {
+  while (sink->pending > 0) pthread_cond_wait(&sink->cond, &sink->lock);
+  sink->pending = sink->filled;
+  sink->active ^= 1;
+  sink->filled = 0;
+  pthread_cond_broadcast(&sink->cond);
+}
+
+static void deadline_after(struct timespec* deadline, unsigned ms) {
+  clock_gettime(CLOCK_MONOTONIC, deadline);
+  deadline->tv_sec += ms / 1000;
+  deadline->tv_nsec += (long)(ms % 1000) * 1000000L;
+  if (deadline->tv_nsec >= 1000000000L) {
+    ++deadline->tv_sec;
+    deadline->tv_nsec -= 1000000000L;
+  }
+}
+
+static void* compressor_main(void* arg) {
+  LogCompressSink* sink = (LogCompressSink*)arg;
+
+  struct timespec deadline;
+  deadline_after(&deadline, sink->interval_ms);
+  pthread_mutex_lock(&sink->lock);
+  for (;;) {
+    if (sink->pending == 0) {
+      if (sink->stop) {
+        if (sink->filled == 0) break;
+        hand_off(sink);
+        continue;
+      }
+      // a partial block is written once it has waited interval_ms
+      if (pthread_cond_timedwait(&sink->cond, &sink->lock, &deadline) == ETIMEDOUT) {
+        if (sink->pending == 0 && sink->filled > 0) hand_off(sink);
+        deadline_after(&deadline, sink->interval_ms);
+      }
+      continue;
+    }
+
+    const char* block = sink->blocks[sink->active ^ 1];
+    size_t size = sink->pending;
+    pthread_mutex_unlock(&sink->lock);
+    write_block(sink, block, size);
+    deadline_after(&deadline, sink->interval_ms);
+    pthread_mutex_lock(&sink->lock);
+    sink->pending = 0;
+    pthread_cond_broadcast(&sink->cond);
+  }
+  pthread_mutex_unlock(&sink->lock);
+  return NULL;
+}
+
+static void compress_sink_free_buffers(LogCompressSink* sink) {
+  free(sink->blocks[0]);
+  free(sink->blocks[1]);
+  free(sink->out);
+  free(sink->table);
+}
+
+LogCompressSink* log_compress_sink_new(const char* path, size_t block_size, unsigned interval_ms) {
+  assert(path != NULL);
+
+  LogCompressSink* sink = (LogCompressSink*)calloc(1, sizeof(LogCompressSink));
+  if (!sink) return NULL;
+
+  sink->block_size = block_size ? block_size : COMPRESS_DEFAULT_BLOCK_SIZE;
+  if (sink->block_size > COMPRESS_MAX_BLOCK_SIZE) sink->block_size = COMPRESS_MAX_BLOCK_SIZE;
+  sink->interval_ms = interval_ms ? interval_ms : COMPRESS_DEFAULT_INTERVAL_MS;
+  sink->blocks[0] = (char*)malloc(sink->block_size);
+  sink->blocks[1] = (char*)malloc(sink->block_size);
+  sink->out = (uint8_t*)malloc(lz_bound(sink->block_size));
+  sink->table = (uint32_t*)malloc(sizeof(uint32_t) << LZ_HASH_BITS);
+  if (!sink->blocks[0] || !sink->blocks[1] || !sink->out || !sink->table) {
+    compress_sink_free_buffers(sink);
+    free(sink);
+    return NULL;
+  }
+
+  sink->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (sink->fd < 0) {
+    fprintf(stderr, "Failed to open compressed log %s: %s\n", path, strerror(errno));
+    compress_sink_free_buffers(sink);
+    free(sink);
+    return NULL;
+  }
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&sink->cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&sink->lock, NULL);
+  if (pthread_create(&sink->compressor, NULL, compressor_main, sink) != 0) {
+    fprintf(stderr, "Failed to start log compressor\n");
+    pthread_cond_destroy(&sink->cond);
+    pthread_mutex_destroy(&sink->lock);
+    close(sink->fd);
+    compress_sink_free_buffers(sink);
+    free(sink);
+    return NULL;
+  }
+  return sink;
+}
+
+void log_compress_sink_free(LogCompressSink* sink) {
+  assert(sink != NULL);
+
+  pthread_mutex_lock(&sink->lock);
+  sink->stop = true;
+  pthread_cond_broadcast(&sink->cond);
+  pthread_mutex_unlock(&sink->lock);
+  pthread_join(sink->compressor, NULL);
+
+  close(sink->fd);
+  pthread_cond_destroy(&sink->cond);
+  pthread_mutex_destroy(&sink->lock);
+  compress_sink_free_buffers(sink);
+  free(sink);
+}
+
+static void compress_sink_write(void* ctx, const LogRecord* record, const char* line, size_t len) {
+  LogCompressSink* sink = (LogCompressSink*)ctx;
+  (void)record;
+
+  pthread_mutex_lock(&sink->lock);
+  // records may straddle blocks, the reader concatenates them
+  while (len > 0) {
+    if (sink->filled == sink->block_size) hand_off(sink);
+    size_t room = sink->block_size - sink->filled;
+    size_t n = len < room ? len : room;
+    memcpy(sink->blocks[sink->active] + sink->filled, line, n);
+    sink->filled += n;
+    line += n;
+    len -= n;
+  }
+  pthread_mutex_unlock(&sink->lock);
+}
+
+// Flushes would cut blocks short and hurt the ratio: blocks are written when
+// full or after interval_ms.
+static const LogSinkOps COMPRESS_SINK_OPS = { compress_sink_write, NULL, NULL };
+
+int logger_add_compress_sink(Logger* logger, LogCompressSink* sink, LogLevel level, LogFormatter formatter) {
+  assert(logger != NULL && sink != NULL);
+
+  return logger_add_sink(logger, &COMPRESS_SINK_OPS, sink, level, formatter);
+}
+
+//------------------------------
+// DECOMPRESSION
+//------------------------------
+
+// Moves a seekable file to the next block magic after at. Returns false at
+// the end of the file or when the file cannot seek.
+static bool resync(FILE* in, off_t at) {
+  if (at < 0 || fseeko(in, at + 1, SEEK_SET) != 0) return false;
+
+  size_t matched = 0;
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    if (c == COMPRESS_MAGIC[matched]) {
+      if (++matched == COMPRESS_MAGIC_LEN) return fseeko(in, -COMPRESS_MAGIC_LEN, SEEK_CUR) == 0;
+    } else {
+      matched = c == COMPRESS_MAGIC[0] ? 1 : 0;
+    }
+  }
+  return false;
+}
+
+int log_decompress(FILE* in, FILE* out) {
+  assert(in != NULL && out != NULL);
+
+  uint8_t* payload = (uint8_t*)malloc(COMPRESS_MAX_BLOCK_SIZE);
+  uint8_t* raw = (uint8_t*)malloc(COMPRESS_MAX_BLOCK_SIZE);
+  if (!payload || !raw) {
+    free(payload);
+    free(raw);
+    return -1;
+  }
+
+  int result = 0;
+  for (;;) {
+    off_t at = ftello(in);
+    BlockHeader header;
+    size_t got = fread(&header, 1, sizeof(header), in);
+    if (got == 0 && feof(in)) break;
+
+    bool valid = got == sizeof(header)
+      && memcmp(header.magic, COMPRESS_MAGIC, COMPRESS_MAGIC_LEN) == 0
+      && header.raw_size > 0 && header.raw_size <= COMPRESS_MAX_BLOCK_SIZE
+      && header.size <= header.raw_size
+      && fread(payload, 1, header.size, in) == header.size
+      && checksum(payload, header.size) == header.checksum;
+    if (valid && header.size < header.raw_size) {
+      valid = lz_decompress(payload, header.size, raw, header.raw_size);
+    }
+    if (!valid) {
+      // torn or damaged block, keep what follows it
+      result = -1;
+      if (!resync(in, at)) break;
+      continue;
+    }
+    fwrite(header.size < header.raw_size ? raw : payload, 1, header.raw_size, out);
+  }
+
+  free(payload);
+  free(raw);
+  return result;
+}
@@ -0,0 +1,78 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// DIRECT
+//####################
+
+// A record is rendered into a buffer on the caller's stack and written with
+// one write(2) to an O_APPEND descriptor: the kernel appends it whole, so
+// neither the logger lock nor stdio is needed and several processes can share
+// the file. Only records over the logger's limit take the lock.
+
+static int direct_fd(const Logger* logger, LogLevel level) {
+  return level <= WARN ? logger->direct_err : logger->direct_out;
+}
+
+// Returns 0 once len bytes went out. A short write (signal, full disk) is
+// resumed, at which point the record is no longer appended atomically.
+static int write_record(int fd, const char* record, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(fd, record, len);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    record += written;
+    len -= (size_t)written;
+  }
+  return 0;
+}
+
+static void direct_write(const Logger* logger, LogLevel level, const char* record, size_t len, bool locked) {
+  int fd = direct_fd(logger, level);
+
+  if (locked && logger_lock(logger) != 0) return;
+  int result = write_record(fd, record, len);
+  if (locked) logger_unlock(logger);
+
+  if (result != 0) {
+    fprintf(stderr, "Failed to write log record: %s\n", strerror(errno));
+    return;
+  }
+  if (logger->stats) stats_bytes(logger->stats, len);
+  if (logger->flush.sync_errors && level <= ERROR && fdatasync(fd) != 0 && errno != EINVAL && errno != EROFS) {
+    fprintf(stderr, "Failed to sync log record: %s\n", strerror(errno));
+  }
+}
+
+void direct_log(const Logger* logger, LogLevel level, const char* message, va_list args) {
+  assert(logger != NULL && message != NULL);
+
+  char stack[DIRECT_MAX_RECORD + 1]; // and the terminator
+  va_list copy;
+  va_copy(copy, args);
+  int len = logger_render(logger, level, stack, logger->direct_max + 1, message, args);
+
+  if (len >= 0 && (size_t)len <= logger->direct_max) {
+    direct_write(logger, level, stack, (size_t)len, false);
+  } else if (len >= 0) {
+    // too long to count on a single append: rendered again in full, in the
+    // thread's arena, and written under the lock
+    size_t full = 0;
+    const char* record = logger_format(logger, level, message, copy, &full);
+    if (record) direct_write(logger, level, record, full, true);
+  }
+  va_end(copy);
+}
+
+void direct_write_line(const Logger* logger, LogLevel level, const char* line, size_t len) {
+  assert(logger != NULL && line != NULL);
+
+  direct_write(logger, level, line, len, len > logger->direct_max);
+}
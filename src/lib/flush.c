@@ -0,0 +1,134 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// FLUSH
+//####################
+
+struct FlushTimer {
+  Logger* logger;
+  size_t interval_ms;
+  bool stop;
+  pthread_t thread;
+  pthread_mutex_t wait_lock;
+  pthread_cond_t wait_cond;
+};
+
+void flush_streams(Logger* logger) {
+  assert(logger != NULL);
+
+  if (logger->out) fflush(logger->out);
+  if (logger->err && logger->err != logger->out) fflush(logger->err);
+  if (logger->sink_count) sinks_flush(logger);
+  if (logger->stats) stats_flush(logger->stats);
+  logger->pending_records = 0;
+  logger->pending_bytes = 0;
+}
+
+static void sync_stream(FILE* stream) {
+  fflush(stream);
+  // ttys and pipes cannot be synced, that is not an error worth reporting
+  if (fdatasync(fileno(stream)) != 0 && errno != EINVAL && errno != EROFS) {
+    fprintf(stderr, "Failed to sync log stream: %s\n", strerror(errno));
+  }
+}
+
+void flush_after_write(Logger* logger, FILE* stream, LogLevel level, size_t len) {
+  assert(logger != NULL);
+
+  if (logger->flush.sync_errors && level <= ERROR) {
+    if (stream) sync_stream(stream);
+    if (logger->sink_count) sinks_flush(logger);
+    if (logger->stats) stats_flush(logger->stats);
+    return;
+  }
+
+  logger->pending_records += 1;
+  logger->pending_bytes += len;
+
+  switch (logger->flush.mode) {
+    case FLUSH_ALWAYS:
+      if (stream) fflush(stream);
+      if (logger->sink_count) sinks_flush(logger);
+      if (logger->stats) stats_flush(logger->stats);
+      logger->pending_records = 0;
+      logger->pending_bytes = 0;
+      break;
+    case FLUSH_EVERY_N_RECORDS:
+      if (logger->pending_records >= logger->flush.threshold) flush_streams(logger);
+      break;
+    case FLUSH_EVERY_N_BYTES:
+      if (logger->pending_bytes >= logger->flush.threshold) flush_streams(logger);
+      break;
+    case FLUSH_ON_LEVEL:
+      if (level <= logger->flush.level) flush_streams(logger);
+      break;
+    case FLUSH_INTERVAL:
+      // the timer thread takes care of it
+      break;
+  }
+}
+
+static void* timer_main(void* arg) {
+  FlushTimer* timer = (FlushTimer*)arg;
+
+  pthread_mutex_lock(&timer->wait_lock);
+  while (!timer->stop) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t)(timer->interval_ms / 1000);
+    deadline.tv_nsec += (long)(timer->interval_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    if (pthread_cond_timedwait(&timer->wait_cond, &timer->wait_lock, &deadline) != ETIMEDOUT) continue;
+
+    pthread_mutex_lock(&timer->logger->lock);
+    if (timer->logger->pending_records > 0) flush_streams(timer->logger);
+    pthread_mutex_unlock(&timer->logger->lock);
+  }
+  pthread_mutex_unlock(&timer->wait_lock);
+  return NULL;
+}
+
+FlushTimer* flush_timer_new(Logger* logger, size_t interval_ms) {
+  assert(logger != NULL && interval_ms > 0);
+
+  FlushTimer* timer = (FlushTimer*)malloc(sizeof(FlushTimer));
+  if (!timer) return NULL;
+
+  timer->logger = logger;
+  timer->interval_ms = interval_ms;
+  timer->stop = false;
+  pthread_mutex_init(&timer->wait_lock, NULL);
+  pthread_cond_init(&timer->wait_cond, NULL);
+
+  if (pthread_create(&timer->thread, NULL, timer_main, timer) != 0) {
+    pthread_cond_destroy(&timer->wait_cond);
+    pthread_mutex_destroy(&timer->wait_lock);
+    free(timer);
+    return NULL;
+  }
+  return timer;
+}
+
+void flush_timer_free(FlushTimer* timer) {
+  assert(timer != NULL);
+
+  pthread_mutex_lock(&timer->wait_lock);
+  timer->stop = true;
+  pthread_cond_signal(&timer->wait_cond);
+  pthread_mutex_unlock(&timer->wait_lock);
+  pthread_join(timer->thread, NULL);
+
+  pthread_cond_destroy(&timer->wait_cond);
+  pthread_mutex_destroy(&timer->wait_lock);
+  free(timer);
+}
@@ -0,0 +1,470 @@
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "./logger_internal.h"
+
+//####################
+// FORMAT
+//####################
+
+// printf for log messages: the usual conversions are rendered here, straight
+// into the caller's buffer, without locale lookups or stdio. Conversions this
+// code does not render exactly like glibc are handed to snprintf one at a
+// time; those it cannot even fetch the argument of (%n, %m, %ls, %Lf,
+// positional arguments) restart the whole message with vsnprintf.
+
+#define FORMAT_MAX_FIXED_PRECISION 9
+
+static const char DIGIT_PAIRS[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static const uint64_t POW10[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL
+};
+
+typedef struct Spec {
+  bool left, plus, space, alt, zero;
+  int width;
+  int precision; // -1 when absent
+  char length; // 0, 'H' (hh), 'h', 'l', 'q' (ll), 'z', 'j', 't'
+  char conversion;
+} Spec;
+
+// Counts past the end like vsnprintf, so that callers learn the full length.
+typedef struct Out {
+  char* buff;
+  size_t size;
+  size_t len;
+} Out;
+
+static inline void put(Out* out, const char* src, size_t n) {
+  if (out->len < out->size) {
+    size_t room = out->size - out->len;
+    memcpy(out->buff + out->len, src, n < room ? n : room);
+  }
+  out->len += n;
+}
+
+static inline void put_fill(Out* out, char c, size_t n) {
+  if (out->len < out->size) {
+    size_t room = out->size - out->len;
+    memset(out->buff + out->len, c, n < room ? n : room);
+  }
+  out->len += n;
+}
+
+// Writes value's digits to the end of buff, returns where they start.
+static char* decimal(char* end, uint64_t value) {
+  char* p = end;
+  while (value >= 100) {
+    const char* pair = DIGIT_PAIRS + (value % 100) * 2;
+    value /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (value >= 10) {
+    *--p = DIGIT_PAIRS[value * 2 + 1];
+    *--p = DIGIT_PAIRS[value * 2];
+  } else {
+    *--p = (char)('0' + value);
+  }
+  return p;
+}
+
+static char* hexadecimal(char* end, uint64_t value, bool upper) {
+  const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  char* p = end;
+  do {
+    *--p = digits[value & 0xf];
+    value >>= 4;
+  } while (value);
+  return p;
+}
+
+static char* octal(char* end, uint64_t value) {
+  char* p = end;
+  do {
+    *--p = (char)('0' + (value & 7));
+    value >>= 3;
+  } while (value);
+  return p;
+}
+
+// prefix, then zeros, then body, padded to the width
+static void put_field(Out* out, const Spec* spec, const char* prefix, size_t prefix_len, size_t zeros, const char* body, size_t body_len) {
+  size_t len = prefix_len + zeros + body_len;
+  size_t width = spec->width > 0 ? (size_t)spec->width : 0;
+  size_t pad = width > len ? width - len : 0;
+
+  if (!spec->left && spec->zero) {
+    zeros += pad;
+    pad = 0;
+  }
+  if (!spec->left) put_fill(out, ' ', pad);
+  put(out, prefix, prefix_len);
+  put_fill(out, '0', zeros);
+  put(out, body, body_len);
+  if (spec->left) put_fill(out, ' ', pad);
+}
+
+static void put_integer(Out* out, Spec spec, uint64_t value, bool negative) {
+  char buff[24];
+  char* end = buff + sizeof(buff);
+  char* digits = end;
+  char prefix[2];
+  size_t prefix_len = 0;
+
+  switch (spec.conversion) {
+    case 'x': case 'X': case 'p':
+      if (value || spec.precision != 0) digits = hexadecimal(end, value, spec.conversion == 'X');
+      if (spec.alt && value) {
+        prefix[prefix_len++] = '0';
+        prefix[prefix_len++] = spec.conversion == 'X' ? 'X' : 'x';
+      }
+      break;
+    case 'o':
+      if (value || spec.precision != 0) digits = octal(end, value);
+      // '#' makes the first digit a zero
+      if (spec.alt && (digits == end || *digits != '0')) *--digits = '0';
+      break;
+    default:
+      if (value || spec.precision != 0) digits = decimal(end, value);
+      if (negative) prefix[prefix_len++] = '-';
+      else if (spec.plus && (spec.conversion == 'd' || spec.conversion == 'i')) prefix[prefix_len++] = '+';
+      else if (spec.space && (spec.conversion == 'd' || spec.conversion == 'i')) prefix[prefix_len++] = ' ';
+      break;
+  }
+
+  size_t len = (size_t)(end - digits);
+  size_t zeros = spec.precision > 0 && (size_t)spec.precision > len ? (size_t)spec.precision - len : 0;
+  // a precision turns the '0' flag off
+  if (spec.precision >= 0) spec.zero = false;
+  put_field(out, &spec, prefix, prefix_len, zeros, digits, len);
+}
+
+static void put_string(Out* out, const Spec* spec, const char* s) {
+  size_t len;
+  if (!s) {
+    // glibc prints "(null)", or nothing when the precision cuts it
+    s = spec->precision < 0 || spec->precision >= 6 ? "(null)" : "";
+    len = strlen(s);
+  } else {
+    len = spec->precision >= 0 ? strnlen(s, (size_t)spec->precision) : strlen(s);
+  }
+  Spec padded = *spec;
+  padded.zero = false;
+  put_field(out, &padded, "", 0, 0, s, len);
+}
+
+//------------------------------
+// Floating point
+//------------------------------
+
+// Splits value (finite, positive) rounded to precision decimals into its
+// integer and fraction digits, rounding ties to even as glibc does: the
+// fraction is computed exactly from the binary mantissa. Returns false for
+// values of 2^63 and above.
+static bool fixed_digits(double value, int precision, uint64_t* integer, uint64_t* fraction) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  int exponent = (int)((bits >> 52) & 0x7ff);
+  uint64_t mantissa = bits & ((1ULL << 52) - 1);
+  if (exponent) mantissa |= 1ULL << 52;
+  int shift = 1075 - (exponent ? exponent : 1); // value = mantissa / 2^shift
+
+  if (shift <= 0) {
+    if (shift < -10) return false;
+    *integer = mantissa << -shift;
+    *fraction = 0;
+    return true;
+  }
+
+  uint64_t ip = shift < 64 ? mantissa >> shift : 0;
+  uint64_t numerator = shift < 64 ? mantissa & ((1ULL << shift) - 1) : mantissa;
+  unsigned __int128 scaled = (unsigned __int128)numerator * POW10[precision];
+  uint64_t fq = 0;
+  // below 2^-128 scaled never reaches half a unit
+  if (shift < 128) {
+    fq = (uint64_t)(scaled >> shift);
+    unsigned __int128 rem = scaled & (((unsigned __int128)1 << shift) - 1);
+    unsigned __int128 half = (unsigned __int128)1 << (shift - 1);
+    uint64_t last = precision ? fq : ip;
+    if (rem > half || (rem == half && (last & 1))) ++fq;
+  }
+  if (fq == POW10[precision]) {
+    fq = 0;
+    ++ip;
+  }
+  *integer = ip;
+  *fraction = fq;
+  return true;
+}
+
+// Hands the conversion to snprintf, with the argument already fetched.
+static void put_double_fallback(Out* out, const Spec* spec, double value) {
+  char format[16];
+  char* f = format;
+  *f++ = '%';
+  if (spec->left) *f++ = '-';
+  if (spec->plus) *f++ = '+';
+  if (spec->space) *f++ = ' ';
+  if (spec->alt) *f++ = '#';
+  if (spec->zero) *f++ = '0';
+  memcpy(f, "*.*", 3);
+  f += 3;
+  *f++ = spec->conversion;
+  *f = '\0';
+
+  size_t room = out->len < out->size ? out->size - out->len : 0;
+  int n = snprintf(room ? out->buff + out->len : NULL, room, format, spec->width, spec->precision, value);
+  if (n > 0) out->len += (size_t)n;
+}
+
+static void put_fixed(Out* out, const Spec* spec, bool negative, uint64_t integer, uint64_t fraction, int precision, bool trim) {
+  char buff[48];
+  char* end = buff + sizeof(buff);
+  char* body = end;
+
+  if (precision > 0) {
+    char* digits = decimal(end, fraction);
+    while (end - digits < precision) *--digits = '0';
+    body = digits;
+    if (trim) {
+      while (end > body && end[-1] == '0') --end;
+    }
+    if (end > body || spec->alt) *--body = '.';
+  } else if (spec->alt) {
+    *--body = '.';
+  }
+  // the integer digits go in front of the point
+  char* point = body;
+  body = decimal(point, integer);
+
+  char sign = negative ? '-' : spec->plus ? '+' : spec->space ? ' ' : '\0';
+  put_field(out, spec, &sign, sign ? 1 : 0, 0, body, (size_t)(end - body));
+}
+
+static void put_double(Out* out, const Spec* spec, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  bool negative = bits >> 63;
+  double magnitude = negative ? -value : value;
+  bool finite = ((bits >> 52) & 0x7ff) != 0x7ff;
+  uint64_t integer = 0, fraction = 0;
+
+  switch (spec->conversion) {
+    case 'f': case 'F': {
+      int precision = spec->precision < 0 ? 6 : spec->precision;
+      if (!finite || precision > FORMAT_MAX_FIXED_PRECISION) break;
+      if (!fixed_digits(magnitude, precision, &integer, &fraction)) break;
+      put_fixed(out, spec, negative, integer, fraction, precision, false);
+      return;
+    }
+    case 'g': case 'G': {
+      // %f with precision - 1 - exponent significant digits when the exponent
+      // of the rounded value is in [-4, precision), %e otherwise
+      int significant = spec->precision < 0 ? 6 : spec->precision == 0 ? 1 : spec->precision;
+      if (!finite || spec->alt || significant > FORMAT_MAX_FIXED_PRECISION) break;
+      if (magnitude == 0) {
+        put_fixed(out, spec, negative, 0, 0, 0, true);
+        return;
+      }
+      if (magnitude < 1e-5 || magnitude >= 1e9) break;
+
+      int exponent = -5;
+      double bound = 1e-4;
+      while (exponent < 8 && magnitude >= bound) {
+        ++exponent;
+        bound *= 10;
+      }
+      // the estimate is off by one at most, when rounding carries or the
+      // powers of ten above are inexact
+      bool fixed = false;
+      for (int tries = 0; tries < 3; ++tries) {
+        int precision = significant - 1 - exponent;
+        if (exponent < -4 || precision < 0 || precision > FORMAT_MAX_FIXED_PRECISION) break;
+        if (!fixed_digits(magnitude, precision, &integer, &fraction)) break;
+        uint64_t digits = integer * POW10[precision] + fraction;
+        if (digits >= POW10[significant]) ++exponent;
+        else if (digits < POW10[significant - 1]) --exponent;
+        else {
+          fixed = true;
+          break;
+        }
+      }
+      if (!fixed) break;
+      put_fixed(out, spec, negative, integer, fraction, significant - 1 - exponent, true);
+      return;
+    }
+    default:
+      break;
+  }
+  put_double_fallback(out, spec, value);
+}
+
+//------------------------------
+// Conversions
+//------------------------------
+
+static const char* parse_number(const char* p, int* value) {
+  int n = 0;
+  while (*p >= '0' && *p <= '9') {
+    if (n < INT_MAX / 10) n = n * 10 + (*p - '0');
+    ++p;
+  }
+  *value = n;
+  return p;
+}
+
+int format_vsnprintf(char* buff, size_t size, const char* format, va_list args) {
+  assert(format != NULL && (buff != NULL || size == 0));
+
+  va_list restart;
+  va_copy(restart, args);
+  Out out = { buff, size, 0 };
+  const char* p = format;
+
+  while (*p) {
+    const char* percent = strchr(p, '%');
+    if (!percent) {
+      put(&out, p, strlen(p));
+      break;
+    }
+    put(&out, p, (size_t)(percent - p));
+    p = percent + 1;
+
+    Spec spec = { false, false, false, false, false, 0, -1, 0, 0 };
+    for (;; ++p) {
+      if (*p == '-') spec.left = true;
+      else if (*p == '+') spec.plus = true;
+      else if (*p == ' ') spec.space = true;
+      else if (*p == '#') spec.alt = true;
+      else if (*p == '0') spec.zero = true;
+      else break;
+    }
+
+    if (*p == '*') {
+      spec.width = va_arg(args, int);
+      if (spec.width < 0) {
+        spec.left = true;
+        spec.width = spec.width == INT_MIN ? INT_MAX : -spec.width;
+      }
+      ++p;
+    } else {
+      p = parse_number(p, &spec.width);
+      if (*p == '$') goto restart;
+    }
+    if (spec.left) spec.zero = false;
+
+    if (*p == '.') {
+      ++p;
+      if (*p == '*') {
+        spec.precision = va_arg(args, int);
+        if (spec.precision < 0) spec.precision = -1;
+        ++p;
+      } else {
+        p = parse_number(p, &spec.precision);
+      }
+    }
+
+    switch (*p) {
+      case 'h': spec.length = p[1] == 'h' ? 'H' : 'h'; p += p[1] == 'h' ? 2 : 1; break;
+      case 'l': spec.length = p[1] == 'l' ? 'q' : 'l'; p += p[1] == 'l' ? 2 : 1; break;
+      case 'z': case 'j': case 't': spec.length = *p++; break;
+      default: break;
+    }
+    spec.conversion = *p++;
+
+    switch (spec.conversion) {
+      case 'd': case 'i': {
+        long long value;
+        switch (spec.length) {
+          case 'H': value = (signed char)va_arg(args, int); break;
+          case 'h': value = (short)va_arg(args, int); break;
+          case 'l': value = va_arg(args, long); break;
+          case 'q': value = va_arg(args, long long); break;
+          case 'z': value = va_arg(args, ssize_t); break;
+          case 'j': value = va_arg(args, intmax_t); break;
+          case 't': value = va_arg(args, ptrdiff_t); break;
+          default: value = va_arg(args, int); break;
+        }
+        uint64_t magnitude = value < 0 ? 0ULL - (uint64_t)value : (uint64_t)value;
+        put_integer(&out, spec, magnitude, value < 0);
+        break;
+      }
+      case 'u': case 'x': case 'X': case 'o': {
+        uint64_t value;
+        switch (spec.length) {
+          case 'H': value = (unsigned char)va_arg(args, unsigned); break;
+          case 'h': value = (unsigned short)va_arg(args, unsigned); break;
+          case 'l': value = va_arg(args, unsigned long); break;
+          case 'q': value = va_arg(args, unsigned long long); break;
+          case 'z': value = va_arg(args, size_t); break;
+          case 'j': value = va_arg(args, uintmax_t); break;
+          case 't': value = (uint64_t)va_arg(args, ptrdiff_t); break;
+          default: value = va_arg(args, unsigned); break;
+        }
+        put_integer(&out, spec, value, false);
+        break;
+      }
+      case 'c': {
+        if (spec.length) goto restart;
+        char c = (char)va_arg(args, int);
+        Spec padded = spec;
+        padded.zero = false;
+        put_field(&out, &padded, "", 0, 0, &c, 1);
+        break;
+      }
+      case 's':
+        if (spec.length) goto restart;
+        put_string(&out, &spec, va_arg(args, const char*));
+        break;
+      case 'p': {
+        void* pointer = va_arg(args, void*);
+        if (!pointer) {
+          Spec nil = { spec.left, false, false, false, false, spec.width, -1, 0, 's' };
+          put_string(&out, &nil, "(nil)");
+          break;
+        }
+        spec.alt = true;
+        spec.conversion = 'x';
+        put_integer(&out, spec, (uint64_t)(uintptr_t)pointer, false);
+        break;
+      }
+      case 'f': case 'F': case 'g': case 'G': case 'e': case 'E': case 'a': case 'A':
+        // 'l' is a no-op on doubles
+        if (spec.length && spec.length != 'l') goto restart;
+        put_double(&out, &spec, va_arg(args, double));
+        break;
+      case '%':
+        put(&out, "%", 1);
+        break;
+      default:
+        // %n, %m, %L..., wide characters, or a malformed conversion
+        goto restart;
+    }
+  }
+
+  va_end(restart);
+  if (out.len < size) buff[out.len] = '\0';
+  else if (size > 0) buff[size - 1] = '\0';
+  if (out.len > INT_MAX) {
+    errno = EOVERFLOW;
+    return -1;
+  }
+  return (int)out.len;
+
+restart: {
+    int n = vsnprintf(buff, size, format, restart);
+    va_end(restart);
+    return n;
+  }
+}
@@ -0,0 +1,270 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// INDEXED FILE SINK
+//####################
+
+// Index layout (native endianness, read on the same architecture):
+//   "CLOGIDX1" | IndexEntry...
+// Every entry covers a run of whole records of the log file: where it starts,
+// how long it is, the first and last record timestamps and a bitmap of the
+// levels in it. An entry is appended when its run closes, so the records
+// after the last entry are not indexed yet. Every entry point of the sink
+// runs under the logger lock.
+
+#define INDEX_MAGIC "CLOGIDX1"
+#define INDEX_MAGIC_LEN 8
+#define INDEX_SUFFIX ".idx"
+#define INDEX_COPY_SIZE 65536
+#define INDEX_ALL_LEVELS ((2u << VERBOSE) - 1)
+
+typedef struct IndexEntry {
+  uint64_t offset;
+  uint64_t length;
+  int64_t first_ns;
+  int64_t last_ns;
+  uint32_t levels; // 1 << level for every level in the run
+  uint32_t reserved;
+} IndexEntry;
+
+struct LogIndexSink {
+  FILE* log;
+  FILE* index;
+  size_t every_bytes;
+  int64_t every_ns;
+  IndexEntry run; // open while length > 0
+};
+
+static int64_t to_ns(const struct timespec* time) {
+  return (int64_t)time->tv_sec * 1000000000LL + time->tv_nsec;
+}
+
+static void index_path(char* buff, size_t size, const char* path) {
+  snprintf(buff, size, "%s" INDEX_SUFFIX, path);
+}
+
+// Opens path for appending, returns its size through size.
+static FILE* open_append(const char* path, off_t* size) {
+  FILE* file = fopen(path, "ae");
+  if (!file) return NULL;
+  if (fseeko(file, 0, SEEK_END) != 0 || (*size = ftello(file)) < 0) {
+    fclose(file);
+    return NULL;
+  }
+  return file;
+}
+
+static void close_run(LogIndexSink* sink) {
+  if (sink->run.length == 0) return;
+  fwrite(&sink->run, sizeof(IndexEntry), 1, sink->index);
+  sink->run.offset += sink->run.length;
+  sink->run.length = 0;
+}
+
+// A process that died with a run open left records after the last entry,
+// which would end up in the middle of the log, out of any entry: they get an
+// entry of their own, with every level and times up to now. A torn entry is
+// cut off first.
+static void index_unclosed(LogIndexSink* sink, const char* sidecar, off_t index_size, off_t log_size) {
+  int fd = open(sidecar, O_RDWR | O_CLOEXEC);
+  if (fd < 0) return;
+  size_t count = (size_t)(index_size - INDEX_MAGIC_LEN) / sizeof(IndexEntry);
+  off_t whole = (off_t)(INDEX_MAGIC_LEN + count * sizeof(IndexEntry));
+  if (whole != index_size && ftruncate(fd, whole) != 0) {
+    fprintf(stderr, "Failed to repair log index %s: %s\n", sidecar, strerror(errno));
+  }
+
+  IndexEntry last = { 0, 0, 0, 0, 0, 0 };
+  if (count > 0 && pread(fd, &last, sizeof(last), whole - (off_t)sizeof(last)) != (ssize_t)sizeof(last)) {
+    close(fd);
+    return;
+  }
+  close(fd);
+
+  uint64_t end = last.offset + last.length;
+  if ((uint64_t)log_size <= end) return;
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  IndexEntry gap = { end, (uint64_t)log_size - end, last.last_ns, to_ns(&now), INDEX_ALL_LEVELS, 0 };
+  fwrite(&gap, sizeof(gap), 1, sink->index);
+}
+
+LogIndexSink* log_index_sink_new(const char* path, size_t every_bytes, unsigned every_ms) {
+  assert(path != NULL);
+
+  LogIndexSink* sink = (LogIndexSink*)calloc(1, sizeof(LogIndexSink));
+  if (!sink) return NULL;
+
+  char sidecar[PATH_MAX];
+  index_path(sidecar, sizeof(sidecar), path);
+  off_t log_size = 0;
+  off_t index_size = 0;
+  sink->log = open_append(path, &log_size);
+  sink->index = sink->log ? open_append(sidecar, &index_size) : NULL;
+  if (!sink->index) {
+    fprintf(stderr, "Failed to open indexed log %s: %s\n", path, strerror(errno));
+    if (sink->log) fclose(sink->log);
+    free(sink);
+    return NULL;
+  }
+  if (index_size < INDEX_MAGIC_LEN) {
+    if (index_size > 0 && ftruncate(fileno(sink->index), 0) != 0) index_size = -1;
+    if (index_size < 0) {
+      fprintf(stderr, "Failed to open indexed log %s: %s\n", path, strerror(errno));
+      fclose(sink->log);
+      fclose(sink->index);
+      free(sink);
+      return NULL;
+    }
+    fwrite(INDEX_MAGIC, 1, INDEX_MAGIC_LEN, sink->index);
+    index_size = INDEX_MAGIC_LEN;
+  }
+  index_unclosed(sink, sidecar, index_size, log_size);
+
+  sink->every_bytes = every_bytes ? every_bytes : INDEX_DEFAULT_BYTES;
+  sink->every_ns = (int64_t)(every_ms ? every_ms : INDEX_DEFAULT_INTERVAL_MS) * 1000000LL;
+  // records appended after a previous run start a new entry
+  sink->run.offset = (uint64_t)log_size;
+  return sink;
+}
+
+void log_index_sink_free(LogIndexSink* sink) {
+  assert(sink != NULL);
+
+  close_run(sink);
+  fclose(sink->log);
+  fclose(sink->index);
+  free(sink);
+}
+
+static void index_sink_write(void* ctx, const LogRecord* record, const char* line, size_t len) {
+  LogIndexSink* sink = (LogIndexSink*)ctx;
+
+  int64_t time = to_ns(&record->time);
+  if (sink->run.length > 0 && time - sink->run.first_ns >= sink->every_ns) close_run(sink);
+  if (sink->run.length == 0) {
+    sink->run.first_ns = time;
+    sink->run.last_ns = time;
+    sink->run.levels = 0;
+  }
+  fwrite(line, 1, len, sink->log);
+  sink->run.length += len;
+  // threads may hand records over slightly out of order
+  if (time > sink->run.last_ns) sink->run.last_ns = time;
+  if (time < sink->run.first_ns) sink->run.first_ns = time;
+  sink->run.levels |= 1u << record->level;
+  if (sink->run.length >= sink->every_bytes) close_run(sink);
+}
+
+static void index_sink_flush(void* ctx) {
+  LogIndexSink* sink = (LogIndexSink*)ctx;
+  // records before entries: an entry never points past the log on disk
+  fflush(sink->log);
+  fflush(sink->index);
+}
+
+static const LogSinkOps INDEX_SINK_OPS = { index_sink_write, index_sink_flush, index_sink_flush };
+
+int logger_add_index_sink(Logger* logger, LogIndexSink* sink, LogLevel level, LogFormatter formatter) {
+  assert(logger != NULL && sink != NULL);
+
+  return logger_add_sink(logger, &INDEX_SINK_OPS, sink, level, formatter);
+}
+
+//------------------------------
+// QUERY
+//------------------------------
+
+static bool read_entry(int fd, size_t i, IndexEntry* entry) {
+  off_t at = (off_t)(INDEX_MAGIC_LEN + i * sizeof(IndexEntry));
+  return pread(fd, entry, sizeof(IndexEntry), at) == (ssize_t)sizeof(IndexEntry);
+}
+
+static int copy_range(int fd, uint64_t offset, uint64_t length, FILE* out) {
+  char buff[INDEX_COPY_SIZE];
+  while (length > 0) {
+    size_t want = length < sizeof(buff) ? (size_t)length : sizeof(buff);
+    ssize_t got = pread(fd, buff, want, (off_t)offset);
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) return -1;
+    fwrite(buff, 1, (size_t)got, out);
+    offset += (uint64_t)got;
+    length -= (uint64_t)got;
+  }
+  return 0;
+}
+
+int log_index_query(const char* path, const LogQuery* query, FILE* out) {
+  assert(path != NULL && query != NULL && out != NULL);
+
+  char sidecar[PATH_MAX];
+  index_path(sidecar, sizeof(sidecar), path);
+  int log = open(path, O_RDONLY | O_CLOEXEC);
+  int index = open(sidecar, O_RDONLY | O_CLOEXEC);
+  char magic[INDEX_MAGIC_LEN];
+  off_t index_size = index >= 0 ? lseek(index, 0, SEEK_END) : -1;
+  off_t log_size = log >= 0 ? lseek(log, 0, SEEK_END) : -1;
+  if (log < 0 || index < 0 || log_size < 0 || index_size < INDEX_MAGIC_LEN
+    || pread(index, magic, INDEX_MAGIC_LEN, 0) != INDEX_MAGIC_LEN || memcmp(magic, INDEX_MAGIC, INDEX_MAGIC_LEN) != 0) {
+    fprintf(stderr, "Failed to open indexed log %s\n", path);
+    if (log >= 0) close(log);
+    if (index >= 0) close(index);
+    return -1;
+  }
+
+  int64_t from = query->from.tv_sec || query->from.tv_nsec ? to_ns(&query->from) : INT64_MIN;
+  int64_t to = query->to.tv_sec || query->to.tv_nsec ? to_ns(&query->to) : INT64_MAX;
+  uint32_t levels = (2u << query->level) - 1;
+  size_t count = (size_t)(index_size - INDEX_MAGIC_LEN) / sizeof(IndexEntry);
+
+  // first entry still holding records at or after from; entries follow the
+  // file, so their last timestamps only go backwards by a reorder
+  size_t low = 0;
+  size_t high = count;
+  IndexEntry entry;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (!read_entry(index, mid, &entry)) break;
+    if (entry.last_ns < from) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  int runs = 0;
+  uint64_t indexed_end = 0;
+  int64_t indexed_last = INT64_MIN;
+  if (count > 0 && read_entry(index, count - 1, &entry)) {
+    indexed_end = entry.offset + entry.length;
+    indexed_last = entry.last_ns;
+  }
+  for (size_t i = low; i < count && read_entry(index, i, &entry); ++i) {
+    if (entry.first_ns > to) break;
+    if (!(entry.levels & levels) || entry.last_ns < from) continue;
+    // entries a crash left past the end of the log
+    if (entry.offset >= (uint64_t)log_size) break;
+    if (entry.offset + entry.length > (uint64_t)log_size) entry.length = (uint64_t)log_size - entry.offset;
+    if (copy_range(log, entry.offset, entry.length, out) != 0) break;
+    ++runs;
+  }
+  // the records after the last entry are not indexed yet: newer than it, of
+  // any level
+  if (to >= indexed_last && (uint64_t)log_size > indexed_end) {
+    if (copy_range(log, indexed_end, (uint64_t)log_size - indexed_end, out) == 0) ++runs;
+  }
+
+  close(log);
+  close(index);
+  return runs;
+}
@@ -0,0 +1,321 @@
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "./logger_internal.h"
+
+//####################
+// STRUCTURED
+//####################
+
+// Records are encoded straight into the thread's record buffer, behind
+// LOGGER_LINE_HEADROOM bytes left for the binary header. The writer keeps
+// counting past the end of the buffer so that a record that did not fit can be
+// encoded again, once, into a buffer of the right size.
+
+// scaled values stay below 2^53, where doubles hold every integer
+#define FLOAT_FIXED_LIMIT 1e9
+#define FLOAT_FIXED_MIN 1e-4
+#define FLOAT_FIXED_SCALE 1000000.0
+#define FLOAT_FIXED_DECIMALS 6
+
+typedef struct KvWriter {
+  char* buff;
+  size_t size;
+  size_t len;
+} KvWriter;
+
+static inline void put(KvWriter* writer, const char* src, size_t n) {
+  if (writer->len + n <= writer->size) memcpy(writer->buff + writer->len, src, n);
+  writer->len += n;
+}
+
+static inline void put_char(KvWriter* writer, char c) {
+  if (writer->len < writer->size) writer->buff[writer->len] = c;
+  writer->len += 1;
+}
+
+#define PUT_LITERAL(writer, literal) put((writer), (literal), sizeof(literal) - 1)
+
+//------------------------------
+// Numbers
+//------------------------------
+
+static const char DIGIT_PAIRS[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static void put_uint(KvWriter* writer, unsigned long long value) {
+  char digits[20];
+  char* p = digits + sizeof(digits);
+
+  while (value >= 100) {
+    const char* pair = DIGIT_PAIRS + (value % 100) * 2;
+    value /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (value >= 10) {
+    const char* pair = DIGIT_PAIRS + value * 2;
+    *--p = pair[1];
+    *--p = pair[0];
+  } else {
+    *--p = (char)('0' + value);
+  }
+  put(writer, p, (size_t)(digits + sizeof(digits) - p));
+}
+
+static void put_int(KvWriter* writer, long long value) {
+  if (value < 0) {
+    put_char(writer, '-');
+    put_uint(writer, 0ULL - (unsigned long long)value);
+    return;
+  }
+  put_uint(writer, (unsigned long long)value);
+}
+
+static void put_float(KvWriter* writer, double value, LogEncoding encoding) {
+  if (isnan(value)) {
+    if (encoding == LOG_ENCODING_JSON) PUT_LITERAL(writer, "null");
+    else PUT_LITERAL(writer, "NaN");
+    return;
+  }
+  if (isinf(value)) {
+    if (encoding == LOG_ENCODING_JSON) PUT_LITERAL(writer, "null");
+    else if (value > 0) PUT_LITERAL(writer, "+Inf");
+    else PUT_LITERAL(writer, "-Inf");
+    return;
+  }
+
+  double magnitude = fabs(value);
+  unsigned long long scaled = 0;
+  if (magnitude != 0 && magnitude >= FLOAT_FIXED_MIN && magnitude < FLOAT_FIXED_LIMIT) {
+    scaled = (unsigned long long)(magnitude * FLOAT_FIXED_SCALE + 0.5);
+  }
+  // 6 decimals read back as scaled / 1e6, correctly rounded: when that is the
+  // value they are its shortest form; otherwise the shortest %g that reads
+  // back to the value
+  if (magnitude != 0 && (double)scaled / FLOAT_FIXED_SCALE != magnitude) {
+    char digits[32];
+    int len = 0;
+    for (int precision = 15; precision <= 17; ++precision) {
+      len = snprintf(digits, sizeof(digits), "%.*g", precision, value);
+      if (strtod(digits, NULL) == value) break;
+    }
+    if (len > 0) put(writer, digits, (size_t)len);
+    return;
+  }
+
+  unsigned long long whole = scaled / (unsigned long long)FLOAT_FIXED_SCALE;
+  unsigned long long fraction = scaled % (unsigned long long)FLOAT_FIXED_SCALE;
+
+  if (value < 0 && scaled != 0) put_char(writer, '-');
+  put_uint(writer, whole);
+  if (fraction == 0) return;
+
+  char decimals[FLOAT_FIXED_DECIMALS];
+  for (int i = FLOAT_FIXED_DECIMALS - 1; i >= 0; --i) {
+    decimals[i] = (char)('0' + fraction % 10);
+    fraction /= 10;
+  }
+  size_t kept = FLOAT_FIXED_DECIMALS;
+  while (decimals[kept - 1] == '0') --kept;
+  put_char(writer, '.');
+  put(writer, decimals, kept);
+}
+
+//------------------------------
+// Strings
+//------------------------------
+
+// Escaped inside quotes: control characters, '"' and '\'. A logfmt value is
+// quoted when it holds one of those, a space or '='.
+static inline bool needs_escape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+static inline bool needs_quote(unsigned char c) {
+  return c <= 0x20 || c == '"' || c == '\\' || c == '=';
+}
+
+// Length of the prefix of s holding no byte that needs escaping (or quoting
+// when quoting is set), 16 bytes at a time where SSE2 is available.
+static size_t scan_plain(const char* s, size_t n, bool quoting) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i equals = _mm_set1_epi8('=');
+  // c <= limit <=> max(c, limit) == limit, unsigned
+  const __m128i limit = _mm_set1_epi8(quoting ? 0x20 : 0x1F);
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_max_epu8(chunk, limit), limit));
+    if (quoting) hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, equals));
+
+    int mask = _mm_movemask_epi8(hit);
+    if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+  }
+#endif
+  for (; i < n; ++i) {
+    unsigned char c = (unsigned char)s[i];
+    if (quoting ? needs_quote(c) : needs_escape(c)) break;
+  }
+  return i;
+}
+
+static void put_escaped_char(KvWriter* writer, unsigned char c) {
+  static const char HEX[] = "0123456789abcdef";
+
+  switch (c) {
+    case '"': PUT_LITERAL(writer, "\\\""); break;
+    case '\\': PUT_LITERAL(writer, "\\\\"); break;
+    case '\n': PUT_LITERAL(writer, "\\n"); break;
+    case '\r': PUT_LITERAL(writer, "\\r"); break;
+    case '\t': PUT_LITERAL(writer, "\\t"); break;
+    case '\b': PUT_LITERAL(writer, "\\b"); break;
+    case '\f': PUT_LITERAL(writer, "\\f"); break;
+    default: {
+      char unicode[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xF] };
+      put(writer, unicode, sizeof(unicode));
+    }
+  }
+}
+
+// Quoted and escaped, copying the runs between escapes in one go.
+static void put_quoted(KvWriter* writer, const char* s, size_t n) {
+  put_char(writer, '"');
+  while (n > 0) {
+    size_t run = scan_plain(s, n, false);
+    put(writer, s, run);
+    if (run == n) break;
+    put_escaped_char(writer, (unsigned char)s[run]);
+    s += run + 1;
+    n -= run + 1;
+  }
+  put_char(writer, '"');
+}
+
+static void put_string(KvWriter* writer, const char* s, LogEncoding encoding) {
+  if (!s) {
+    PUT_LITERAL(writer, "null");
+    return;
+  }
+  size_t n = strlen(s);
+  if (encoding == LOG_ENCODING_LOGFMT && n > 0 && scan_plain(s, n, true) == n) {
+    put(writer, s, n);
+    return;
+  }
+  put_quoted(writer, s, n);
+}
+
+//------------------------------
+// Records
+//------------------------------
+
+static void put_key(KvWriter* writer, const char* key, LogEncoding encoding) {
+  if (encoding == LOG_ENCODING_JSON) {
+    put_char(writer, ',');
+    put_quoted(writer, key, strlen(key));
+    put_char(writer, ':');
+  } else {
+    put_char(writer, ' ');
+    put(writer, key, strlen(key));
+    put_char(writer, '=');
+  }
+}
+
+static void put_field(KvWriter* writer, const LogField* field, LogEncoding encoding) {
+  put_key(writer, field->key, encoding);
+
+  switch (field->type) {
+    case LOG_FIELD_STR:
+      put_string(writer, field->value.str, encoding);
+      break;
+    case LOG_FIELD_INT:
+      put_int(writer, field->value.i);
+      break;
+    case LOG_FIELD_UINT:
+      put_uint(writer, field->value.u);
+      break;
+    case LOG_FIELD_FLOAT:
+      put_float(writer, field->value.f, encoding);
+      break;
+    case LOG_FIELD_BOOL:
+      if (field->value.b) PUT_LITERAL(writer, "true");
+      else PUT_LITERAL(writer, "false");
+      break;
+  }
+}
+
+static size_t encode(KvWriter* writer, LogEncoding encoding, const char* stamp, LogLevel level, const char* message, const LogField* fields, size_t count) {
+  uint64_t sample = logger_record_sample;
+  writer->len = 0;
+
+  if (encoding == LOG_ENCODING_JSON) {
+    PUT_LITERAL(writer, "{\"time\":");
+    put_quoted(writer, stamp, strlen(stamp));
+    PUT_LITERAL(writer, ",\"level\":\"");
+    put(writer, logger_level_name(level), strlen(logger_level_name(level)));
+    PUT_LITERAL(writer, "\"");
+    if (sample > 1) {
+      PUT_LITERAL(writer, ",\"sample\":");
+      put_uint(writer, sample);
+    }
+    PUT_LITERAL(writer, ",\"msg\":");
+    put_quoted(writer, message, strlen(message));
+  } else {
+    PUT_LITERAL(writer, "time=");
+    put_quoted(writer, stamp, strlen(stamp));
+    PUT_LITERAL(writer, " level=");
+    put(writer, logger_level_name(level), strlen(logger_level_name(level)));
+    if (sample > 1) {
+      PUT_LITERAL(writer, " sample=");
+      put_uint(writer, sample);
+    }
+    PUT_LITERAL(writer, " msg=");
+    put_string(writer, message, encoding);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    put_field(writer, &fields[i], encoding);
+  }
+
+  if (encoding == LOG_ENCODING_JSON) put_char(writer, '}');
+  put_char(writer, '\n');
+  return writer->len;
+}
+
+void log_kv(const Logger* logger, LogLevel level, const char* message, const LogField* fields, size_t count) {
+  assert(logger != NULL && message != NULL && (fields != NULL || count == 0));
+
+  if (!logger_admit(logger, logger_get_level(logger), level, 1)) return;
+
+  struct timespec now;
+  clock_gettime(logger->ts_clock, &now);
+  char stamp[BUFF_SIZE_TIMESTAMP];
+  timestamp_format(stamp, &now, logger->ts_precision);
+
+  char* buff = logger_buffer(BUFF_SIZE_RECORD);
+  KvWriter writer = { buff + LOGGER_LINE_HEADROOM, BUFF_SIZE_RECORD - LOGGER_LINE_HEADROOM, 0 };
+  size_t len = encode(&writer, logger->kv_encoding, stamp, level, message, fields, count);
+
+  if (len > writer.size) {
+    buff = logger_buffer(LOGGER_LINE_HEADROOM + len);
+    if (!buff) return;
+    writer = (KvWriter){ buff + LOGGER_LINE_HEADROOM, len, 0 };
+    encode(&writer, logger->kv_encoding, stamp, level, message, fields, count);
+  }
+
+  logger_log_line(logger, level, writer.buff, len);
+}
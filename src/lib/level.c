@@ -0,0 +1,279 @@
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "./logger_internal.h"
+
+//####################
+// CATEGORIES
+//####################
+
+#define LEVEL_SPEC_MAX_SIZE 4096
+#define LEVEL_SPEC_MAX_ENTRIES 64
+
+__thread const char* logger_record_category = NULL;
+
+static const char* LEVEL_SPEC_NAMES[] = {
+  "fatal", "error", "warn", "info", "debug", "trace", "verbose"
+};
+
+void logger_set_level(Logger* logger, LogLevel level) {
+  assert(logger != NULL && level <= VERBOSE);
+
+  __atomic_store_n(&logger->level, level, __ATOMIC_RELAXED);
+}
+
+void log_category_set_level(LogCategory* category, LogLevel level) {
+  assert(category != NULL && level <= VERBOSE);
+
+  __atomic_store_n(&category->level, level, __ATOMIC_RELAXED);
+}
+
+LogCategory* logger_category(Logger* logger, const char* name) {
+  assert(logger != NULL && name != NULL);
+
+  pthread_mutex_lock(&logger->lock);
+  LogCategory* category = logger->categories;
+  while (category && strncmp(category->name, name, LOG_CATEGORY_NAME_SIZE - 1) != 0) {
+    category = category->next;
+  }
+  if (!category) {
+    category = (LogCategory*)malloc(sizeof(LogCategory));
+    if (category) {
+      category->level = logger_get_level(logger);
+      category->logger = logger;
+      snprintf(category->name, sizeof(category->name), "%s", name);
+      // published whole: readers only reach it through the lock or a handle
+      category->next = logger->categories;
+      logger->categories = category;
+    }
+  }
+  pthread_mutex_unlock(&logger->lock);
+  return category;
+}
+
+void log_category(const LogCategory* category, LogLevel level, const char* message, ...) {
+  assert(category != NULL && message != NULL);
+
+  if (!logger_admit(category->logger, log_category_get_level(category), level, 1)) return;
+  logger_record_category = category->name;
+
+  va_list args;
+  va_start(args, message);
+  logger_log(category->logger, level, message, args);
+  va_end(args);
+}
+
+//------------------------------
+// Level specs
+//------------------------------
+
+typedef struct LevelEntry {
+  char name[LOG_CATEGORY_NAME_SIZE]; // empty for the logger's own level
+  LogLevel level;
+} LevelEntry;
+
+static int parse_level(const char* text, size_t len, LogLevel* level) {
+  if (len == 1 && text[0] >= '0' && text[0] <= '0' + VERBOSE) {
+    *level = (LogLevel)(text[0] - '0');
+    return 0;
+  }
+  for (int i = FATAL; i <= VERBOSE; ++i) {
+    if (strlen(LEVEL_SPEC_NAMES[i]) == len && strncasecmp(LEVEL_SPEC_NAMES[i], text, len) == 0) {
+      *level = (LogLevel)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static bool is_separator(char c) {
+  return c == ',' || isspace((unsigned char)c);
+}
+
+// Returns the number of entries, -1 on a malformed spec.
+static int parse_spec(const char* spec, LevelEntry* entries, int capacity) {
+  int count = 0;
+  const char* p = spec;
+
+  while (*p) {
+    while (*p && is_separator(*p)) ++p;
+    if (!*p) break;
+    if (*p == '#') {
+      // comment, to the end of the line
+      while (*p && *p != '\n') ++p;
+      continue;
+    }
+
+    const char* start = p;
+    while (*p && !is_separator(*p)) ++p;
+    const char* equals = memchr(start, '=', (size_t)(p - start));
+    if (count == capacity) return -1;
+
+    LevelEntry* entry = &entries[count++];
+    entry->name[0] = '\0';
+    const char* level = start;
+    if (equals) {
+      size_t name_len = (size_t)(equals - start);
+      if (name_len == 0 || name_len >= LOG_CATEGORY_NAME_SIZE) return -1;
+      memcpy(entry->name, start, name_len);
+      entry->name[name_len] = '\0';
+      level = equals + 1;
+    }
+    if (parse_level(level, (size_t)(p - level), &entry->level) != 0) return -1;
+  }
+  return count;
+}
+
+int logger_set_levels(Logger* logger, const char* spec) {
+  assert(logger != NULL && spec != NULL);
+
+  LevelEntry entries[LEVEL_SPEC_MAX_ENTRIES];
+  int count = parse_spec(spec, entries, LEVEL_SPEC_MAX_ENTRIES);
+  if (count < 0) {
+    fprintf(stderr, "Failed to parse log levels: \"%s\"\n", spec);
+    return -1;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    if (!entries[i].name[0]) {
+      logger_set_level(logger, entries[i].level);
+      continue;
+    }
+    LogCategory* category = logger_category(logger, entries[i].name);
+    if (!category) return -1;
+    log_category_set_level(category, entries[i].level);
+  }
+  return 0;
+}
+
+int logger_load_levels(Logger* logger, const char* env_var, const char* path) {
+  assert(logger != NULL);
+
+  int result = 0;
+  const char* spec = env_var ? getenv(env_var) : NULL;
+  if (spec && logger_set_levels(logger, spec) != 0) result = -1;
+
+  FILE* file = path ? fopen(path, "r") : NULL;
+  if (file) {
+    char buff[LEVEL_SPEC_MAX_SIZE];
+    size_t len = fread(buff, 1, sizeof(buff) - 1, file);
+    buff[len] = '\0';
+    fclose(file);
+    if (logger_set_levels(logger, buff) != 0) result = -1;
+  }
+  return result;
+}
+
+//------------------------------
+// SIGHUP reload
+//------------------------------
+
+// The handler only posts a semaphore (async-signal-safe); the reload itself
+// runs on a thread of its own.
+typedef struct Reloader {
+  Logger* logger;
+  char* env_var;
+  char* path;
+  bool stop;
+  sem_t wake;
+  pthread_t thread;
+  struct sigaction previous;
+} Reloader;
+
+static Reloader* reloader = NULL;
+
+static void on_sighup(int signal) {
+  (void)signal;
+  int saved = errno;
+  if (reloader) sem_post(&reloader->wake);
+  errno = saved;
+}
+
+static void* reloader_main(void* arg) {
+  Reloader* state = (Reloader*)arg;
+
+  while (true) {
+    if (sem_wait(&state->wake) != 0) continue; // EINTR
+    if (__atomic_load_n(&state->stop, __ATOMIC_ACQUIRE)) break;
+    logger_load_levels(state->logger, state->env_var, state->path);
+  }
+  return NULL;
+}
+
+static void reloader_free(Reloader* state) {
+  free(state->env_var);
+  free(state->path);
+  free(state);
+}
+
+int logger_reload_on_sighup(Logger* logger, const char* env_var, const char* path) {
+  assert(logger != NULL && (env_var != NULL || path != NULL));
+
+  if (__atomic_load_n(&reloader, __ATOMIC_ACQUIRE)) {
+    fprintf(stderr, "Failed to install SIGHUP reload: already owned by a logger\n");
+    return -1;
+  }
+
+  Reloader* state = (Reloader*)calloc(1, sizeof(Reloader));
+  if (!state) return -1;
+  state->logger = logger;
+  state->env_var = env_var ? strdup(env_var) : NULL;
+  state->path = path ? strdup(path) : NULL;
+  if ((env_var && !state->env_var) || (path && !state->path) || sem_init(&state->wake, 0, 0) != 0) {
+    reloader_free(state);
+    return -1;
+  }
+  if (pthread_create(&state->thread, NULL, reloader_main, state) != 0) {
+    sem_destroy(&state->wake);
+    reloader_free(state);
+    return -1;
+  }
+
+  __atomic_store_n(&reloader, state, __ATOMIC_RELEASE);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_sighup;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  if (sigaction(SIGHUP, &action, &state->previous) != 0) {
+    fprintf(stderr, "Failed to install SIGHUP handler: %s\n", strerror(errno));
+    __atomic_store_n(&reloader, NULL, __ATOMIC_RELEASE);
+    __atomic_store_n(&state->stop, true, __ATOMIC_RELEASE);
+    sem_post(&state->wake);
+    pthread_join(state->thread, NULL);
+    sem_destroy(&state->wake);
+    reloader_free(state);
+    return -1;
+  }
+  return 0;
+}
+
+void levels_free(Logger* logger) {
+  assert(logger != NULL);
+
+  Reloader* state = __atomic_load_n(&reloader, __ATOMIC_ACQUIRE);
+  if (state && state->logger == logger) {
+    sigaction(SIGHUP, &state->previous, NULL);
+    __atomic_store_n(&reloader, NULL, __ATOMIC_RELEASE);
+    __atomic_store_n(&state->stop, true, __ATOMIC_RELEASE);
+    sem_post(&state->wake);
+    pthread_join(state->thread, NULL);
+    sem_destroy(&state->wake);
+    reloader_free(state);
+  }
+
+  LogCategory* category = logger->categories;
+  while (category) {
+    LogCategory* next = category->next;
+    free(category);
+    category = next;
+  }
+  logger->categories = NULL;
+}
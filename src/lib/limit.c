@@ -0,0 +1,240 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// RATE LIMITING
+//####################
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define REPORT_INTERVAL_US 1000000
+
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static LOG_PRINTF(3, 4) void log_at(const Logger* logger, LogLevel level, const char* message, ...) {
+  va_list args;
+  va_start(args, message);
+  logger_log(logger, level, message, args);
+  va_end(args);
+}
+
+//------------------------------
+// QUIET SITES
+//------------------------------
+
+// A site that suppresses or repeats a record is pushed, once, onto a lock-free
+// list of watched sites and remembers the logger to report to. The first one
+// starts a detached reporter thread that writes the counts of sites gone
+// quiet; logger_free writes what its sites still hold and unbinds them.
+// watch_lock keeps a logger alive while a report is being written to it.
+
+static LogRateLimit* watched_limits = NULL;
+static LogDedup* watched_dedups = NULL;
+static pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t watch_once = PTHREAD_ONCE_INIT;
+static bool reporter_started = false;
+
+static void report_suppressed(const Logger* logger, LogLevel level, LogRateLimit* limit) {
+  uint64_t suppressed = __atomic_exchange_n(&limit->suppressed, 0, __ATOMIC_RELAXED);
+  if (suppressed > 0) {
+    log_at(logger, level, "%s:%d: %llu messages suppressed\n", limit->file, limit->line, (unsigned long long)suppressed);
+  }
+}
+
+static void report_repeats(const Logger* logger, LogLevel level, LogDedup* dedup);
+
+static void report_watched(const Logger* only, uint64_t now) {
+  LogRateLimit* limit = __atomic_load_n(&watched_limits, __ATOMIC_ACQUIRE);
+  for (; limit; limit = limit->next_watched) {
+    const Logger* logger = __atomic_load_n(&limit->logger, __ATOMIC_RELAXED);
+    if (!logger || (only && logger != only)) continue;
+    // quiet once the bucket holds a token again
+    if (only || now >= __atomic_load_n(&limit->next_ns, __ATOMIC_RELAXED)) report_suppressed(logger, limit->level, limit);
+    if (only) __atomic_store_n(&limit->logger, NULL, __ATOMIC_RELAXED);
+  }
+
+  LogDedup* dedup = __atomic_load_n(&watched_dedups, __ATOMIC_ACQUIRE);
+  for (; dedup; dedup = dedup->next_watched) {
+    const Logger* logger = __atomic_load_n(&dedup->logger, __ATOMIC_RELAXED);
+    if (!logger || (only && logger != only)) continue;
+    uint64_t reported = __atomic_load_n(&dedup->reported_ns, __ATOMIC_RELAXED);
+    if (only || (now - reported >= dedup->window_ns
+      && __atomic_compare_exchange_n(&dedup->reported_ns, &reported, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))) {
+      report_repeats(logger, dedup->level, dedup);
+    }
+    if (only) __atomic_store_n(&dedup->logger, NULL, __ATOMIC_RELAXED);
+  }
+}
+
+static void* reporter_main(void* arg) {
+  (void)arg;
+  while (true) {
+    usleep(REPORT_INTERVAL_US);
+    pthread_mutex_lock(&watch_lock);
+    report_watched(NULL, now_ns());
+    pthread_mutex_unlock(&watch_lock);
+  }
+  return NULL;
+}
+
+static void watch_prepare(void) {
+  pthread_mutex_lock(&watch_lock);
+}
+
+static void watch_parent(void) {
+  pthread_mutex_unlock(&watch_lock);
+}
+
+// The reporter does not survive fork, the first site the child watches
+// starts its own.
+static void watch_child(void) {
+  pthread_mutex_unlock(&watch_lock);
+  __atomic_store_n(&reporter_started, false, __ATOMIC_RELAXED);
+}
+
+static void watch_init(void) {
+  pthread_atfork(watch_prepare, watch_parent, watch_child);
+}
+
+static void start_reporter(void) {
+  if (__atomic_load_n(&reporter_started, __ATOMIC_RELAXED) || __atomic_exchange_n(&reporter_started, true, __ATOMIC_ACQ_REL)) return;
+
+  pthread_once(&watch_once, watch_init);
+  pthread_t reporter;
+  if (pthread_create(&reporter, NULL, reporter_main, NULL) != 0) {
+    fprintf(stderr, "Failed to start the suppressed records reporter\n");
+    return;
+  }
+  pthread_detach(reporter);
+}
+
+static void watch_limit(const Logger* logger, LogLevel level, LogRateLimit* limit) {
+  limit->level = level;
+  __atomic_store_n(&limit->logger, logger, __ATOMIC_RELAXED);
+  if (__atomic_exchange_n(&limit->watched, true, __ATOMIC_ACQ_REL)) return;
+
+  LogRateLimit* head = __atomic_load_n(&watched_limits, __ATOMIC_RELAXED);
+  do {
+    limit->next_watched = head;
+  } while (!__atomic_compare_exchange_n(&watched_limits, &head, limit, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  start_reporter();
+}
+
+static void watch_dedup(const Logger* logger, LogLevel level, LogDedup* dedup) {
+  dedup->level = level;
+  __atomic_store_n(&dedup->logger, logger, __ATOMIC_RELAXED);
+  if (__atomic_exchange_n(&dedup->watched, true, __ATOMIC_ACQ_REL)) return;
+
+  LogDedup* head = __atomic_load_n(&watched_dedups, __ATOMIC_RELAXED);
+  do {
+    dedup->next_watched = head;
+  } while (!__atomic_compare_exchange_n(&watched_dedups, &head, dedup, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  start_reporter();
+}
+
+void limits_release(const Logger* logger) {
+  assert(logger != NULL);
+
+  if (!__atomic_load_n(&watched_limits, __ATOMIC_ACQUIRE) && !__atomic_load_n(&watched_dedups, __ATOMIC_ACQUIRE)) return;
+  pthread_mutex_lock(&watch_lock);
+  report_watched(logger, now_ns());
+  pthread_mutex_unlock(&watch_lock);
+}
+
+//------------------------------
+// SITES
+//------------------------------
+
+// Generic cell rate algorithm: the bucket is a single timestamp, the time at
+// which the next record is due. A call is admitted while that time is less
+// than tolerance_ns (burst - 1 intervals) ahead of now.
+bool log_rate_limit_allow(const Logger* logger, LogLevel level, LogRateLimit* limit) {
+  assert(logger != NULL && limit != NULL);
+
+  uint64_t now = now_ns();
+  uint64_t next = __atomic_load_n(&limit->next_ns, __ATOMIC_RELAXED);
+  while (true) {
+    uint64_t base = next > now ? next : now;
+    if (base - now > limit->tolerance_ns) {
+      if (__atomic_fetch_add(&limit->suppressed, 1, __ATOMIC_RELAXED) == 0) watch_limit(logger, level, limit);
+      return false;
+    }
+    if (__atomic_compare_exchange_n(&limit->next_ns, &next, base + limit->interval_ns, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      return true;
+    }
+  }
+}
+
+void log_rate_limited(const Logger* logger, LogLevel level, LogRateLimit* limit, const char* message, ...) {
+  assert(logger != NULL && limit != NULL && message != NULL);
+
+  if (!logger_sample(logger, level, 1)) return;
+
+  report_suppressed(logger, level, limit);
+
+  va_list args;
+  va_start(args, message);
+  logger_log(logger, level, message, args);
+  va_end(args);
+}
+
+static uint64_t hash_message(const char* message, va_list args) {
+  char buff[BUFF_SIZE_RECORD];
+  int len = format_vsnprintf(buff, sizeof(buff), message, args);
+  if (len < 0) return 0;
+
+  // longer messages only hash their first bytes, plus their length
+  size_t hashed = (size_t)len < sizeof(buff) ? (size_t)len : sizeof(buff) - 1;
+  uint64_t hash = FNV_OFFSET ^ (uint64_t)len;
+  for (size_t i = 0; i < hashed; ++i) {
+    hash = (hash ^ (unsigned char)buff[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static void report_repeats(const Logger* logger, LogLevel level, LogDedup* dedup) {
+  uint64_t repeats = __atomic_exchange_n(&dedup->repeats, 0, __ATOMIC_RELAXED);
+  if (repeats > 0) {
+    log_at(logger, level, "%s:%d: last message repeated %llu times\n", dedup->file, dedup->line, (unsigned long long)repeats);
+  }
+}
+
+void log_dedup(const Logger* logger, LogLevel level, LogDedup* dedup, const char* message, ...) {
+  assert(logger != NULL && dedup != NULL && message != NULL);
+
+  if (!logger_sample(logger, level, 1)) return;
+
+  // formatted on the stack: the record buffer is still needed to write it
+  va_list args;
+  va_start(args, message);
+  uint64_t hash = hash_message(message, args);
+  va_end(args);
+
+  uint64_t now = now_ns();
+  uint64_t last = __atomic_exchange_n(&dedup->last_hash, hash, __ATOMIC_RELAXED);
+  if (last == hash) {
+    if (__atomic_fetch_add(&dedup->repeats, 1, __ATOMIC_RELAXED) == 0) watch_dedup(logger, level, dedup);
+    uint64_t reported = __atomic_load_n(&dedup->reported_ns, __ATOMIC_RELAXED);
+    if (now - reported >= dedup->window_ns &&
+        __atomic_compare_exchange_n(&dedup->reported_ns, &reported, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      report_repeats(logger, level, dedup);
+    }
+    return;
+  }
+
+  report_repeats(logger, level, dedup);
+  __atomic_store_n(&dedup->reported_ns, now, __ATOMIC_RELAXED);
+
+  va_start(args, message);
+  logger_log(logger, level, message, args);
+  va_end(args);
+}
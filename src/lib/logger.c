@@ -1,10 +1,12 @@
 #include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
-#include "./c_logger.h"
+#include "./logger_internal.h"
 
 //####################
 // LOGGER
@@ -33,198 +35,595 @@ static int safe_mutex_unlock(pthread_mutex_t* mutex) {
   return 0;
 }
 
-void timestamp(char* buff, size_t size) {
-  assert(buff != NULL);
+int logger_lock(const Logger* logger) {
+  assert(logger != NULL);
+
+  pthread_mutex_t* lock = (pthread_mutex_t*)&logger->lock;
+  if (!logger->stats) return safe_mutex_lock(lock);
 
-  time_t now = time(NULL);
-  struct tm* time = localtime(&now);
-  strftime(buff, size, "%Y-%m-%d %H:%M:%S", time);
+  int result = pthread_mutex_trylock(lock);
+  if (result == EBUSY) {
+    uint64_t start = stats_now();
+    result = pthread_mutex_lock(lock);
+    stats_lock_wait(logger->stats, stats_now() - start);
+  }
+  if (result != 0) {
+    fprintf(stderr, "Failed to lock mutex: %s\n", strerror(result));
+    return -1;
+  }
+  return 0;
 }
 
-Logger* logger_new(LogLevel level, FILE* out, FILE* err) {
-  assert(out != NULL && err != NULL);
+void logger_unlock(const Logger* logger) {
+  assert(logger != NULL);
+
+  safe_mutex_unlock((pthread_mutex_t*)&logger->lock);
+}
+
+static const char* LEVEL_TAGS[] = {
+  "[FATAL] ", "[ERROR] ", "[WARN] ", "[INFO] ", "[DEBUG] ", "[TRACE] ", "[VERBOSE] "
+};
+
+static const char* LEVEL_NAMES[] = {
+  "FATAL", "ERROR", "WARN", "INFO", "DEBUG", "TRACE", "VERBOSE"
+};
+
+static const char* LEVEL_COLORS[] = {
+  TXT_RED, TXT_BRIGHT_RED, TXT_BRIGHT_YELLOW, TXT_BRIGHT_GREEN, TXT_BRIGHT_BLUE, TXT_BRIGHT_CYAN, TXT_BRIGHT_WHITE
+};
+
+const char* logger_level_tag(LogLevel level) {
+  return LEVEL_TAGS[level];
+}
+
+const char* logger_level_name(LogLevel level) {
+  return LEVEL_NAMES[level];
+}
+
+const char* logger_level_color(LogLevel level) {
+  return LEVEL_COLORS[level];
+}
+
+FILE* logger_stream(const Logger* logger, LogLevel level) {
+  assert(logger != NULL);
+
+  return level <= WARN ? logger->err : logger->out;
+}
+
+int logger_err_fd(const Logger* logger) {
+  assert(logger != NULL);
+
+  if (logger->err) return fileno(logger->err);
+  return logger->direct_err >= 0 ? logger->direct_err : STDERR_FILENO;
+}
+
+bool logger_is_colored(const Logger* logger, LogLevel level) {
+  return level <= WARN ? logger->colored_err : logger->colored_out;
+}
+
+// Colors go to terminals only, and never when NO_COLOR is set (no-color.org).
+static bool is_terminal(FILE* stream) {
+  const char* no_color = getenv("NO_COLOR");
+  return stream && !(no_color && no_color[0]) && isatty(fileno(stream));
+}
+
+void logger_record_tags(char* buff, size_t size, const char* category, uint64_t sample) {
+  assert(buff != NULL && size > 0);
+
+  int len = category ? snprintf(buff, size, " [%s]", category) : 0;
+  if (len < 0 || (size_t)len >= size) len = 0;
+  if (sample > 1) snprintf(buff + len, size - (size_t)len, " sample=%llu", (unsigned long long)sample);
+  else buff[len] = '\0';
+}
+
+int logger_render(const Logger* logger, LogLevel level, char* buff, size_t size, const char* message, va_list args) {
+  assert(logger != NULL);
+
+  struct timespec now;
+  clock_gettime(logger->ts_clock, &now);
+  return logger_render_at(logger, level, &now, buff, size, message, args);
+}
+
+int logger_render_at(const Logger* logger, LogLevel level, const struct timespec* now, char* buff, size_t size, const char* message, va_list args) {
+  assert(logger != NULL && now != NULL && buff != NULL && message != NULL);
+
+  LogRecord record = {
+    .level = level, .time = *now, .precision = logger->ts_precision, .message = NULL, .message_len = 0,
+    .category = logger_record_category, .sample = logger_record_sample
+  };
+  const LogPattern* pattern = logger->pattern ? logger->pattern : log_pattern_default();
+
+  // args may be an array parameter here, a copy can be passed by address
+  va_list copy;
+  va_copy(copy, args);
+  int len = pattern_render(pattern, &record, logger_is_colored(logger, level), message, &copy, buff, size);
+  va_end(copy);
+  return len;
+}
+
+//####################
+// RECORD BUFFERS
+//####################
+
+// Records are rendered into a per-thread buffer; the ones that do not fit
+// spill into a thread-local arena that grows on demand and is released when
+// the thread exits.
+static __thread char record_buff[BUFF_SIZE_RECORD];
+static __thread char* arena = NULL;
+static __thread size_t arena_size = 0;
+
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+
+static void arena_key_init(void) {
+  pthread_key_create(&arena_key, free);
+}
 
+static char* arena_reserve(size_t size) {
+  if (size <= arena_size) return arena;
+
+  size_t capacity = arena_size ? arena_size : BUFF_SIZE_RECORD * 2;
+  while (capacity < size) capacity <<= 1;
+
+  char* grown = (char*)realloc(arena, capacity);
+  if (!grown) return NULL;
+
+  pthread_once(&arena_key_once, arena_key_init);
+  pthread_setspecific(arena_key, grown);
+  arena = grown;
+  arena_size = capacity;
+  return arena;
+}
+
+char* logger_buffer(size_t size) {
+  return size <= BUFF_SIZE_RECORD ? record_buff : arena_reserve(size);
+}
+
+const char* logger_format_message(const char* message, va_list args, size_t* len) {
+  assert(message != NULL && len != NULL);
+
+  va_list copy;
+  va_copy(copy, args);
+  int needed = format_vsnprintf(record_buff, BUFF_SIZE_RECORD, message, args);
+  const char* text = record_buff;
+
+  if (needed >= BUFF_SIZE_RECORD) {
+    char* buff = arena_reserve((size_t)needed + 1);
+    if (buff) {
+      needed = format_vsnprintf(buff, (size_t)needed + 1, message, copy);
+      text = buff;
+    } else {
+      needed = BUFF_SIZE_RECORD - 1;
+    }
+  }
+  va_end(copy);
+
+  if (needed < 0) return NULL;
+  *len = (size_t)needed;
+  return text;
+}
+
+const char* logger_format(const Logger* logger, LogLevel level, const char* message, va_list args, size_t* len) {
+  assert(logger != NULL && message != NULL && len != NULL);
+
+  va_list copy;
+  va_copy(copy, args);
+  int needed = logger_render(logger, level, record_buff, BUFF_SIZE_RECORD, message, args);
+  const char* record = record_buff;
+
+  if (needed >= BUFF_SIZE_RECORD) {
+    char* buff = arena_reserve((size_t)needed + 1);
+    if (buff) {
+      needed = logger_render(logger, level, buff, (size_t)needed + 1, message, copy);
+      record = buff;
+    } else {
+      needed = BUFF_SIZE_RECORD - 1;
+    }
+  }
+  va_end(copy);
+
+  if (needed < 0) return NULL;
+  *len = (size_t)needed;
+  return record;
+}
+
+static Logger* logger_init(LogLevel level, FILE* out, FILE* err) {
   Logger* logger = (Logger*)malloc(sizeof(Logger));
   if (!logger) return NULL;
-  
+
   pthread_mutex_init(&logger->lock, NULL);
   logger->level = level;
   logger->out = out;
   logger->err = err;
+  logger->async = NULL;
+  logger->shards = NULL;
+  logger->binary = false;
+  logger->ts_precision = TS_SECONDS;
+  logger->ts_clock = TIMESTAMP_DEFAULT_CLOCK;
+  logger->flush = (FlushPolicy){ .mode = FLUSH_ALWAYS, .threshold = 0, .level = FATAL, .sync_errors = false };
+  logger->pending_records = 0;
+  logger->pending_bytes = 0;
+  logger->flush_timer = NULL;
+  logger->mmap = NULL;
+  logger->rotator = NULL;
+  logger->sink_count = 0;
+  logger->kv_encoding = LOG_ENCODING_JSON;
+  memset(logger->sample_rate, 0, sizeof(logger->sample_rate));
+  logger->categories = NULL;
+  logger->recorder = NULL;
+  logger->record_level = FATAL;
+  logger->stats = NULL;
+  logger->direct_out = -1;
+  logger->direct_err = -1;
+  logger->direct_max = 0;
+  logger->pattern = NULL;
+  logger->shm = NULL;
+  logger->colored_out = is_terminal(out);
+  logger->colored_err = is_terminal(err);
+  return logger;
+}
+
+Logger* logger_new(LogLevel level, FILE* out, FILE* err) {
+  assert(out != NULL && err != NULL);
+
+  return logger_init(level, out, err);
+}
+
+Logger* logger_new_async(LogLevel level, FILE* out, FILE* err, size_t capacity) {
+  assert(out != NULL && err != NULL);
+
+  Logger* logger = logger_init(level, out, err);
+  if (!logger) return NULL;
+
+  logger->async = async_queue_new(logger, capacity, NULL);
+  if (!logger->async) {
+    pthread_mutex_destroy(&logger->lock);
+    free(logger);
+    return NULL;
+  }
+  return logger;
+}
+
+Logger* logger_new_sharded(LogLevel level, FILE* out, FILE* err, size_t capacity, unsigned window_us) {
+  assert(out != NULL && err != NULL);
+
+  Logger* logger = logger_init(level, out, err);
+  if (!logger) return NULL;
+
+  logger->shards = shard_set_new(logger, capacity, window_us);
+  if (!logger->shards) {
+    pthread_mutex_destroy(&logger->lock);
+    free(logger);
+    return NULL;
+  }
+  return logger;
+}
+
+Logger* logger_new_batched(LogLevel level, FILE* out, FILE* err, size_t capacity, BatchPolicy policy) {
+  assert(out != NULL && err != NULL);
+
+  Logger* logger = logger_init(level, out, err);
+  if (!logger) return NULL;
+
+  logger->async = async_queue_new(logger, capacity, &policy);
+  if (!logger->async) {
+    pthread_mutex_destroy(&logger->lock);
+    free(logger);
+    return NULL;
+  }
+  return logger;
+}
+
+Logger* logger_new_mmap(LogLevel level, const char* path, size_t chunk_size, size_t max_size) {
+  assert(path != NULL);
+
+  Logger* logger = logger_init(level, NULL, NULL);
+  if (!logger) return NULL;
+
+  logger->mmap = mmap_sink_new(path, chunk_size, max_size);
+  if (!logger->mmap) {
+    pthread_mutex_destroy(&logger->lock);
+    free(logger);
+    return NULL;
+  }
+  return logger;
+}
+
+Logger* logger_new_rotating(LogLevel level, const char* path, RotationPolicy policy) {
+  assert(path != NULL);
+
+  Logger* logger = logger_init(level, NULL, NULL);
+  if (!logger) return NULL;
+
+  FILE* stream = NULL;
+  logger->rotator = rotator_new(path, policy, &stream);
+  if (!logger->rotator) {
+    pthread_mutex_destroy(&logger->lock);
+    free(logger);
+    return NULL;
+  }
+  logger->out = stream;
+  logger->err = stream;
+  return logger;
+}
+
+Logger* logger_new_sinks(void) {
+  return logger_init(FATAL, NULL, NULL);
+}
+
+Logger* logger_new_direct(LogLevel level, int out_fd, int err_fd, size_t max_record) {
+  assert(out_fd >= 0 && err_fd >= 0);
+
+  Logger* logger = logger_init(level, NULL, NULL);
+  if (!logger) return NULL;
+
+  logger->direct_out = out_fd;
+  logger->direct_err = err_fd;
+  logger->direct_max = max_record && max_record < DIRECT_MAX_RECORD ? max_record : DIRECT_MAX_RECORD;
+  return logger;
+}
+
+Logger* logger_new_shm(LogLevel level, LogShm* shm) {
+  assert(shm != NULL);
+
+  Logger* logger = logger_init(level, NULL, NULL);
+  if (!logger) return NULL;
+
+  logger->shm = shm;
   return logger;
 }
 
 void logger_free(Logger* logger) {
   assert(logger != NULL);
 
+  limits_release(logger);
+  if (logger->async) async_queue_free(logger->async);
+  if (logger->shards) shard_set_free(logger->shards);
+  if (logger->mmap) mmap_sink_free(logger->mmap);
+  if (logger->flush_timer) flush_timer_free(logger->flush_timer);
+  if (logger->out) fflush(logger->out);
+  if (logger->err) fflush(logger->err);
+  if (logger->sink_count) sinks_close(logger);
+  if (logger->rotator) rotator_free(logger->rotator, logger->out);
+  levels_free(logger);
+  if (logger->recorder) recorder_free(logger);
+  if (logger->stats) stats_set_free(logger->stats);
+  log_pattern_free(logger->pattern);
   pthread_mutex_destroy(&logger->lock);
   free(logger);
 }
 
-void log_fatal(const Logger* logger, const char* message, ...) {
+void logger_set_timestamp(Logger* logger, TimestampPrecision precision, clockid_t clock) {
+  assert(logger != NULL);
+
+  logger->ts_precision = precision;
+  logger->ts_clock = clock;
+}
+
+int logger_set_flush_policy(Logger* logger, FlushPolicy policy) {
+  assert(logger != NULL);
+  assert(policy.mode == FLUSH_ALWAYS || policy.mode == FLUSH_ON_LEVEL || policy.threshold > 0);
+
+  if (logger->flush_timer) {
+    flush_timer_free(logger->flush_timer);
+    logger->flush_timer = NULL;
+  }
+
+  if (safe_mutex_lock(&logger->lock) != 0) return -1;
+  logger->flush = policy;
+  logger->pending_records = 0;
+  logger->pending_bytes = 0;
+  flush_streams(logger);
+  safe_mutex_unlock(&logger->lock);
+
+  if (policy.mode == FLUSH_INTERVAL) {
+    logger->flush_timer = flush_timer_new(logger, policy.threshold);
+    if (!logger->flush_timer) return -1;
+  }
+  return 0;
+}
+
+void logger_set_kv_encoding(Logger* logger, LogEncoding encoding) {
+  assert(logger != NULL);
+
+  logger->kv_encoding = encoding;
+}
+
+void logger_write(const Logger* logger, LogLevel level, const char* record, size_t len) {
+  assert(logger != NULL && record != NULL);
+
+  if (logger->mmap) {
+    if (mmap_sink_write(logger->mmap, record, len) == 0 && logger->stats) stats_bytes(logger->stats, len);
+    if (logger->flush.sync_errors && level <= ERROR) mmap_sink_sync(logger->mmap);
+    return;
+  }
+  if (logger_lock(logger) != 0) return;
+  if (logger->rotator) rotator_before_write((Logger*)logger, len);
+  FILE* stream = logger_stream(logger, level);
+  fwrite(record, 1, len, stream);
+  if (logger->stats) stats_bytes(logger->stats, len);
+  flush_after_write((Logger*)logger, stream, level, len);
+  logger_unlock(logger);
+}
+
+void logger_log(const Logger* logger, LogLevel level, const char* message, va_list args) {
   assert(logger != NULL && message != NULL);
 
-  if (logger->level < FATAL) return;
-  if (safe_mutex_lock((pthread_mutex_t*)&logger->lock) != 0) return;
+  if (logger->stats) stats_emitted(logger->stats, level);
+  if (logger->binary) {
+    binary_write_text(logger, level, message, args);
+    return;
+  }
+  if (logger->async) {
+    async_queue_push(logger->async, level, message, args);
+    return;
+  }
+  if (logger->shards) {
+    shard_set_push(logger->shards, level, message, args);
+    return;
+  }
+  if (logger->sink_count) {
+    sinks_log(logger, level, message, args);
+    return;
+  }
+  if (logger->direct_max) {
+    direct_log(logger, level, message, args);
+    return;
+  }
+  if (logger->shm) {
+    shm_log(logger, level, message, args);
+    return;
+  }
 
-  char stamp[BUFF_SIZE_TIMESTAMP];
-  timestamp(stamp, BUFF_SIZE_TIMESTAMP);
+  // the whole record is built before taking the lock, which only covers the append
+  size_t len = 0;
+  const char* record = logger_format(logger, level, message, args, &len);
+  if (!record) return;
+
+  logger_write(logger, level, record, len);
+}
+
+void logger_log_line(const Logger* logger, LogLevel level, char* line, size_t len) {
+  assert(logger != NULL && line != NULL);
+
+  if (logger->stats) stats_emitted(logger->stats, level);
+  if (logger->binary) {
+    binary_write_line(logger, level, line, len);
+    return;
+  }
+  if (logger->async) {
+    async_queue_push_line(logger->async, level, line, len);
+    return;
+  }
+  if (logger->shards) {
+    shard_set_push_line(logger->shards, level, line, len);
+    return;
+  }
+  if (logger->sink_count) {
+    sinks_write_line(logger, level, line, len);
+    return;
+  }
+  if (logger->direct_max) {
+    direct_write_line(logger, level, line, len);
+    return;
+  }
+  if (logger->shm) {
+    shm_write_line(logger, level, line, len);
+    return;
+  }
+  logger_write(logger, level, line, len);
+}
+
+// The flight recorder sees records before the level and sampling checks: a
+// record the logger filters out only costs its copy into the ring.
+static void logger_log_level(const Logger* logger, LogLevel level, const char* message, va_list args) {
+  uint64_t start = logger->stats ? stats_now() : 0;
+  if (logger->recorder && logger->record_level >= level) {
+    va_list copy;
+    va_copy(copy, args);
+    recorder_write(logger->recorder, level, message, copy);
+    va_end(copy);
+  }
+  if (logger_admit(logger, logger_get_level(logger), level, 1)) logger_log(logger, level, message, args);
+  if (logger->stats) stats_call(logger->stats, stats_now() - start);
+}
+
+void log_fatal(const Logger* logger, const char* message, ...) {
+  assert(logger != NULL && message != NULL);
+
+  if (!logger_enabled(logger, FATAL)) {
+    logger_count_filtered(logger, FATAL);
+    return;
+  }
 
   va_list args;
   va_start(args, message);
-  if (logger->err == stderr) {
-    fprintf(logger->err, TXT_RED "[FATAL] " RESET);
-  } else {
-    fprintf(logger->err,"[FATAL] ");
-  }
-  fprintf(logger->err, "(%s) -- ", stamp);
-  vfprintf(logger->err, message, args);
+  logger_log_level(logger, FATAL, message, args);
   va_end(args);
-  fflush(stderr);
 
-  safe_mutex_unlock((pthread_mutex_t*)&logger->lock);
+  if (logger->recorder) logger_dump_flight_recorder(logger);
 }
 
 void log_error(const Logger* logger, const char* message, ...) {
   assert(logger != NULL && message != NULL);
 
-  if (logger->level < ERROR) return;
-  if (safe_mutex_lock((pthread_mutex_t*)&logger->lock) != 0) return;
-
-  char stamp[BUFF_SIZE_TIMESTAMP];
-  timestamp(stamp, BUFF_SIZE_TIMESTAMP);
+  if (!logger_enabled(logger, ERROR)) {
+    logger_count_filtered(logger, ERROR);
+    return;
+  }
 
   va_list args;
   va_start(args, message);
-  if (logger->err == stderr) {
-    fprintf(logger->err, TXT_BRIGHT_RED "[ERROR] " RESET);
-  } else {
-    fprintf(logger->err,"[ERROR] ");
-  }
-  fprintf(logger->err, "(%s) -- ", stamp);
-  vfprintf(logger->err, message, args);
+  logger_log_level(logger, ERROR, message, args);
   va_end(args);
-  fflush(stderr);
-
-  safe_mutex_unlock((pthread_mutex_t*)&logger->lock);
 }
 
 void log_warn(const Logger* logger, const char* message, ...) {
   assert(logger != NULL && message != NULL);
 
-  if (logger->level < WARN) return;
-  if (safe_mutex_lock((pthread_mutex_t*)&logger->lock) != 0) return;
-
-  char stamp[BUFF_SIZE_TIMESTAMP];
-  timestamp(stamp, BUFF_SIZE_TIMESTAMP);
+  if (!logger_enabled(logger, WARN)) {
+    logger_count_filtered(logger, WARN);
+    return;
+  }
 
   va_list args;
   va_start(args, message);
-  if (logger->err == stderr) {
-    fprintf(logger->err, TXT_BRIGHT_YELLOW "[WARN] " RESET);
-  } else {
-    fprintf(logger->err,"[WARN] ");
-  }
-  fprintf(logger->err, "(%s) -- ", stamp);
-  vfprintf(logger->err, message, args);
+  logger_log_level(logger, WARN, message, args);
   va_end(args);
-  fflush(stderr);
-
-  safe_mutex_unlock((pthread_mutex_t*)&logger->lock);
 }
 
 void log_info(const Logger* logger, const char* message, ...) {
   assert(logger != NULL && message != NULL);
 
-  if (logger->level < INFO)  return;
-  if (safe_mutex_lock((pthread_mutex_t*)&logger->lock) != 0) return;
-
-  char stamp[BUFF_SIZE_TIMESTAMP];
-  timestamp(stamp, BUFF_SIZE_TIMESTAMP);
+  if (!logger_enabled(logger, INFO)) {
+    logger_count_filtered(logger, INFO);
+    return;
+  }
 
   va_list args;
   va_start(args, message);
-  if (logger->out == stdout) {
-    fprintf(logger->out, TXT_BRIGHT_GREEN "[INFO] " RESET);
-  } else {
-    fprintf(logger->out,"[INFO] ");
-  }
-  fprintf(logger->out, "(%s) -- ", stamp);
-  vfprintf(logger->out, message, args);
+  logger_log_level(logger, INFO, message, args);
   va_end(args);
-  fflush(stdout);
-
-  safe_mutex_unlock((pthread_mutex_t*)&logger->lock);
 }
 
 void log_debug(const Logger* logger, const char* message, ...) {
   assert(logger != NULL && message != NULL);
 
-  if (logger->level < DEBUG) return;
-  if (safe_mutex_lock((pthread_mutex_t*)&logger->lock) != 0) return;
-
-  char stamp[BUFF_SIZE_TIMESTAMP];
-  timestamp(stamp, BUFF_SIZE_TIMESTAMP);
+  if (!logger_enabled(logger, DEBUG)) {
+    logger_count_filtered(logger, DEBUG);
+    return;
+  }
 
   va_list args;
   va_start(args, message);
-  if (logger->out == stdout) {
-    fprintf(logger->out, TXT_BRIGHT_BLUE "[DEBUG] " RESET);
-  } else {
-    fprintf(logger->out,"[DEBUG] ");
-  }
-  fprintf(logger->out, "(%s) -- ", stamp);
-  vfprintf(logger->out, message, args);
+  logger_log_level(logger, DEBUG, message, args);
   va_end(args);
-  fflush(stdout);
-
-  safe_mutex_unlock((pthread_mutex_t*)&logger->lock);
 }
 
 void log_trace(const Logger* logger, const char* message, ...) {
   assert(logger != NULL && message != NULL);
 
-  if (logger->level < TRACE) return;
-  if (safe_mutex_lock((pthread_mutex_t*)&logger->lock) != 0) return;
-
-  char stamp[BUFF_SIZE_TIMESTAMP];
-  timestamp(stamp, BUFF_SIZE_TIMESTAMP);
+  if (!logger_enabled(logger, TRACE)) {
+    logger_count_filtered(logger, TRACE);
+    return;
+  }
 
   va_list args;
   va_start(args, message);
-  if (logger->out == stdout) {
-    fprintf(logger->out, TXT_BRIGHT_CYAN "[TRACE] " RESET);
-  } else {
-    fprintf(logger->out,"[TRACE] ");
-  }
-  fprintf(logger->out, "(%s) -- ", stamp);
-  vfprintf(logger->out, message, args);
+  logger_log_level(logger, TRACE, message, args);
   va_end(args);
-  fflush(stdout);
-
-  safe_mutex_unlock((pthread_mutex_t*)&logger->lock);
 }
 
 void log_verbose(const Logger* logger, const char* message, ...) {
   assert(logger != NULL && message != NULL);
 
-  if (logger->level < VERBOSE) return;
-  if (safe_mutex_lock((pthread_mutex_t*)&logger->lock) != 0) return;
-
-  char stamp[BUFF_SIZE_TIMESTAMP];
-  timestamp(stamp, BUFF_SIZE_TIMESTAMP);
+  if (!logger_enabled(logger, VERBOSE)) {
+    logger_count_filtered(logger, VERBOSE);
+    return;
+  }
 
   va_list args;
   va_start(args, message);
-  if (logger->out == stdout) {
-    fprintf(logger->out, TXT_BRIGHT_WHITE "[VERBOSE] " RESET);
-  } else {
-    fprintf(logger->out,"[VERBOSE] ");
-  }
-  fprintf(logger->out, "(%s) -- ", stamp);
-  vfprintf(logger->out, message, args);
+  logger_log_level(logger, VERBOSE, message, args);
   va_end(args);
-  fflush(stdout);
-
-  safe_mutex_unlock((pthread_mutex_t*)&logger->lock);
 }
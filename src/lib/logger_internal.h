@@ -0,0 +1,273 @@
+#ifndef LOGGER_INTERNAL_H
+#define LOGGER_INTERNAL_H
+
+#include <stdarg.h>
+
+#include "./c_logger.h"
+
+#define BUFF_SIZE_RECORD 1024
+#define BUFF_SIZE_SAMPLE 32 // " sample=N" in a record prefix
+#define BUFF_SIZE_TAGS (LOG_CATEGORY_NAME_SIZE + 3 + BUFF_SIZE_SAMPLE)
+
+//####################
+// LOGGER
+//####################
+
+// "[LEVEL] " tag without colors.
+const char* logger_level_tag(LogLevel level);
+// Level name without brackets, e.g. "INFO".
+const char* logger_level_name(LogLevel level);
+// ANSI color of the level's tag.
+const char* logger_level_color(LogLevel level);
+
+// Whether records of level are written with colors to their stream.
+bool logger_is_colored(const Logger* logger, LogLevel level);
+
+// " [category] sample=N" between the timestamp and "--", empty for records
+// outside categories and samples.
+void logger_record_tags(char* buff, size_t size, const char* category, uint64_t sample);
+
+// Stream a record of the given level is written to.
+FILE* logger_stream(const Logger* logger, LogLevel level);
+
+// Renders "[LEVEL] (timestamp) -- message" into buff, vsnprintf semantics:
+// returns the length the full record needs, or -1 on error.
+int logger_render(const Logger* logger, LogLevel level, char* buff, size_t size, const char* message, va_list args);
+// logger_render for a timestamp taken by the caller.
+int logger_render_at(const Logger* logger, LogLevel level, const struct timespec* now, char* buff, size_t size, const char* message, va_list args);
+
+// Renders a record into a thread-local buffer, growing the thread's arena for
+// oversized records. The result is valid until the thread's next call.
+const char* logger_format(const Logger* logger, LogLevel level, const char* message, va_list args, size_t* len);
+
+// vsnprintf for messages: the common conversions are rendered without stdio,
+// the others are passed on to vsnprintf.
+int format_vsnprintf(char* buff, size_t size, const char* format, va_list args);
+
+// Formats the message alone into the thread-local buffer, see logger_format.
+const char* logger_format_message(const char* message, va_list args, size_t* len);
+
+// Thread-local scratch buffer of at least size bytes, NULL if the arena could
+// not grow. Shares storage with logger_format.
+char* logger_buffer(size_t size);
+
+// Entry point shared by every log_* function once the level check passed.
+void logger_log(const Logger* logger, LogLevel level, const char* message, va_list args);
+
+// Appends a rendered record to the level's stream under the logger lock and
+// applies the flush policy.
+void logger_write(const Logger* logger, LogLevel level, const char* record, size_t len);
+
+// Descriptor the flight recorder dumps to: err's, the direct one or stderr.
+int logger_err_fd(const Logger* logger);
+
+// Bytes writable in front of a line passed to logger_log_line.
+#define LOGGER_LINE_HEADROOM 32
+
+// Like logger_log for a line that is already complete (no prefix is added),
+// routed to whichever destination the logger writes to. line must have
+// LOGGER_LINE_HEADROOM writable bytes before it.
+void logger_log_line(const Logger* logger, LogLevel level, char* line, size_t len);
+
+//####################
+// STATISTICS
+//####################
+
+// Called only when logger->stats is set; each updates the calling thread's
+// counters.
+void stats_emitted(StatsSet* set, LogLevel level);
+void stats_filtered(StatsSet* set, LogLevel level);
+void stats_call(StatsSet* set, uint64_t ns);
+void stats_bytes(StatsSet* set, size_t bytes);
+void stats_flush(StatsSet* set);
+void stats_lock_wait(StatsSet* set, uint64_t ns);
+// Monotonic ns for the durations above.
+uint64_t stats_now(void);
+void stats_set_free(StatsSet* set);
+
+static inline void logger_count_filtered(const Logger* logger, LogLevel level) {
+  if (logger->stats) stats_filtered(logger->stats, level);
+}
+
+// Takes the logger lock, timing the wait when it is contended and stats are
+// on. Returns 0 on success, -1 on error.
+int logger_lock(const Logger* logger);
+void logger_unlock(const Logger* logger);
+
+//####################
+// SAMPLING
+//####################
+
+// Sampling factor and category of the record the thread is logging, reset
+// by logger_sample.
+extern __thread uint64_t logger_record_sample;
+extern __thread const char* logger_record_category;
+
+// Draws from the thread's PRNG, true once every rate calls on average.
+bool sample_hit(unsigned rate);
+
+// Applies the level's sampling rate on top of the call site's factor; every
+// log entry point calls it once the level check passed. Returns false when
+// the record is dropped.
+static inline bool logger_sample(const Logger* logger, LogLevel level, uint64_t factor) {
+  unsigned rate = logger->sample_rate[level];
+  logger_record_sample = factor;
+  logger_record_category = NULL;
+  if (rate <= 1) return true;
+  if (!sample_hit(rate)) {
+    logger_count_filtered(logger, level);
+    return false;
+  }
+  logger_record_sample = factor * rate;
+  return true;
+}
+
+// The level check (against threshold) then logger_sample, counting the
+// records dropped by either.
+static inline bool logger_admit(const Logger* logger, LogLevel threshold, LogLevel level, uint64_t factor) {
+  if (threshold < level) {
+    logger_count_filtered(logger, level);
+    return false;
+  }
+  return logger_sample(logger, level, factor);
+}
+
+//####################
+// RATE LIMITING
+//####################
+
+// Reports the counts still pending at the call sites bound to logger and
+// unbinds them; called by logger_free.
+void limits_release(const Logger* logger);
+
+//####################
+// CATEGORIES
+//####################
+
+// Frees the logger's categories and stops its SIGHUP reloader.
+void levels_free(Logger* logger);
+
+//####################
+// FLIGHT RECORDER
+//####################
+
+// Copies a record into the next slot of the ring, lock-free.
+void recorder_write(FlightRecorder* recorder, LogLevel level, const char* message, va_list args);
+// Uninstalls the logger's crash handlers and frees its recorder.
+void recorder_free(Logger* logger);
+
+//####################
+// FLUSH
+//####################
+
+// Called with the logger lock held after a record was appended to stream
+// (NULL when it only went to sinks).
+void flush_after_write(Logger* logger, FILE* stream, LogLevel level, size_t len);
+// Flushes out and err, called with the logger lock held.
+void flush_streams(Logger* logger);
+FlushTimer* flush_timer_new(Logger* logger, size_t interval_ms);
+void flush_timer_free(FlushTimer* timer);
+
+//####################
+// MMAP
+//####################
+
+MmapSink* mmap_sink_new(const char* path, size_t chunk_size, size_t max_size);
+// Trims the file to what was written and unmaps it.
+void mmap_sink_free(MmapSink* sink);
+// Returns 0 on success, -1 if the record did not fit.
+int mmap_sink_write(MmapSink* sink, const char* record, size_t len);
+void mmap_sink_sync(MmapSink* sink);
+
+//####################
+// ROTATION
+//####################
+
+// Opens path for appending; the stream is owned by the rotator.
+Rotator* rotator_new(const char* path, RotationPolicy policy, FILE** stream);
+// Finishes pending renames and closes the current stream.
+void rotator_free(Rotator* rotator, FILE* current);
+// Called with the logger lock held before len bytes are appended, may swap
+// out/err to the prepared next file.
+void rotator_before_write(Logger* logger, size_t len);
+
+//####################
+// SINKS
+//####################
+
+// Formats the message once and writes it to out/err and every sink.
+void sinks_log(const Logger* logger, LogLevel level, const char* message, va_list args);
+// Writes a complete line as-is to out/err and every sink, skipping formatters.
+void sinks_write_line(const Logger* logger, LogLevel level, const char* line, size_t len);
+// Called with the logger lock held.
+void sinks_flush(Logger* logger);
+void sinks_close(Logger* logger);
+
+//####################
+// PATTERNS
+//####################
+
+// Returns NULL (after reporting it) on a malformed pattern.
+LogPattern* log_pattern_compile(const char* source);
+void log_pattern_free(LogPattern* pattern);
+// LOG_PATTERN_DEFAULT, compiled on first use.
+const LogPattern* log_pattern_default(void);
+// Renders record through pattern, vsnprintf semantics. The message is
+// formatted from format and args, or copied from record when format is NULL.
+int pattern_render(const LogPattern* pattern, const LogRecord* record, bool colored, const char* format, va_list* args, char* buff, size_t size);
+
+//####################
+// DIRECT
+//####################
+
+// Renders the record on the stack and writes it with a single write(2).
+void direct_log(const Logger* logger, LogLevel level, const char* message, va_list args);
+void direct_write_line(const Logger* logger, LogLevel level, const char* line, size_t len);
+
+//####################
+// SHARED MEMORY
+//####################
+
+// Renders the record on the stack and copies it into a slot of the shared ring.
+void shm_log(const Logger* logger, LogLevel level, const char* message, va_list args);
+void shm_write_line(const Logger* logger, LogLevel level, const char* line, size_t len);
+
+//####################
+// TIMESTAMP
+//####################
+
+// Formats now into buff (at least BUFF_SIZE_TIMESTAMP bytes), returns the length.
+size_t timestamp_format(char* buff, const struct timespec* now, TimestampPrecision precision);
+
+//####################
+// BINARY
+//####################
+
+// Writes a log_* record to a binary logger as a preformatted text record.
+void binary_write_text(const Logger* logger, LogLevel level, const char* message, va_list args);
+// Stores a complete line as a text record, its header goes in the headroom.
+void binary_write_line(const Logger* logger, LogLevel level, char* line, size_t len);
+
+//####################
+// SHARDS
+//####################
+
+ShardSet* shard_set_new(Logger* logger, size_t capacity, unsigned window_us);
+// Merges every pending record and joins the merger thread.
+void shard_set_free(ShardSet* set);
+void shard_set_push(ShardSet* set, LogLevel level, const char* message, va_list args);
+void shard_set_push_line(ShardSet* set, LogLevel level, const char* line, size_t len);
+
+//####################
+// ASYNC
+//####################
+
+// batch is NULL for a writer going through logger_write.
+AsyncQueue* async_queue_new(Logger* logger, size_t capacity, const BatchPolicy* batch);
+// Drains every pending record and joins the writer thread.
+void async_queue_free(AsyncQueue* queue);
+void async_queue_push(AsyncQueue* queue, LogLevel level, const char* message, va_list args);
+// Queues a copy of a complete record.
+void async_queue_push_line(AsyncQueue* queue, LogLevel level, const char* line, size_t len);
+
+#endif
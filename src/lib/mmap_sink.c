@@ -0,0 +1,166 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// MMAP
+//####################
+
+// The whole max_size address range is reserved up front, so the mapping never
+// moves: growing maps the next chunk of the file right after the previous one
+// and writers that raced past the old end simply wait for it. Only growth
+// takes grow_lock.
+
+struct MmapSink {
+  size_t offset;   // bump pointer, next byte to hand out
+  size_t mapped;   // bytes of the file mapped at base
+  size_t overflow; // first offset that did not fit, SIZE_MAX while none did
+  size_t existing; // size of the file when opened
+  int fd;
+  char* base;
+  size_t chunk_size;
+  size_t max_size;
+  pthread_mutex_t grow_lock;
+};
+
+static size_t round_to_page(size_t size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (size + page - 1) / page * page;
+}
+
+static int allocate(int fd, size_t offset, size_t len) {
+  int result = posix_fallocate(fd, (off_t)offset, (off_t)len);
+  // filesystems without fallocate still get a sparse file of the right size
+  if (result == EOPNOTSUPP || result == EINVAL) return ftruncate(fd, (off_t)(offset + len));
+  return result == 0 ? 0 : -1;
+}
+
+static int grow(MmapSink* sink, size_t needed) {
+  pthread_mutex_lock(&sink->grow_lock);
+
+  int result = 0;
+  size_t mapped = sink->mapped;
+  while (mapped < needed) {
+    size_t next = mapped + sink->chunk_size;
+    if (next > sink->max_size) next = sink->max_size;
+
+    if (allocate(sink->fd, mapped, next - mapped) != 0
+      || mmap(sink->base + mapped, next - mapped, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, sink->fd, (off_t)mapped) == MAP_FAILED) {
+      fprintf(stderr, "Failed to grow mmap log: %s\n", strerror(errno));
+      result = -1;
+      break;
+    }
+    mapped = next;
+    __atomic_store_n(&sink->mapped, mapped, __ATOMIC_RELEASE);
+  }
+
+  pthread_mutex_unlock(&sink->grow_lock);
+  return result;
+}
+
+static void note_overflow(MmapSink* sink, size_t start) {
+  size_t current = __atomic_load_n(&sink->overflow, __ATOMIC_RELAXED);
+  while (start < current
+    && !__atomic_compare_exchange_n(&sink->overflow, &current, start, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// A process that crashed never trimmed the file: the zero-filled rest of its
+// last chunk is not part of the log. Returns the end of the last record.
+static size_t logical_end(int fd, size_t size, size_t chunk_size) {
+  char buff[4096];
+  size_t floor = size > chunk_size ? size - chunk_size : 0;
+  size_t end = size;
+  while (end > floor) {
+    size_t len = end - floor < sizeof(buff) ? end - floor : sizeof(buff);
+    if (pread(fd, buff, len, (off_t)(end - len)) != (ssize_t)len) break;
+    size_t kept = len;
+    while (kept > 0 && buff[kept - 1] == '\0') --kept;
+    end -= len - kept;
+    if (kept > 0) break;
+  }
+  return end;
+}
+
+MmapSink* mmap_sink_new(const char* path, size_t chunk_size, size_t max_size) {
+  assert(path != NULL);
+
+  MmapSink* sink = (MmapSink*)malloc(sizeof(MmapSink));
+  if (!sink) return NULL;
+
+  sink->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (sink->fd < 0) {
+    free(sink);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(sink->fd, &st) != 0) {
+    close(sink->fd);
+    free(sink);
+    return NULL;
+  }
+
+  sink->chunk_size = round_to_page(chunk_size ? chunk_size : MMAP_DEFAULT_CHUNK_SIZE);
+  sink->max_size = round_to_page(max_size ? max_size : MMAP_DEFAULT_MAX_SIZE);
+  sink->base = (char*)mmap(NULL, sink->max_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (sink->base == MAP_FAILED) {
+    close(sink->fd);
+    free(sink);
+    return NULL;
+  }
+  // existing contents are kept, new records are appended after them
+  sink->existing = logical_end(sink->fd, (size_t)st.st_size, sink->chunk_size);
+  sink->offset = sink->existing;
+  sink->mapped = 0;
+  sink->overflow = SIZE_MAX;
+  pthread_mutex_init(&sink->grow_lock, NULL);
+  return sink;
+}
+
+void mmap_sink_free(MmapSink* sink) {
+  assert(sink != NULL);
+
+  size_t end = sink->offset < sink->overflow ? sink->offset : sink->overflow;
+  if (end > sink->mapped) end = sink->mapped;
+  // a sink freed before its first write never mapped the existing contents
+  if (end < sink->existing) end = sink->existing;
+
+  munmap(sink->base, sink->max_size);
+  if (ftruncate(sink->fd, (off_t)end) != 0) {
+    fprintf(stderr, "Failed to trim mmap log: %s\n", strerror(errno));
+  }
+  close(sink->fd);
+  pthread_mutex_destroy(&sink->grow_lock);
+  free(sink);
+}
+
+int mmap_sink_write(MmapSink* sink, const char* record, size_t len) {
+  assert(sink != NULL && record != NULL);
+
+  size_t start = __atomic_fetch_add(&sink->offset, len, __ATOMIC_RELAXED);
+  if (start + len > sink->max_size) {
+    note_overflow(sink, start);
+    return -1;
+  }
+  if (start + len > __atomic_load_n(&sink->mapped, __ATOMIC_ACQUIRE) && grow(sink, start + len) != 0) {
+    note_overflow(sink, start);
+    return -1;
+  }
+  memcpy(sink->base + start, record, len);
+  return 0;
+}
+
+void mmap_sink_sync(MmapSink* sink) {
+  assert(sink != NULL);
+
+  if (fdatasync(sink->fd) != 0) {
+    fprintf(stderr, "Failed to sync mmap log: %s\n", strerror(errno));
+  }
+}
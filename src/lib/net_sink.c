@@ -0,0 +1,377 @@
+#define _GNU_SOURCE // sendmmsg, program_invocation_short_name
+
+#include <assert.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// NETWORK SINK
+//####################
+
+// Records are framed as they are written and queued in a bounded buffer, each
+// behind a 4-byte length; flushes send the queue without blocking. Datagram
+// transports send up to NET_SEND_BATCH datagrams per sendmmsg, pointing their
+// iovecs straight into the queue. Whatever the socket does not take stays
+// queued for the next flush; records that do not fit in the queue are dropped
+// and counted. Every entry point runs under the logger lock.
+
+#define NET_SEND_BATCH 32
+#define NET_SEND_IOV 256
+#define NET_RECONNECT_SEC 1
+#define NET_HEADER_SIZE 128
+
+// LogLevel to syslog severity
+static const int SYSLOG_SEVERITY[] = { 2, 3, 4, 6, 7, 7, 7 };
+
+struct LogNetSink {
+  NetSinkPolicy policy;
+  int fd;
+  int type; // SOCK_DGRAM or SOCK_STREAM
+  struct sockaddr_storage peer;
+  socklen_t peer_len;
+  time_t retry_at; // next connection attempt of a stream transport
+  char* queue;
+  size_t capacity;
+  size_t head;
+  size_t tail;
+  size_t partial; // bytes of the first stream record already sent
+  uint64_t dropped;
+  // syslog header fields
+  char host[64];
+  char app[49];
+  long pid;
+  time_t stamp_second;
+  char stamp[24];
+};
+
+static int resolve(LogNetSink* sink, const char* address) {
+  if (sink->policy.transport != LOG_TRANSPORT_UDP) {
+    struct sockaddr_un* un = (struct sockaddr_un*)&sink->peer;
+    if (strlen(address) >= sizeof(un->sun_path)) return -1;
+    un->sun_family = AF_UNIX;
+    strcpy(un->sun_path, address);
+    sink->peer_len = (socklen_t)sizeof(struct sockaddr_un);
+    return 0;
+  }
+
+  // "port" alone or "host:port", the host defaulting to localhost
+  char host[256] = "localhost";
+  const char* port = strrchr(address, ':');
+  if (port) {
+    size_t len = (size_t)(port - address);
+    if (len >= sizeof(host)) return -1;
+    memcpy(host, address, len);
+    host[len] = '\0';
+    ++port;
+  } else {
+    port = address;
+  }
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_NUMERICSERV;
+  struct addrinfo* found = NULL;
+  int result = getaddrinfo(host, port, &hints, &found);
+  if (result != 0) {
+    fprintf(stderr, "Failed to resolve %s: %s\n", address, gai_strerror(result));
+    return -1;
+  }
+  memcpy(&sink->peer, found->ai_addr, found->ai_addrlen);
+  sink->peer_len = found->ai_addrlen;
+  freeaddrinfo(found);
+  return 0;
+}
+
+static void disconnect(LogNetSink* sink) {
+  if (sink->fd >= 0) close(sink->fd);
+  sink->fd = -1;
+  sink->retry_at = time(NULL) + NET_RECONNECT_SEC;
+}
+
+// Datagram sockets are opened once and address every send; stream sockets
+// connect, and reconnect at most every NET_RECONNECT_SEC after a failure.
+static int net_connect(LogNetSink* sink) {
+  if (sink->fd >= 0) return 0;
+  if (sink->type == SOCK_STREAM && time(NULL) < sink->retry_at) return -1;
+
+  sink->fd = socket(sink->peer.ss_family, sink->type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sink->fd < 0) {
+    disconnect(sink);
+    return -1;
+  }
+  if (sink->type == SOCK_STREAM && connect(sink->fd, (struct sockaddr*)&sink->peer, sink->peer_len) != 0) {
+    disconnect(sink);
+    return -1;
+  }
+  return 0;
+}
+
+LogNetSink* log_net_sink_new(const NetSinkPolicy* policy) {
+  assert(policy != NULL && policy->address != NULL);
+
+  LogNetSink* sink = (LogNetSink*)calloc(1, sizeof(LogNetSink));
+  if (!sink) return NULL;
+  sink->policy = *policy;
+  sink->policy.address = NULL;
+  if (!sink->policy.datagram_size) sink->policy.datagram_size = NET_DEFAULT_DATAGRAM_SIZE;
+  if (!sink->policy.buffer_size) sink->policy.buffer_size = NET_DEFAULT_BUFFER_SIZE;
+  if (sink->policy.facility <= 0 || sink->policy.facility > 23) sink->policy.facility = 1;
+  if (sink->policy.buffer_size < sink->policy.datagram_size) sink->policy.buffer_size = sink->policy.datagram_size;
+  sink->type = policy->transport == LOG_TRANSPORT_UNIX_STREAM ? SOCK_STREAM : SOCK_DGRAM;
+  sink->fd = -1;
+
+  if (resolve(sink, policy->address) != 0) {
+    fprintf(stderr, "Failed to create network sink: bad address %s\n", policy->address);
+    free(sink);
+    return NULL;
+  }
+  sink->capacity = sink->policy.buffer_size;
+  sink->queue = (char*)malloc(sink->capacity);
+  if (!sink->queue) {
+    free(sink);
+    return NULL;
+  }
+
+  if (gethostname(sink->host, sizeof(sink->host)) != 0 || !sink->host[0]) strcpy(sink->host, "-");
+  sink->host[sizeof(sink->host) - 1] = '\0';
+  snprintf(sink->app, sizeof(sink->app), "%s", policy->app_name ? policy->app_name : program_invocation_short_name);
+  sink->pid = (long)getpid();
+
+  // a stream peer that is not up yet is retried on the next flush
+  if (sink->type == SOCK_DGRAM && net_connect(sink) != 0) {
+    fprintf(stderr, "Failed to create network sink: %s\n", strerror(errno));
+    free(sink->queue);
+    free(sink);
+    return NULL;
+  }
+  net_connect(sink);
+  return sink;
+}
+
+//------------------------------
+// Queue
+//------------------------------
+
+static size_t record_len(const LogNetSink* sink, size_t offset) {
+  uint32_t len;
+  memcpy(&len, sink->queue + offset, sizeof(len));
+  return len;
+}
+
+static void consume(LogNetSink* sink, size_t records) {
+  for (size_t i = 0; i < records && sink->head < sink->tail; ++i) {
+    sink->head += sizeof(uint32_t) + record_len(sink, sink->head);
+  }
+  sink->partial = 0;
+  if (sink->head == sink->tail) sink->head = sink->tail = 0;
+}
+
+static bool would_block(int error) {
+  // ECONNREFUSED and ENOENT: nobody is listening on the Unix socket yet
+  return error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS || error == EINTR
+    || error == ECONNREFUSED || error == ENOENT;
+}
+
+static void send_datagrams(LogNetSink* sink) {
+  struct mmsghdr messages[NET_SEND_BATCH];
+  struct iovec iov[NET_SEND_IOV];
+  size_t records[NET_SEND_BATCH];
+
+  while (sink->head < sink->tail) {
+    size_t count = 0;
+    size_t used = 0;
+    size_t offset = sink->head;
+
+    // a datagram takes one record with syslog framing, as many as fit otherwise
+    while (offset < sink->tail && count < NET_SEND_BATCH && used < NET_SEND_IOV) {
+      struct msghdr* header = &messages[count].msg_hdr;
+      memset(header, 0, sizeof(struct msghdr));
+      header->msg_name = &sink->peer;
+      header->msg_namelen = sink->peer_len;
+      header->msg_iov = &iov[used];
+      records[count] = 0;
+
+      size_t bytes = 0;
+      while (offset < sink->tail && used < NET_SEND_IOV) {
+        size_t len = record_len(sink, offset);
+        if (records[count] > 0 && (sink->policy.syslog || bytes + len > sink->policy.datagram_size)) break;
+        iov[used].iov_base = sink->queue + offset + sizeof(uint32_t);
+        iov[used].iov_len = len;
+        ++used;
+        ++records[count];
+        bytes += len;
+        offset += sizeof(uint32_t) + len;
+      }
+      header->msg_iovlen = records[count];
+      ++count;
+    }
+
+    int sent = sendmmsg(sink->fd, messages, (unsigned)count, MSG_DONTWAIT);
+    if (sent < 0) {
+      if (would_block(errno)) return;
+      // e.g. EMSGSIZE: this datagram will never go through
+      __atomic_store_n(&sink->dropped, sink->dropped + records[0], __ATOMIC_RELAXED);
+      consume(sink, records[0]);
+      continue;
+    }
+    size_t done = 0;
+    for (int i = 0; i < sent; ++i) {
+      done += records[i];
+    }
+    consume(sink, done);
+    if ((size_t)sent < count) return;
+  }
+}
+
+static void send_stream(LogNetSink* sink) {
+  struct iovec iov[NET_SEND_IOV];
+
+  while (sink->head < sink->tail) {
+    if (net_connect(sink) != 0) return;
+
+    size_t used = 0;
+    for (size_t offset = sink->head; offset < sink->tail && used < NET_SEND_IOV; ++used) {
+      size_t len = record_len(sink, offset);
+      size_t skip = used == 0 ? sink->partial : 0;
+      iov[used].iov_base = sink->queue + offset + sizeof(uint32_t) + skip;
+      iov[used].iov_len = len - skip;
+      offset += sizeof(uint32_t) + len;
+    }
+
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = iov;
+    header.msg_iovlen = used;
+    ssize_t sent = sendmsg(sink->fd, &header, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+      // the peer went away: a record cut in the middle cannot be resumed
+      // on a new connection without breaking the framing
+      if (sink->partial) {
+        __atomic_store_n(&sink->dropped, sink->dropped + 1, __ATOMIC_RELAXED);
+        consume(sink, 1);
+      }
+      disconnect(sink);
+      return;
+    }
+
+    size_t left = (size_t)sent;
+    for (size_t i = 0; i < used && left > 0; ++i) {
+      if (left < iov[i].iov_len) {
+        sink->partial += left;
+        break;
+      }
+      left -= iov[i].iov_len;
+      consume(sink, 1);
+    }
+  }
+}
+
+static void net_send(LogNetSink* sink) {
+  if (sink->head == sink->tail) return;
+  if (sink->type == SOCK_STREAM) send_stream(sink);
+  else if (sink->fd >= 0) send_datagrams(sink);
+}
+
+//------------------------------
+// Framing
+//------------------------------
+
+// RFC 5424 header: "<PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID - - "
+static size_t syslog_header(LogNetSink* sink, const LogRecord* record, char* buff) {
+  if (record->time.tv_sec != sink->stamp_second) {
+    struct tm tm;
+    gmtime_r(&record->time.tv_sec, &tm);
+    strftime(sink->stamp, sizeof(sink->stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    sink->stamp_second = record->time.tv_sec;
+  }
+  int priority = sink->policy.facility * 8 + SYSLOG_SEVERITY[record->level];
+  int len = snprintf(buff, NET_HEADER_SIZE, "<%d>1 %s.%06ldZ %s %s %ld - - ",
+    priority, sink->stamp, record->time.tv_nsec / 1000L, sink->host, sink->app[0] ? sink->app : "-", sink->pid);
+  return len < 0 ? 0 : (size_t)len < NET_HEADER_SIZE ? (size_t)len : NET_HEADER_SIZE - 1;
+}
+
+static void net_sink_write(void* ctx, const LogRecord* record, const char* line, size_t len) {
+  LogNetSink* sink = (LogNetSink*)ctx;
+
+  char header[NET_HEADER_SIZE];
+  size_t header_len = 0;
+  char count[24];
+  size_t count_len = 0;
+  bool newline = false;
+
+  if (sink->policy.syslog) {
+    // syslog messages carry no trailing newline, their framing delimits them
+    while (len > 0 && line[len - 1] == '\n') --len;
+    header_len = syslog_header(sink, record, header);
+    // octet counting on streams (RFC 6587)
+    if (sink->type == SOCK_STREAM) count_len = (size_t)snprintf(count, sizeof(count), "%zu ", header_len + len);
+  } else {
+    newline = len == 0 || line[len - 1] != '\n';
+  }
+
+  size_t framed = count_len + header_len + len + (newline ? 1 : 0);
+  size_t needed = sizeof(uint32_t) + framed;
+  if (sink->capacity - sink->tail < needed) {
+    net_send(sink);
+    if (sink->head > 0) {
+      memmove(sink->queue, sink->queue + sink->head, sink->tail - sink->head);
+      sink->tail -= sink->head;
+      sink->head = 0;
+    }
+    if (sink->capacity - sink->tail < needed || framed > UINT32_MAX) {
+      __atomic_store_n(&sink->dropped, sink->dropped + 1, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+
+  uint32_t framed_len = (uint32_t)framed;
+  char* dst = sink->queue + sink->tail;
+  memcpy(dst, &framed_len, sizeof(framed_len));
+  dst += sizeof(framed_len);
+  memcpy(dst, count, count_len);
+  memcpy(dst + count_len, header, header_len);
+  memcpy(dst + count_len + header_len, line, len);
+  if (newline) dst[framed - 1] = '\n';
+  sink->tail += needed;
+
+  if (sink->tail - sink->head >= sink->policy.datagram_size) net_send(sink);
+}
+
+static void net_sink_flush(void* ctx) {
+  net_send((LogNetSink*)ctx);
+}
+
+static const LogSinkOps NET_SINK_OPS = { net_sink_write, net_sink_flush, net_sink_flush };
+
+int logger_add_net_sink(Logger* logger, LogNetSink* sink, LogLevel level, LogFormatter formatter) {
+  assert(logger != NULL && sink != NULL);
+
+  return logger_add_sink(logger, &NET_SINK_OPS, sink, level, formatter);
+}
+
+uint64_t log_net_sink_dropped(const LogNetSink* sink) {
+  assert(sink != NULL);
+
+  return __atomic_load_n(&sink->dropped, __ATOMIC_RELAXED);
+}
+
+void log_net_sink_free(LogNetSink* sink) {
+  assert(sink != NULL);
+
+  net_send(sink);
+  if (sink->fd >= 0) close(sink->fd);
+  free(sink->queue);
+  free(sink);
+}
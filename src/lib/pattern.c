@@ -0,0 +1,481 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// PATTERNS
+//####################
+
+// A pattern compiles to a flat array of ops. Everything that only depends on
+// the level and on coloring (literal text, %L, %^ and %$) is merged into
+// segments rendered ahead of time for each level, colored or not, so that
+// rendering is a loop of memcpys around the few fields that change per
+// record.
+
+#define PATTERN_TIME_CACHE 4 // strftime results cached per thread
+#define PATTERN_TIME_SIZE 64
+#define PATTERN_MAX_WIDTH 32
+
+__thread const char* log_site_file = NULL;
+__thread int log_site_line = 0;
+
+typedef enum PatternOpType {
+  OP_SEGMENT,
+  OP_TIMESTAMP, // %d, the logger's precision
+  OP_TIME, // strftime part of %d{...}
+  OP_FRACTION, // %ms, %us or %ns inside %d{...}
+  OP_THREAD,
+  OP_FILE,
+  OP_LINE,
+  OP_CATEGORY,
+  OP_TAGS,
+  OP_MESSAGE
+} PatternOpType;
+
+typedef struct PatternOp {
+  PatternOpType type;
+  int width; // minimum width, negative to left-justify
+  size_t offset[2][VERBOSE + 1]; // OP_SEGMENT texts by [colored][level] and OP_TIME format, in the pool
+  size_t len[2][VERBOSE + 1];
+  int digits; // OP_FRACTION
+} PatternOp;
+
+struct LogPattern {
+  PatternOp* ops;
+  size_t count;
+  char* pool;
+  uint64_t generation; // unique per compiled pattern, ops may reuse freed memory
+};
+
+static uint64_t pattern_generation = 0;
+
+//------------------------------
+// Compiling
+//------------------------------
+
+typedef struct Text {
+  char* data;
+  size_t len;
+  size_t capacity;
+} Text;
+
+typedef struct Compiler {
+  PatternOp* ops;
+  size_t count;
+  size_t capacity;
+  Text pool;
+  Text segment[2][VERBOSE + 1]; // segment being built
+  bool open; // segment has content
+  bool message;
+  bool failed;
+} Compiler;
+
+static void text_append(Compiler* compiler, Text* text, const char* src, size_t n) {
+  if (text->len + n + 1 > text->capacity) {
+    size_t capacity = text->capacity ? text->capacity : 64;
+    while (capacity < text->len + n + 1) capacity <<= 1;
+    char* grown = (char*)realloc(text->data, capacity);
+    if (!grown) {
+      compiler->failed = true;
+      return;
+    }
+    text->data = grown;
+    text->capacity = capacity;
+  }
+  memcpy(text->data + text->len, src, n);
+  text->len += n;
+  text->data[text->len] = '\0';
+}
+
+static PatternOp* push_op(Compiler* compiler, PatternOpType type, int width) {
+  if (compiler->count == compiler->capacity) {
+    size_t capacity = compiler->capacity ? compiler->capacity * 2 : 8;
+    PatternOp* grown = (PatternOp*)realloc(compiler->ops, capacity * sizeof(PatternOp));
+    if (!grown) {
+      compiler->failed = true;
+      return NULL;
+    }
+    compiler->ops = grown;
+    compiler->capacity = capacity;
+  }
+  PatternOp* op = &compiler->ops[compiler->count++];
+  memset(op, 0, sizeof(PatternOp));
+  op->type = type;
+  op->width = width;
+  return op;
+}
+
+static void close_segment(Compiler* compiler) {
+  if (!compiler->open) return;
+  compiler->open = false;
+
+  PatternOp* op = push_op(compiler, OP_SEGMENT, 0);
+  for (int colored = 0; colored < 2; ++colored) {
+    for (int level = FATAL; level <= VERBOSE; ++level) {
+      Text* text = &compiler->segment[colored][level];
+      if (op) {
+        op->offset[colored][level] = compiler->pool.len;
+        op->len[colored][level] = text->len;
+        text_append(compiler, &compiler->pool, text->data ? text->data : "", text->len);
+      }
+      text->len = 0;
+    }
+  }
+}
+
+// Appends to the segment, the same text for every level and coloring.
+static void segment_literal(Compiler* compiler, const char* src, size_t n) {
+  for (int colored = 0; colored < 2; ++colored) {
+    for (int level = FATAL; level <= VERBOSE; ++level) {
+      text_append(compiler, &compiler->segment[colored][level], src, n);
+    }
+  }
+  compiler->open = true;
+}
+
+static const char SPACES[PATTERN_MAX_WIDTH + 1] = "                                ";
+
+static void segment_padded(Compiler* compiler, Text* text, const char* value, int width) {
+  size_t n = strlen(value);
+  size_t target = (size_t)(width < 0 ? -width : width);
+  size_t pad = target > n ? target - n : 0;
+  if (pad > sizeof(SPACES) - 1) pad = sizeof(SPACES) - 1;
+
+  if (width > 0) text_append(compiler, text, SPACES, pad);
+  text_append(compiler, text, value, n);
+  if (width < 0) text_append(compiler, text, SPACES, pad);
+}
+
+static void segment_level(Compiler* compiler, int width) {
+  for (int colored = 0; colored < 2; ++colored) {
+    for (int level = FATAL; level <= VERBOSE; ++level) {
+      segment_padded(compiler, &compiler->segment[colored][level], logger_level_name((LogLevel)level), width);
+    }
+  }
+  compiler->open = true;
+}
+
+static void segment_color(Compiler* compiler, bool start) {
+  for (int level = FATAL; level <= VERBOSE; ++level) {
+    const char* code = start ? logger_level_color((LogLevel)level) : RESET;
+    text_append(compiler, &compiler->segment[1][level], code, strlen(code));
+  }
+  compiler->open = true;
+}
+
+// "%d{...}": strftime runs split around %ms, %us and %ns.
+static const char* compile_time(Compiler* compiler, const char* p) {
+  const char* end = strchr(p, '}');
+  if (!end) {
+    compiler->failed = true;
+    return p;
+  }
+
+  const char* run = p;
+  while (p < end) {
+    int digits = 0;
+    if (p[0] == '%' && p + 2 < end && p[2] == 's') {
+      if (p[1] == 'm') digits = 3;
+      else if (p[1] == 'u') digits = 6;
+      else if (p[1] == 'n') digits = 9;
+    }
+    if (!digits) {
+      p += p[0] == '%' && p + 1 < end ? 2 : 1;
+      continue;
+    }
+    if (p > run) {
+      PatternOp* op = push_op(compiler, OP_TIME, 0);
+      if (op) {
+        op->offset[0][0] = compiler->pool.len;
+        op->len[0][0] = (size_t)(p - run);
+        text_append(compiler, &compiler->pool, run, (size_t)(p - run));
+        text_append(compiler, &compiler->pool, "", 1); // strftime wants it terminated
+      }
+    }
+    PatternOp* op = push_op(compiler, OP_FRACTION, 0);
+    if (op) op->digits = digits;
+    p += 3;
+    run = p;
+  }
+  if (end > run) {
+    PatternOp* op = push_op(compiler, OP_TIME, 0);
+    if (op) {
+      op->offset[0][0] = compiler->pool.len;
+      op->len[0][0] = (size_t)(end - run);
+      text_append(compiler, &compiler->pool, run, (size_t)(end - run));
+      text_append(compiler, &compiler->pool, "", 1);
+    }
+  }
+  return end + 1;
+}
+
+static void compile_field(Compiler* compiler, PatternOpType type, int width) {
+  close_segment(compiler);
+  push_op(compiler, type, width);
+}
+
+LogPattern* log_pattern_compile(const char* source) {
+  assert(source != NULL);
+
+  Compiler compiler;
+  memset(&compiler, 0, sizeof(compiler));
+
+  const char* p = source;
+  while (*p && !compiler.failed) {
+    const char* literal = p;
+    while (*p && *p != '%') ++p;
+    if (p > literal) segment_literal(&compiler, literal, (size_t)(p - literal));
+    if (!*p) break;
+
+    // '%' [-] [width] conversion
+    ++p;
+    bool left = *p == '-';
+    if (left) ++p;
+    int width = 0;
+    while (*p >= '0' && *p <= '9') {
+      if (width < PATTERN_MAX_WIDTH) width = width * 10 + (*p - '0');
+      ++p;
+    }
+    if (left) width = -width;
+
+    switch (*p++) {
+      case '%': segment_literal(&compiler, "%", 1); break;
+      case 'n': segment_literal(&compiler, "\n", 1); break;
+      case 'L': segment_level(&compiler, width); break;
+      case '^': segment_color(&compiler, true); break;
+      case '$': segment_color(&compiler, false); break;
+      case 'd':
+        close_segment(&compiler);
+        if (*p == '{') p = compile_time(&compiler, p + 1);
+        else push_op(&compiler, OP_TIMESTAMP, width);
+        break;
+      case 't': compile_field(&compiler, OP_THREAD, width); break;
+      case 'F': compile_field(&compiler, OP_FILE, width); break;
+      case 'l': compile_field(&compiler, OP_LINE, width); break;
+      case 'c': compile_field(&compiler, OP_CATEGORY, width); break;
+      case 'X': compile_field(&compiler, OP_TAGS, width); break;
+      case 'm':
+        // the arguments can only be consumed once
+        if (compiler.message) compiler.failed = true;
+        compiler.message = true;
+        compile_field(&compiler, OP_MESSAGE, 0);
+        break;
+      default:
+        compiler.failed = true;
+        --p;
+    }
+  }
+  close_segment(&compiler);
+
+  for (int colored = 0; colored < 2; ++colored) {
+    for (int level = FATAL; level <= VERBOSE; ++level) {
+      free(compiler.segment[colored][level].data);
+    }
+  }
+
+  LogPattern* pattern = compiler.failed ? NULL : (LogPattern*)malloc(sizeof(LogPattern));
+  if (!pattern) {
+    fprintf(stderr, "Failed to compile log pattern: \"%s\"\n", source);
+    free(compiler.ops);
+    free(compiler.pool.data);
+    return NULL;
+  }
+  pattern->ops = compiler.ops;
+  pattern->count = compiler.count;
+  pattern->pool = compiler.pool.data;
+  pattern->generation = __atomic_add_fetch(&pattern_generation, 1, __ATOMIC_RELAXED);
+  return pattern;
+}
+
+void log_pattern_free(LogPattern* pattern) {
+  if (!pattern) return;
+
+  free(pattern->ops);
+  free(pattern->pool);
+  free(pattern);
+}
+
+static LogPattern* default_pattern = NULL;
+static pthread_once_t default_pattern_once = PTHREAD_ONCE_INIT;
+
+static void default_pattern_init(void) {
+  default_pattern = log_pattern_compile(LOG_PATTERN_DEFAULT);
+}
+
+const LogPattern* log_pattern_default(void) {
+  pthread_once(&default_pattern_once, default_pattern_init);
+  return default_pattern;
+}
+
+//------------------------------
+// Rendering
+//------------------------------
+
+typedef struct Writer {
+  char* buff;
+  size_t size;
+  size_t len; // keeps counting past size
+} Writer;
+
+static inline void put(Writer* writer, const char* src, size_t n) {
+  if (writer->len + n <= writer->size) memcpy(writer->buff + writer->len, src, n);
+  writer->len += n;
+}
+
+static void put_padded(Writer* writer, const char* src, size_t n, int width) {
+  size_t target = (size_t)(width < 0 ? -width : width);
+  size_t pad = target > n ? target - n : 0;
+  if (pad > sizeof(SPACES) - 1) pad = sizeof(SPACES) - 1;
+
+  if (width > 0) put(writer, SPACES, pad);
+  put(writer, src, n);
+  if (width < 0) put(writer, SPACES, pad);
+}
+
+static size_t format_uint(char* digits, unsigned long long value) {
+  char reversed[20];
+  size_t n = 0;
+  do {
+    reversed[n++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value);
+  for (size_t i = 0; i < n; ++i) digits[i] = reversed[n - 1 - i];
+  return n;
+}
+
+static __thread pid_t thread_id = 0;
+static pthread_once_t thread_id_once = PTHREAD_ONCE_INIT;
+
+static void thread_id_reset(void) {
+  thread_id = 0; // the child's only thread is not the one that was cached
+}
+
+static void thread_id_init(void) {
+  pthread_atfork(NULL, NULL, thread_id_reset);
+}
+
+static pid_t current_thread_id(void) {
+  if (!thread_id) {
+    pthread_once(&thread_id_once, thread_id_init);
+    thread_id = (pid_t)syscall(SYS_gettid);
+  }
+  return thread_id;
+}
+
+typedef struct TimeCache {
+  const PatternOp* op;
+  uint64_t generation;
+  time_t sec;
+  size_t len;
+  char text[PATTERN_TIME_SIZE];
+} TimeCache;
+
+static __thread TimeCache time_cache[PATTERN_TIME_CACHE];
+
+static void put_time(Writer* writer, const LogPattern* pattern, const PatternOp* op, const struct timespec* time) {
+  TimeCache* cache = &time_cache[((uintptr_t)op / sizeof(PatternOp)) % PATTERN_TIME_CACHE];
+  if (cache->op != op || cache->generation != pattern->generation || cache->sec != time->tv_sec) {
+    struct tm tm;
+    localtime_r(&time->tv_sec, &tm);
+    cache->len = strftime(cache->text, sizeof(cache->text), pattern->pool + op->offset[0][0], &tm);
+    cache->op = op;
+    cache->generation = pattern->generation;
+    cache->sec = time->tv_sec;
+  }
+  put(writer, cache->text, cache->len);
+}
+
+static void put_fraction(Writer* writer, long nsec, int digits) {
+  char buff[9];
+  unsigned long value = (unsigned long)nsec;
+  for (int i = 9; i > digits; --i) value /= 10;
+  for (int i = digits - 1; i >= 0; --i) {
+    buff[i] = (char)('0' + value % 10);
+    value /= 10;
+  }
+  put(writer, buff, (size_t)digits);
+}
+
+static void put_message(Writer* writer, const LogRecord* record, const char* format, va_list* args) {
+  if (!format) {
+    put(writer, record->message, record->message_len);
+    return;
+  }
+  size_t room = writer->len < writer->size ? writer->size - writer->len : 0;
+  int n = format_vsnprintf(room ? writer->buff + writer->len : NULL, room, format, *args);
+  if (n > 0) writer->len += (size_t)n;
+}
+
+int pattern_render(const LogPattern* pattern, const LogRecord* record, bool colored, const char* format, va_list* args, char* buff, size_t size) {
+  assert(pattern != NULL && record != NULL && buff != NULL);
+
+  Writer writer = { buff, size, 0 };
+  char digits[24];
+
+  for (size_t i = 0; i < pattern->count; ++i) {
+    const PatternOp* op = &pattern->ops[i];
+    switch (op->type) {
+      case OP_SEGMENT:
+        put(&writer, pattern->pool + op->offset[colored][record->level], op->len[colored][record->level]);
+        break;
+      case OP_TIMESTAMP: {
+        char stamp[BUFF_SIZE_TIMESTAMP];
+        size_t n = timestamp_format(stamp, &record->time, record->precision);
+        put_padded(&writer, stamp, n, op->width);
+        break;
+      }
+      case OP_TIME:
+        put_time(&writer, pattern, op, &record->time);
+        break;
+      case OP_FRACTION:
+        put_fraction(&writer, record->time.tv_nsec, op->digits);
+        break;
+      case OP_THREAD:
+        put_padded(&writer, digits, format_uint(digits, (unsigned long long)current_thread_id()), op->width);
+        break;
+      case OP_FILE: {
+        const char* file = log_site_file ? log_site_file : "";
+        put_padded(&writer, file, strlen(file), op->width);
+        break;
+      }
+      case OP_LINE:
+        if (log_site_file) put_padded(&writer, digits, format_uint(digits, (unsigned long long)log_site_line), op->width);
+        else put_padded(&writer, "", 0, op->width);
+        break;
+      case OP_CATEGORY:
+        put_padded(&writer, record->category ? record->category : "", record->category ? strlen(record->category) : 0, op->width);
+        break;
+      case OP_TAGS: {
+        char tags[BUFF_SIZE_TAGS];
+        logger_record_tags(tags, sizeof(tags), record->category, record->sample);
+        put_padded(&writer, tags, strlen(tags), op->width);
+        break;
+      }
+      case OP_MESSAGE:
+        put_message(&writer, record, format, args);
+        break;
+    }
+  }
+
+  if (writer.len < size) buff[writer.len] = '\0';
+  else if (size > 0) buff[size - 1] = '\0';
+  return writer.len > (size_t)INT32_MAX ? -1 : (int)writer.len;
+}
+
+int logger_set_pattern(Logger* logger, const char* pattern) {
+  assert(logger != NULL && pattern != NULL);
+
+  LogPattern* compiled = log_pattern_compile(pattern);
+  if (!compiled) return -1;
+
+  log_pattern_free(logger->pattern);
+  logger->pattern = compiled;
+  return 0;
+}
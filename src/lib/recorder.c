@@ -0,0 +1,341 @@
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// FLIGHT RECORDER
+//####################
+
+// Writers claim a slot with one fetch_add on head and overwrite the oldest
+// record. A slot's seq is cleared while it is being written and set to its
+// index + 1 once complete, so that readers skip the slots they raced with
+// instead of waiting on them: the dump may run in a signal handler that
+// interrupted a writer.
+
+#define DUMP_LINE_SIZE (RECORDER_SLOT_SIZE + 64)
+
+typedef struct RecorderSlot {
+  uint64_t seq;
+  struct timespec time;
+  LogLevel level;
+  size_t len;
+  char text[RECORDER_SLOT_SIZE];
+} RecorderSlot;
+
+struct FlightRecorder {
+  uint64_t head;
+  size_t mask;
+  long utc_offset; // seconds east of UTC, refreshed by every dump outside signal handlers
+  RecorderSlot* slots;
+};
+
+static size_t next_pow2(size_t n) {
+  size_t p = 2;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+static long local_utc_offset(void) {
+  time_t now = time(NULL);
+  struct tm tm;
+  localtime_r(&now, &tm);
+  return tm.tm_gmtoff;
+}
+
+int logger_set_flight_recorder(Logger* logger, size_t records, LogLevel level) {
+  assert(logger != NULL && level <= VERBOSE);
+
+  if (logger->recorder) {
+    fprintf(stderr, "Failed to set flight recorder: already set\n");
+    return -1;
+  }
+
+  FlightRecorder* recorder = (FlightRecorder*)malloc(sizeof(FlightRecorder));
+  if (!recorder) return -1;
+  size_t capacity = next_pow2(records ? records : RECORDER_DEFAULT_RECORDS);
+  recorder->slots = (RecorderSlot*)calloc(capacity, sizeof(RecorderSlot));
+  if (!recorder->slots) {
+    fprintf(stderr, "Failed to allocate flight recorder: %s\n", strerror(errno));
+    free(recorder);
+    return -1;
+  }
+  recorder->head = 0;
+  recorder->mask = capacity - 1;
+  recorder->utc_offset = local_utc_offset();
+
+  logger->recorder = recorder;
+  logger->record_level = level;
+  return 0;
+}
+
+void recorder_write(FlightRecorder* recorder, LogLevel level, const char* message, va_list args) {
+  assert(recorder != NULL && message != NULL);
+
+  uint64_t index = __atomic_fetch_add(&recorder->head, 1, __ATOMIC_RELAXED);
+  RecorderSlot* slot = &recorder->slots[index & recorder->mask];
+
+  // formatted in full then cut: glibc's vsnprintf is an order of magnitude
+  // slower on output it has to truncate
+  size_t len = 0;
+  const char* text = logger_format_message(message, args, &len);
+  if (!text) {
+    text = "";
+    len = 0;
+  }
+  if (len >= RECORDER_SLOT_SIZE) len = RECORDER_SLOT_SIZE - 1;
+
+  __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  clock_gettime(CLOCK_REALTIME, &slot->time);
+  slot->level = level;
+  memcpy(slot->text, text, len);
+  slot->len = len;
+  __atomic_store_n(&slot->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+//------------------------------
+// Dump
+//------------------------------
+
+// Everything below runs in signal handlers: no stdio, no locale, no malloc.
+
+typedef struct DumpLine {
+  char buff[DUMP_LINE_SIZE];
+  size_t len;
+} DumpLine;
+
+static void put(DumpLine* line, const char* src, size_t n) {
+  if (n > sizeof(line->buff) - line->len) n = sizeof(line->buff) - line->len;
+  memcpy(line->buff + line->len, src, n);
+  line->len += n;
+}
+
+static void put_str(DumpLine* line, const char* s) {
+  put(line, s, strlen(s));
+}
+
+static void put_digits(DumpLine* line, unsigned long value, int width) {
+  char digits[20];
+  for (int i = width - 1; i >= 0; --i) {
+    digits[i] = (char)('0' + value % 10);
+    value /= 10;
+  }
+  put(line, digits, (size_t)width);
+}
+
+// "%Y-%m-%d %H:%M:%S.uuuuuu" without localtime_r, civil date from days since
+// the epoch (H. Hinnant's algorithm).
+static void put_stamp(DumpLine* line, const struct timespec* time, long utc_offset) {
+  long long seconds = (long long)time->tv_sec + utc_offset;
+  long long days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+  long long in_day = seconds - days * 86400;
+
+  long long z = days + 719468;
+  long long era = (z >= 0 ? z : z - 146096) / 146097;
+  long long day_of_era = z - era * 146097;
+  long long year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+  long long day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  long long mp = (5 * day_of_year + 2) / 153;
+  long long day = day_of_year - (153 * mp + 2) / 5 + 1;
+  long long month = mp < 10 ? mp + 3 : mp - 9;
+  long long year = year_of_era + era * 400 + (month <= 2);
+
+  put_digits(line, (unsigned long)year, 4);
+  put(line, "-", 1);
+  put_digits(line, (unsigned long)month, 2);
+  put(line, "-", 1);
+  put_digits(line, (unsigned long)day, 2);
+  put(line, " ", 1);
+  put_digits(line, (unsigned long)(in_day / 3600), 2);
+  put(line, ":", 1);
+  put_digits(line, (unsigned long)(in_day / 60 % 60), 2);
+  put(line, ":", 1);
+  put_digits(line, (unsigned long)(in_day % 60), 2);
+  put(line, ".", 1);
+  put_digits(line, (unsigned long)time->tv_nsec / 1000UL, 6);
+}
+
+static void write_all(int fd, const char* buff, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(fd, buff, len);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return;
+    buff += written;
+    len -= (size_t)written;
+  }
+}
+
+static void recorder_dump(FlightRecorder* recorder, int fd) {
+  static const char BEGIN[] = "---- flight recorder ----\n";
+  static const char END[] = "---- end of flight recorder ----\n";
+
+  int saved = errno;
+  long utc_offset = __atomic_load_n(&recorder->utc_offset, __ATOMIC_RELAXED);
+  uint64_t head = __atomic_load_n(&recorder->head, __ATOMIC_ACQUIRE);
+  uint64_t capacity = recorder->mask + 1;
+  uint64_t first = head > capacity ? head - capacity : 0;
+
+  write_all(fd, BEGIN, sizeof(BEGIN) - 1);
+  for (uint64_t index = first; index < head; ++index) {
+    RecorderSlot* slot = &recorder->slots[index & recorder->mask];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != index + 1) continue;
+
+    RecorderSlot copy;
+    memcpy(&copy, slot, sizeof(RecorderSlot));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != index + 1) continue; // overwritten meanwhile
+
+    DumpLine line = { .len = 0 };
+    put_str(&line, logger_level_tag(copy.level));
+    put(&line, "(", 1);
+    put_stamp(&line, &copy.time, utc_offset);
+    put(&line, ") -- ", 5);
+    put(&line, copy.text, copy.len);
+    if (copy.len == 0 || copy.text[copy.len - 1] != '\n') {
+      if (line.len == sizeof(line.buff)) --line.len;
+      put(&line, "\n", 1);
+    }
+    write_all(fd, line.buff, line.len);
+  }
+  write_all(fd, END, sizeof(END) - 1);
+  errno = saved;
+}
+
+void logger_dump_flight_recorder(const Logger* logger) {
+  assert(logger != NULL);
+
+  FlightRecorder* recorder = logger->recorder;
+  if (!recorder) return;
+  __atomic_store_n(&recorder->utc_offset, local_utc_offset(), __ATOMIC_RELAXED);
+
+  // under the lock, after what was already buffered for err
+  pthread_mutex_lock((pthread_mutex_t*)&logger->lock);
+  if (logger->err) fflush(logger->err);
+  recorder_dump(recorder, logger_err_fd(logger));
+  pthread_mutex_unlock((pthread_mutex_t*)&logger->lock);
+}
+
+//------------------------------
+// Crash signals
+//------------------------------
+
+static const int CRASH_SIGNALS[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+#define CRASH_SIGNAL_COUNT (sizeof(CRASH_SIGNALS) / sizeof(CRASH_SIGNALS[0]))
+#define CRASH_STACK_SIZE (64 * 1024)
+
+typedef struct CrashHandler {
+  Logger* logger;
+  int fd;
+  bool dumped;
+  struct sigaction previous[CRASH_SIGNAL_COUNT];
+  void* stack; // alternate stack of the installing thread, NULL if it had one
+} CrashHandler;
+
+static CrashHandler* crash_handler = NULL;
+
+static void restore_signals(CrashHandler* handler) {
+  for (size_t i = 0; i < CRASH_SIGNAL_COUNT; ++i) {
+    sigaction(CRASH_SIGNALS[i], &handler->previous[i], NULL);
+  }
+}
+
+// Only the installing thread can take its alternate stack down; freed from
+// another thread, the stack stays registered there and is left allocated.
+static void release_stack(CrashHandler* handler) {
+  stack_t current;
+  if (!handler->stack || sigaltstack(NULL, &current) != 0 || current.ss_sp != handler->stack) return;
+  stack_t disabled = { .ss_sp = NULL, .ss_flags = SS_DISABLE, .ss_size = 0 };
+  if (sigaltstack(&disabled, NULL) == 0) free(handler->stack);
+}
+
+static void on_crash(int signal) {
+  CrashHandler* handler = __atomic_load_n(&crash_handler, __ATOMIC_ACQUIRE);
+  if (!handler) return;
+
+  // once, even if the dump itself faults or several threads crash
+  if (!__atomic_exchange_n(&handler->dumped, true, __ATOMIC_ACQ_REL)) {
+    recorder_dump(handler->logger->recorder, handler->fd);
+  }
+
+  // the signal stays blocked until we return, then runs under the previous
+  // disposition; a fault that is not raised again simply recurs
+  for (size_t i = 0; i < CRASH_SIGNAL_COUNT; ++i) {
+    if (CRASH_SIGNALS[i] == signal) sigaction(signal, &handler->previous[i], NULL);
+  }
+  raise(signal);
+}
+
+int logger_dump_on_crash(Logger* logger) {
+  assert(logger != NULL);
+
+  if (!logger->recorder) {
+    fprintf(stderr, "Failed to install crash handlers: no flight recorder\n");
+    return -1;
+  }
+  if (__atomic_load_n(&crash_handler, __ATOMIC_ACQUIRE)) {
+    fprintf(stderr, "Failed to install crash handlers: already owned by a logger\n");
+    return -1;
+  }
+
+  CrashHandler* handler = (CrashHandler*)calloc(1, sizeof(CrashHandler));
+  if (!handler) return -1;
+  handler->logger = logger;
+  handler->fd = logger_err_fd(logger);
+
+  // a stack overflow leaves no room to run the handler on the faulting stack
+  stack_t current;
+  if (sigaltstack(NULL, &current) == 0 && (current.ss_flags & SS_DISABLE)) {
+    stack_t stack = { .ss_sp = malloc(CRASH_STACK_SIZE), .ss_flags = 0, .ss_size = CRASH_STACK_SIZE };
+    if (stack.ss_sp && sigaltstack(&stack, NULL) == 0) {
+      handler->stack = stack.ss_sp;
+    } else {
+      fprintf(stderr, "Failed to install crash signal stack: %s\n", stack.ss_sp ? strerror(errno) : "out of memory");
+      free(stack.ss_sp);
+    }
+  }
+  __atomic_store_n(&crash_handler, handler, __ATOMIC_RELEASE);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_crash;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_ONSTACK;
+  for (size_t i = 0; i < CRASH_SIGNAL_COUNT; ++i) {
+    if (sigaction(CRASH_SIGNALS[i], &action, &handler->previous[i]) != 0) {
+      fprintf(stderr, "Failed to install crash handler: %s\n", strerror(errno));
+      for (size_t j = 0; j < i; ++j) {
+        sigaction(CRASH_SIGNALS[j], &handler->previous[j], NULL);
+      }
+      __atomic_store_n(&crash_handler, NULL, __ATOMIC_RELEASE);
+      release_stack(handler);
+      free(handler);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void recorder_free(Logger* logger) {
+  assert(logger != NULL);
+
+  CrashHandler* handler = __atomic_load_n(&crash_handler, __ATOMIC_ACQUIRE);
+  if (handler && handler->logger == logger) {
+    restore_signals(handler);
+    __atomic_store_n(&crash_handler, NULL, __ATOMIC_RELEASE);
+    release_stack(handler);
+    free(handler);
+  }
+
+  free(logger->recorder->slots);
+  free(logger->recorder);
+  logger->recorder = NULL;
+  logger->record_level = FATAL;
+}
@@ -0,0 +1,209 @@
+#include <assert.h>
+#include <errno.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// ROTATION
+//####################
+
+// The write path only swaps FILE pointers under the logger lock. Everything
+// slow (fclose, renames, gzip, opening the next file) happens on the worker
+// thread. The worker signals readiness through next; the write path hands the
+// old stream back through retired and does not rotate again until the worker
+// is done with it. The write path only ever trylocks the rotator lock.
+
+#define ROTATED_NAME_MAX 4096
+
+extern char** environ;
+
+struct Rotator {
+  char* path;
+  char* next_path; // where the next file is prepared
+  RotationPolicy policy;
+  size_t bytes;     // written to the current file, under the logger lock
+  time_t rotate_at; // under the logger lock
+  FILE* next;
+  FILE* retired;
+  bool stop;
+  pthread_t worker;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static void rotated_name(char* buff, const char* path, unsigned index, bool gz) {
+  snprintf(buff, ROTATED_NAME_MAX, "%s.%u%s", path, index, gz ? ".gz" : "");
+}
+
+// Moves path.from[.gz] to path.to[.gz], or deletes it when to is 0.
+static void shift(const char* path, unsigned from, unsigned to) {
+  char src[ROTATED_NAME_MAX];
+  char dst[ROTATED_NAME_MAX];
+  for (int gz = 0; gz <= 1; ++gz) {
+    rotated_name(src, path, from, gz);
+    if (access(src, F_OK) != 0) continue;
+    if (to == 0) {
+      unlink(src);
+    } else {
+      rotated_name(dst, path, to, gz);
+      rename(src, dst);
+    }
+  }
+}
+
+static void compress(const char* file) {
+  pid_t pid;
+  char* argv[] = { "gzip", "-f", (char*)file, NULL };
+  if (posix_spawnp(&pid, "gzip", NULL, NULL, argv, environ) != 0) {
+    fprintf(stderr, "Failed to compress rotated log %s\n", file);
+    return;
+  }
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+}
+
+static void retire(Rotator* rotator, FILE* old) {
+  fclose(old);
+
+  unsigned retention = rotator->policy.retention;
+  if (retention == 0) {
+    unlink(rotator->path);
+  } else {
+    shift(rotator->path, retention, 0);
+    for (unsigned i = retention - 1; i >= 1; --i) shift(rotator->path, i, i + 1);
+
+    char first[ROTATED_NAME_MAX];
+    rotated_name(first, rotator->path, 1, false);
+    rename(rotator->path, first);
+    // the stream swapped in is still named next_path, path must not be
+    // missing for the whole compression
+    rename(rotator->next_path, rotator->path);
+    if (rotator->policy.compress) compress(first);
+    return;
+  }
+  rename(rotator->next_path, rotator->path);
+}
+
+static void* worker_main(void* arg) {
+  Rotator* rotator = (Rotator*)arg;
+
+  pthread_mutex_lock(&rotator->lock);
+  while (true) {
+    if (rotator->retired) {
+      FILE* old = rotator->retired;
+      pthread_mutex_unlock(&rotator->lock);
+      retire(rotator, old);
+      pthread_mutex_lock(&rotator->lock);
+      rotator->retired = NULL;
+      continue;
+    }
+    if (rotator->stop) break;
+    if (!rotator->next) {
+      pthread_mutex_unlock(&rotator->lock);
+      // appended to: a crash may have left records in it
+      FILE* next = fopen(rotator->next_path, "a");
+      if (!next) fprintf(stderr, "Failed to open %s: %s\n", rotator->next_path, strerror(errno));
+      pthread_mutex_lock(&rotator->lock);
+      rotator->next = next;
+      if (next) continue;
+    }
+    pthread_cond_wait(&rotator->cond, &rotator->lock);
+  }
+  pthread_mutex_unlock(&rotator->lock);
+  return NULL;
+}
+
+Rotator* rotator_new(const char* path, RotationPolicy policy, FILE** stream) {
+  assert(path != NULL && stream != NULL);
+
+  Rotator* rotator = (Rotator*)calloc(1, sizeof(Rotator));
+  if (!rotator) return NULL;
+
+  size_t len = strlen(path);
+  rotator->path = strdup(path);
+  rotator->next_path = (char*)malloc(len + sizeof(".next"));
+  if (rotator->next_path) {
+    snprintf(rotator->next_path, len + sizeof(".next"), "%s.next", path);
+    // a crash between moving the old file away and promoting the next one
+    // left the current file under next_path
+    if (access(path, F_OK) != 0 && access(rotator->next_path, F_OK) == 0) rename(rotator->next_path, path);
+  }
+  *stream = rotator->next_path ? fopen(path, "a") : NULL;
+  if (!rotator->path || !rotator->next_path || !*stream) {
+    if (*stream) fclose(*stream);
+    free(rotator->next_path);
+    free(rotator->path);
+    free(rotator);
+    return NULL;
+  }
+  rotator->policy = policy;
+  rotator->bytes = (size_t)ftell(*stream);
+  rotator->rotate_at = policy.interval_sec ? time(NULL) + (time_t)policy.interval_sec : 0;
+  pthread_mutex_init(&rotator->lock, NULL);
+  pthread_cond_init(&rotator->cond, NULL);
+
+  if (pthread_create(&rotator->worker, NULL, worker_main, rotator) != 0) {
+    pthread_cond_destroy(&rotator->cond);
+    pthread_mutex_destroy(&rotator->lock);
+    fclose(*stream);
+    free(rotator->next_path);
+    free(rotator->path);
+    free(rotator);
+    return NULL;
+  }
+  return rotator;
+}
+
+void rotator_free(Rotator* rotator, FILE* current) {
+  assert(rotator != NULL);
+
+  pthread_mutex_lock(&rotator->lock);
+  rotator->stop = true;
+  pthread_cond_signal(&rotator->cond);
+  pthread_mutex_unlock(&rotator->lock);
+  pthread_join(rotator->worker, NULL);
+
+  if (current) fclose(current);
+  if (rotator->next) {
+    // records a crash left in it are promoted at the next rotation
+    bool empty = fseek(rotator->next, 0, SEEK_END) == 0 && ftell(rotator->next) == 0;
+    fclose(rotator->next);
+    if (empty) unlink(rotator->next_path);
+  }
+  pthread_cond_destroy(&rotator->cond);
+  pthread_mutex_destroy(&rotator->lock);
+  free(rotator->next_path);
+  free(rotator->path);
+  free(rotator);
+}
+
+void rotator_before_write(Logger* logger, size_t len) {
+  assert(logger != NULL && logger->rotator != NULL);
+
+  Rotator* rotator = logger->rotator;
+  RotationPolicy* policy = &rotator->policy;
+  time_t now = policy->interval_sec ? time(NULL) : 0;
+
+  bool due = (policy->max_bytes && rotator->bytes > 0 && rotator->bytes + len > policy->max_bytes)
+    || (policy->interval_sec && now >= rotator->rotate_at);
+  if (due && pthread_mutex_trylock(&rotator->lock) == 0) {
+    if (rotator->next && !rotator->retired) {
+      flush_streams(logger);
+      rotator->retired = logger->out;
+      logger->out = rotator->next;
+      logger->err = rotator->next;
+      rotator->next = NULL;
+      rotator->bytes = 0;
+      if (policy->interval_sec) rotator->rotate_at = now + (time_t)policy->interval_sec;
+      pthread_cond_signal(&rotator->cond);
+    }
+    pthread_mutex_unlock(&rotator->lock);
+  }
+  rotator->bytes += len;
+}
@@ -0,0 +1,79 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "./logger_internal.h"
+
+//####################
+// SAMPLING
+//####################
+
+#ifdef CLOCK_MONOTONIC_COARSE
+#define INTERVAL_CLOCK CLOCK_MONOTONIC_COARSE
+#else
+#define INTERVAL_CLOCK CLOCK_MONOTONIC
+#endif
+
+__thread uint64_t logger_record_sample = 1;
+
+// xorshift64*, seeded per thread from the clock and the state's own address
+static __thread uint64_t prng_state = 0;
+
+static uint64_t prng_next(void) {
+  uint64_t x = prng_state;
+  if (x == 0) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    x = ((uint64_t)now.tv_nsec << 32) ^ (uint64_t)now.tv_sec ^ (uint64_t)(uintptr_t)&prng_state;
+    if (x == 0) x = 0x9E3779B97F4A7C15ULL;
+  }
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  prng_state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+bool sample_hit(unsigned rate) {
+  // maps the top 32 bits onto [0, rate) without a division
+  uint64_t draw = prng_next() >> 32;
+  return ((draw * rate) >> 32) == 0;
+}
+
+void logger_set_sampling(Logger* logger, LogLevel level, unsigned one_in) {
+  assert(logger != NULL && level <= VERBOSE);
+
+  logger->sample_rate[level] = one_in;
+}
+
+uint64_t log_interval_due(LogInterval* interval) {
+  assert(interval != NULL);
+
+  struct timespec ts;
+  clock_gettime(INTERVAL_CLOCK, &ts);
+  uint64_t now = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+
+  uint64_t last = __atomic_load_n(&interval->last_ns, __ATOMIC_RELAXED);
+  if (last != 0 && now - last < interval->interval_ns) {
+    __atomic_fetch_add(&interval->skipped, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  if (!__atomic_compare_exchange_n(&interval->last_ns, &last, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    // another thread took this interval
+    __atomic_fetch_add(&interval->skipped, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  return __atomic_exchange_n(&interval->skipped, 0, __ATOMIC_RELAXED) + 1;
+}
+
+void log_sampled(const Logger* logger, LogLevel level, uint64_t factor, const char* message, ...) {
+  assert(logger != NULL && message != NULL);
+
+  if (!logger_admit(logger, logger_get_level(logger), level, factor)) return;
+
+  va_list args;
+  va_start(args, message);
+  logger_log(logger, level, message, args);
+  va_end(args);
+}
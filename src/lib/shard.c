@@ -0,0 +1,351 @@
+#include <assert.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "./logger_internal.h"
+
+//####################
+// SHARDS
+//####################
+
+// Every logging thread owns a single-producer / single-consumer ring (a
+// shard), so producers never share a cache line or a lock. Shards are
+// allocated and zeroed by their first owner, which places them on its NUMA
+// node under the default first-touch policy. The merger thread repeatedly
+// k-way merges the heads of all shards with a binary heap, writing the records
+// whose timestamp is older than the reorder window. When a producer finds its
+// shard full the merger stops waiting on the window and merges up to the
+// low watermark instead: the oldest of the newest records of the non-empty
+// shards, which is as far as what was published can be ordered.
+
+#define CACHE_LINE 64
+#define MERGER_MIN_SLEEP_NS 50000L
+#define MERGER_MAX_SLEEP_NS 10000000L
+
+typedef struct ShardSlot {
+  uint64_t key; // record timestamp in ns, the merge order
+  LogLevel level;
+  size_t len;
+  char* heap; // set when the record did not fit in data
+  char data[ASYNC_SLOT_SIZE];
+} __attribute__((aligned(CACHE_LINE))) ShardSlot;
+
+typedef struct Shard {
+  size_t head __attribute__((aligned(CACHE_LINE))); // written by the owner
+  size_t cached_tail;
+  size_t tail __attribute__((aligned(CACHE_LINE))); // written by the merger
+  int owned __attribute__((aligned(CACHE_LINE))); // 1 while a live thread logs through it
+  size_t mask;
+  ShardSlot* slots;
+  struct Shard* next;
+} Shard;
+
+typedef struct HeapEntry {
+  uint64_t key;
+  Shard* shard;
+} HeapEntry;
+
+struct ShardSet {
+  Logger* logger;
+  Shard* shards; // pushed at the front, never unlinked before shard_set_free
+  size_t capacity;
+  uint64_t window_ns;
+  pthread_key_t key;
+  int stop;
+  int pressure; // set by producers waiting on a full shard
+  pthread_t merger;
+  HeapEntry* heap; // merger scratch
+  size_t heap_capacity;
+};
+
+static size_t next_pow2(size_t n) {
+  size_t p = 2;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+static uint64_t to_ns(const struct timespec* ts) {
+  return (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+}
+
+//------------------------------
+// Producers
+//------------------------------
+
+static void shard_release(void* arg) {
+  Shard* shard = (Shard*)arg;
+  // pending records stay, the merger drains them before the shard is reused
+  __atomic_store_n(&shard->owned, 0, __ATOMIC_RELEASE);
+}
+
+static Shard* shard_new(size_t capacity) {
+  Shard* shard = NULL;
+  if (posix_memalign((void**)&shard, CACHE_LINE, sizeof(Shard)) != 0) return NULL;
+  memset(shard, 0, sizeof(Shard));
+
+  if (posix_memalign((void**)&shard->slots, CACHE_LINE, capacity * sizeof(ShardSlot)) != 0) {
+    free(shard);
+    return NULL;
+  }
+  // first touch from the owning thread
+  memset(shard->slots, 0, capacity * sizeof(ShardSlot));
+  shard->mask = capacity - 1;
+  shard->owned = 1;
+  return shard;
+}
+
+// Reuses the drained shard of a thread that exited, or links a new one.
+static Shard* shard_claim(ShardSet* set) {
+  for (Shard* shard = __atomic_load_n(&set->shards, __ATOMIC_ACQUIRE); shard; shard = shard->next) {
+    int free_shard = 0;
+    if (__atomic_load_n(&shard->owned, __ATOMIC_RELAXED) == 0 &&
+        __atomic_load_n(&shard->tail, __ATOMIC_ACQUIRE) == shard->head &&
+        __atomic_compare_exchange_n(&shard->owned, &free_shard, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return shard;
+    }
+  }
+
+  Shard* shard = shard_new(set->capacity);
+  if (!shard) return NULL;
+  shard->next = __atomic_load_n(&set->shards, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&set->shards, &shard->next, shard, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  return shard;
+}
+
+static Shard* thread_shard(ShardSet* set) {
+  Shard* shard = (Shard*)pthread_getspecific(set->key);
+  if (shard) return shard;
+
+  shard = shard_claim(set);
+  if (!shard) {
+    fprintf(stderr, "Failed to allocate log shard\n");
+    return NULL;
+  }
+  pthread_setspecific(set->key, shard);
+  return shard;
+}
+
+static ShardSlot* claim_slot(ShardSet* set, Shard* shard) {
+  if (shard->head - shard->cached_tail > shard->mask) {
+    // full: wait for the merger, which never waits on producers
+    while ((shard->cached_tail = __atomic_load_n(&shard->tail, __ATOMIC_ACQUIRE)) + shard->mask < shard->head) {
+      if (!__atomic_load_n(&set->pressure, __ATOMIC_RELAXED)) __atomic_store_n(&set->pressure, 1, __ATOMIC_RELAXED);
+      sched_yield();
+    }
+  }
+  return &shard->slots[shard->head & shard->mask];
+}
+
+static void publish(Shard* shard, ShardSlot* slot, LogLevel level, const struct timespec* now, int len) {
+  slot->key = to_ns(now);
+  slot->level = level;
+  slot->len = len < 0 ? 0 : (size_t)len;
+  __atomic_store_n(&shard->head, shard->head + 1, __ATOMIC_RELEASE);
+}
+
+void shard_set_push(ShardSet* set, LogLevel level, const char* message, va_list args) {
+  assert(set != NULL && message != NULL);
+
+  Shard* shard = thread_shard(set);
+  if (!shard) return;
+  ShardSlot* slot = claim_slot(set, shard);
+
+  struct timespec now;
+  clock_gettime(set->logger->ts_clock, &now);
+  va_list copy;
+  va_copy(copy, args);
+  int len = logger_render_at(set->logger, level, &now, slot->data, ASYNC_SLOT_SIZE, message, args);
+  if (len >= ASYNC_SLOT_SIZE) {
+    slot->heap = (char*)malloc((size_t)len + 1);
+    if (slot->heap) {
+      logger_render_at(set->logger, level, &now, slot->heap, (size_t)len + 1, message, copy);
+    } else {
+      len = ASYNC_SLOT_SIZE - 1;
+    }
+  }
+  va_end(copy);
+
+  publish(shard, slot, level, &now, len);
+}
+
+void shard_set_push_line(ShardSet* set, LogLevel level, const char* line, size_t len) {
+  assert(set != NULL && line != NULL);
+
+  Shard* shard = thread_shard(set);
+  if (!shard) return;
+  ShardSlot* slot = claim_slot(set, shard);
+
+  if (len < ASYNC_SLOT_SIZE) {
+    memcpy(slot->data, line, len);
+  } else {
+    slot->heap = (char*)malloc(len);
+    if (slot->heap) {
+      memcpy(slot->heap, line, len);
+    } else {
+      len = ASYNC_SLOT_SIZE - 1;
+      memcpy(slot->data, line, len);
+    }
+  }
+
+  struct timespec now;
+  clock_gettime(set->logger->ts_clock, &now);
+  publish(shard, slot, level, &now, (int)len);
+}
+
+//------------------------------
+// Merger
+//------------------------------
+
+static void heap_sift_down(HeapEntry* heap, size_t count, size_t i) {
+  while (true) {
+    size_t smallest = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < count && heap[left].key < heap[smallest].key) smallest = left;
+    if (right < count && heap[right].key < heap[smallest].key) smallest = right;
+    if (smallest == i) return;
+
+    HeapEntry swap = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = swap;
+    i = smallest;
+  }
+}
+
+static bool shard_peek(Shard* shard, uint64_t* key) {
+  if (__atomic_load_n(&shard->head, __ATOMIC_ACQUIRE) == shard->tail) return false;
+  *key = shard->slots[shard->tail & shard->mask].key;
+  return true;
+}
+
+// Fills the heap with the head record of every non-empty shard and returns
+// their count; *watermark is the oldest of their newest records.
+static size_t heap_build(ShardSet* set, uint64_t* watermark) {
+  size_t count = 0;
+  *watermark = UINT64_MAX;
+  for (Shard* shard = __atomic_load_n(&set->shards, __ATOMIC_ACQUIRE); shard; shard = shard->next) {
+    uint64_t key;
+    if (!shard_peek(shard, &key)) continue;
+    uint64_t newest = shard->slots[(__atomic_load_n(&shard->head, __ATOMIC_ACQUIRE) - 1) & shard->mask].key;
+    if (newest < *watermark) *watermark = newest;
+
+    if (count == set->heap_capacity) {
+      size_t capacity = set->heap_capacity ? set->heap_capacity * 2 : 16;
+      HeapEntry* grown = (HeapEntry*)realloc(set->heap, capacity * sizeof(HeapEntry));
+      if (!grown) break;
+      set->heap = grown;
+      set->heap_capacity = capacity;
+    }
+    set->heap[count++] = (HeapEntry){ key, shard };
+  }
+  for (size_t i = count / 2; i-- > 0;) heap_sift_down(set->heap, count, i);
+  return count;
+}
+
+// Writes, in key order, every record older than cutoff. Returns how many were
+// written; *next is the key of the oldest record held back (UINT64_MAX if none).
+static size_t merge(ShardSet* set, uint64_t cutoff, uint64_t* next) {
+  uint64_t watermark;
+  size_t count = heap_build(set, &watermark);
+  size_t written = 0;
+  *next = UINT64_MAX;
+
+  if (__atomic_load_n(&set->pressure, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&set->pressure, 0, __ATOMIC_RELAXED);
+    if (watermark != UINT64_MAX && watermark > cutoff) cutoff = watermark;
+  }
+
+  while (count > 0) {
+    HeapEntry* top = &set->heap[0];
+    if (top->key > cutoff) {
+      *next = top->key;
+      break;
+    }
+
+    Shard* shard = top->shard;
+    ShardSlot* slot = &shard->slots[shard->tail & shard->mask];
+    logger_write(set->logger, slot->level, slot->heap ? slot->heap : slot->data, slot->len);
+    free(slot->heap);
+    slot->heap = NULL;
+    __atomic_store_n(&shard->tail, shard->tail + 1, __ATOMIC_RELEASE);
+    ++written;
+
+    if (shard_peek(shard, &top->key)) {
+      heap_sift_down(set->heap, count, 0);
+    } else {
+      set->heap[0] = set->heap[--count];
+      heap_sift_down(set->heap, count, 0);
+    }
+  }
+  return written;
+}
+
+static void sleep_ns(uint64_t ns) {
+  if (ns < MERGER_MIN_SLEEP_NS) ns = MERGER_MIN_SLEEP_NS;
+  if (ns > MERGER_MAX_SLEEP_NS) ns = MERGER_MAX_SLEEP_NS;
+  struct timespec wait = { .tv_sec = (time_t)(ns / 1000000000ULL), .tv_nsec = (long)(ns % 1000000000ULL) };
+  nanosleep(&wait, NULL);
+}
+
+static void* merger_main(void* arg) {
+  ShardSet* set = (ShardSet*)arg;
+  uint64_t next;
+
+  while (!__atomic_load_n(&set->stop, __ATOMIC_ACQUIRE)) {
+    struct timespec ts;
+    clock_gettime(set->logger->ts_clock, &ts);
+    uint64_t now = to_ns(&ts);
+    uint64_t cutoff = now > set->window_ns ? now - set->window_ns : 0;
+
+    if (merge(set, cutoff, &next) > 0) continue;
+    // nothing old enough: sleep until the oldest record leaves the window
+    sleep_ns(next == UINT64_MAX ? set->window_ns / 2 : next - cutoff);
+  }
+  // producers are gone once stop is set, merge everything left
+  while (merge(set, UINT64_MAX, &next) > 0);
+  return NULL;
+}
+
+ShardSet* shard_set_new(Logger* logger, size_t capacity, unsigned window_us) {
+  assert(logger != NULL);
+
+  ShardSet* set = (ShardSet*)calloc(1, sizeof(ShardSet));
+  if (!set) return NULL;
+
+  set->logger = logger;
+  set->capacity = next_pow2(capacity ? capacity : SHARD_DEFAULT_CAPACITY);
+  set->window_ns = (uint64_t)(window_us ? window_us : SHARD_DEFAULT_WINDOW_US) * 1000ULL;
+  if (pthread_key_create(&set->key, shard_release) != 0) {
+    free(set);
+    return NULL;
+  }
+  if (pthread_create(&set->merger, NULL, merger_main, set) != 0) {
+    pthread_key_delete(set->key);
+    free(set);
+    return NULL;
+  }
+  return set;
+}
+
+void shard_set_free(ShardSet* set) {
+  assert(set != NULL);
+
+  __atomic_store_n(&set->stop, 1, __ATOMIC_RELEASE);
+  pthread_join(set->merger, NULL);
+  // no destructor may touch the shards once they are freed
+  pthread_key_delete(set->key);
+
+  Shard* shard = set->shards;
+  while (shard) {
+    Shard* next = shard->next;
+    free(shard->slots);
+    free(shard);
+    shard = next;
+  }
+  free(set->heap);
+  free(set);
+}
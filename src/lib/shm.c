@@ -0,0 +1,390 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// SHARED MEMORY
+//####################
+
+// A bounded MPSC ring in a shm_open mapping, shared by every process that
+// inherits or opens it. Producers claim a slot with a CAS on head, copy their
+// rendered record in and publish it by moving the slot's seq from pos to
+// pos + 1; the collector releases it by moving seq to pos + capacity. No lock
+// is ever held across processes, so a writer dying leaves at most the slot it
+// had claimed unpublished: the collector skips such a slot once its owner is
+// gone (or, if the owner never got recorded, after SHM_STALL_NS).
+// Between its CAS on head and its first byte of data a writer takes the slot's
+// claim word (the position and its pid) with a CAS; the collector gives a slot
+// up only by taking that word first, so a writer stalled past SHM_STALL_NS
+// finds the slot taken and never writes into a slot handed to the next round.
+
+#define SHM_MAGIC 0x63006c6f67736d31ULL
+#define SHM_VERSION 2
+#define SHM_STALL_NS 1000000000ULL
+#define CACHE_LINE 64
+
+typedef struct ShmHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t slot_size;
+  uint64_t capacity;
+  uint64_t dropped; // records that found the ring full
+  uint64_t lost;    // claimed slots skipped after their writer died
+  uint64_t head __attribute__((aligned(CACHE_LINE))); // next position to claim
+  uint64_t tail __attribute__((aligned(CACHE_LINE))); // next position to collect
+} ShmHeader;
+
+// claim words: the low 32 bits of the position in the high half, the pid of
+// the writer (or CLAIM_RECLAIMED) in the low half
+#define CLAIM_RECLAIMED UINT32_MAX
+#define CLAIM(pos, who) (((pos) << 32) | (uint32_t)(who))
+#define CLAIM_TAG(claim) ((claim) >> 32)
+#define CLAIM_WHO(claim) ((uint32_t)(claim))
+
+typedef struct ShmSlot {
+  uint64_t seq;
+  uint64_t claim; // who holds the slot for which position, stale until taken
+  int32_t level;
+  uint32_t len;
+  char data[SHM_SLOT_SIZE];
+} __attribute__((aligned(CACHE_LINE))) ShmSlot;
+
+struct LogShm {
+  ShmHeader* header;
+  ShmSlot* slots;
+  size_t mask;
+  size_t map_size;
+  pid_t creator; // removes the name on close, 0 for rings opened by name
+  char name[NAME_MAX];
+  // collector side, meaningful in the collecting process only
+  uint64_t stalled_pos;
+  uint64_t stalled_since;
+  pthread_mutex_t drain_lock;
+  Logger* target;
+  unsigned interval_ms;
+  bool collecting;
+  pid_t collector_pid;
+  bool stop;
+  pthread_t collector;
+  pthread_mutex_t wait_lock;
+  pthread_cond_t wait_cond;
+};
+
+static size_t next_pow2(size_t n) {
+  size_t p = 2;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// pid cached per process, refreshed in fork children
+static pid_t shm_pid = 0;
+static pthread_once_t shm_pid_once = PTHREAD_ONCE_INIT;
+
+static void shm_pid_reset(void) {
+  __atomic_store_n(&shm_pid, getpid(), __ATOMIC_RELAXED);
+}
+
+static void shm_pid_init(void) {
+  shm_pid_reset();
+  pthread_atfork(NULL, NULL, shm_pid_reset);
+}
+
+static pid_t current_pid(void) {
+  pthread_once(&shm_pid_once, shm_pid_init);
+  return __atomic_load_n(&shm_pid, __ATOMIC_RELAXED);
+}
+
+static LogShm* shm_alloc(const char* name) {
+  LogShm* shm = (LogShm*)calloc(1, sizeof(LogShm));
+  if (!shm) return NULL;
+  // shm_open names are "/name"
+  snprintf(shm->name, sizeof(shm->name), "%s%s", name[0] == '/' ? "" : "/", name);
+  pthread_mutex_init(&shm->drain_lock, NULL);
+  pthread_mutex_init(&shm->wait_lock, NULL);
+  pthread_cond_init(&shm->wait_cond, NULL);
+  return shm;
+}
+
+static void shm_release(LogShm* shm) {
+  if (shm->header) munmap(shm->header, shm->map_size);
+  pthread_cond_destroy(&shm->wait_cond);
+  pthread_mutex_destroy(&shm->wait_lock);
+  pthread_mutex_destroy(&shm->drain_lock);
+  free(shm);
+}
+
+static int shm_map(LogShm* shm, int fd, size_t size) {
+  void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) return -1;
+  shm->header = (ShmHeader*)base;
+  shm->slots = (ShmSlot*)((char*)base + sizeof(ShmHeader));
+  shm->map_size = size;
+  return 0;
+}
+
+LogShm* log_shm_create(const char* name, size_t capacity) {
+  assert(name != NULL);
+
+  LogShm* shm = shm_alloc(name);
+  if (!shm) return NULL;
+  size_t slots = next_pow2(capacity ? capacity : SHM_DEFAULT_CAPACITY);
+  size_t size = sizeof(ShmHeader) + slots * sizeof(ShmSlot);
+
+  int fd = shm_open(shm->name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0 || ftruncate(fd, (off_t)size) != 0 || shm_map(shm, fd, size) != 0) {
+    fprintf(stderr, "Failed to create shared log ring %s: %s\n", shm->name, strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+      shm_unlink(shm->name);
+    }
+    shm_release(shm);
+    return NULL;
+  }
+  close(fd);
+
+  // the file is zero-filled; slots are free for the first round at their index
+  for (size_t i = 0; i < slots; ++i) {
+    shm->slots[i].seq = i;
+  }
+  shm->header->version = SHM_VERSION;
+  shm->header->slot_size = SHM_SLOT_SIZE;
+  shm->header->capacity = slots;
+  __atomic_store_n(&shm->header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+  shm->mask = slots - 1;
+  shm->creator = getpid();
+  return shm;
+}
+
+LogShm* log_shm_open(const char* name) {
+  assert(name != NULL);
+
+  LogShm* shm = shm_alloc(name);
+  if (!shm) return NULL;
+
+  struct stat st;
+  int fd = shm_open(shm->name, O_RDWR, 0);
+  if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmHeader) || shm_map(shm, fd, (size_t)st.st_size) != 0) {
+    fprintf(stderr, "Failed to open shared log ring %s: %s\n", shm->name, fd < 0 ? strerror(errno) : "not a log ring");
+    if (fd >= 0) close(fd);
+    shm_release(shm);
+    return NULL;
+  }
+  close(fd);
+
+  ShmHeader* header = shm->header;
+  size_t capacity = header->capacity;
+  if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC || header->version != SHM_VERSION
+      || header->slot_size != SHM_SLOT_SIZE || capacity == 0 || (capacity & (capacity - 1)) != 0
+      || sizeof(ShmHeader) + capacity * sizeof(ShmSlot) > shm->map_size) {
+    fprintf(stderr, "Failed to open shared log ring %s: incompatible layout\n", shm->name);
+    shm_release(shm);
+    return NULL;
+  }
+  shm->mask = capacity - 1;
+  return shm;
+}
+
+uint64_t log_shm_dropped(const LogShm* shm) {
+  assert(shm != NULL);
+
+  return __atomic_load_n(&shm->header->dropped, __ATOMIC_RELAXED) + __atomic_load_n(&shm->header->lost, __ATOMIC_RELAXED);
+}
+
+//------------------------------
+// Producers
+//------------------------------
+
+void shm_write_line(const Logger* logger, LogLevel level, const char* line, size_t len) {
+  assert(logger != NULL && line != NULL);
+
+  LogShm* shm = logger->shm;
+  ShmHeader* header = shm->header;
+
+  uint64_t pos = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+  ShmSlot* slot;
+  for (;;) {
+    slot = &shm->slots[pos & shm->mask];
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    int64_t diff = (int64_t)(seq - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&header->head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+    } else if (diff < 0) {
+      // full: the collector is a round behind
+      __atomic_fetch_add(&header->dropped, 1, __ATOMIC_RELAXED);
+      return;
+    } else {
+      pos = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+    }
+  }
+
+  // the collector may have given up on the slot while this writer stalled
+  uint64_t claim = __atomic_load_n(&slot->claim, __ATOMIC_ACQUIRE);
+  do {
+    if (CLAIM_TAG(claim) == (uint32_t)pos && CLAIM_WHO(claim) != 0) return;
+  } while (!__atomic_compare_exchange_n(&slot->claim, &claim, CLAIM(pos, current_pid()), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  bool truncated = len > SHM_SLOT_SIZE;
+  if (truncated) len = SHM_SLOT_SIZE;
+  memcpy(slot->data, line, len);
+  if (truncated) slot->data[len - 1] = '\n';
+  slot->len = (uint32_t)len;
+  slot->level = (int32_t)level;
+
+  // fails only if the collector took the pid for a dead one, then the record
+  // is lost
+  uint64_t expected = pos;
+  __atomic_compare_exchange_n(&slot->seq, &expected, pos + 1, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+void shm_log(const Logger* logger, LogLevel level, const char* message, va_list args) {
+  assert(logger != NULL && message != NULL);
+
+  char stack[SHM_SLOT_SIZE + 1];
+  int len = logger_render(logger, level, stack, sizeof(stack), message, args);
+  if (len < 0) return;
+  shm_write_line(logger, level, stack, (size_t)len);
+}
+
+//------------------------------
+// Collector
+//------------------------------
+
+static bool writer_dead(LogShm* shm, ShmSlot* slot, uint64_t pos) {
+  uint64_t claim = __atomic_load_n(&slot->claim, __ATOMIC_ACQUIRE);
+  if (CLAIM_TAG(claim) == (uint32_t)pos && CLAIM_WHO(claim) != 0) {
+    pid_t owner = (pid_t)CLAIM_WHO(claim);
+    return CLAIM_WHO(claim) == CLAIM_RECLAIMED || (kill(owner, 0) != 0 && errno == ESRCH);
+  }
+
+  // head moved but the slot not taken yet: a writer stopped right there
+  uint64_t now = now_ns();
+  if (shm->stalled_pos != pos || !shm->stalled_since) {
+    shm->stalled_pos = pos;
+    shm->stalled_since = now;
+    return false;
+  }
+  if (now - shm->stalled_since < SHM_STALL_NS) return false;
+  // fails if the writer woke up and took the slot meanwhile
+  return __atomic_compare_exchange_n(&slot->claim, &claim, CLAIM(pos, CLAIM_RECLAIMED), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+size_t log_shm_drain(LogShm* shm, const Logger* target) {
+  assert(shm != NULL && target != NULL);
+
+  ShmHeader* header = shm->header;
+  char line[LOGGER_LINE_HEADROOM + SHM_SLOT_SIZE];
+  size_t drained = 0;
+
+  pthread_mutex_lock(&shm->drain_lock);
+  uint64_t pos = __atomic_load_n(&header->tail, __ATOMIC_RELAXED);
+  for (;;) {
+    ShmSlot* slot = &shm->slots[pos & shm->mask];
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if (seq == pos + 1) {
+      size_t len = slot->len <= SHM_SLOT_SIZE ? slot->len : SHM_SLOT_SIZE;
+      LogLevel level = slot->level >= FATAL && slot->level <= VERBOSE ? (LogLevel)slot->level : INFO;
+      memcpy(line + LOGGER_LINE_HEADROOM, slot->data, len);
+      __atomic_store_n(&slot->seq, pos + shm->mask + 1, __ATOMIC_RELEASE);
+      __atomic_store_n(&header->tail, ++pos, __ATOMIC_RELAXED);
+
+      logger_log_line(target, level, line + LOGGER_LINE_HEADROOM, len);
+      ++drained;
+      continue;
+    }
+
+    // empty, or claimed and still being written
+    if (pos >= __atomic_load_n(&header->head, __ATOMIC_ACQUIRE)) break;
+    if (!writer_dead(shm, slot, pos)) break;
+
+    uint64_t expected = pos;
+    if (__atomic_compare_exchange_n(&slot->seq, &expected, pos + shm->mask + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      __atomic_fetch_add(&header->lost, 1, __ATOMIC_RELAXED);
+      __atomic_store_n(&header->tail, ++pos, __ATOMIC_RELAXED);
+    }
+    // otherwise it got published meanwhile and is read on the next turn
+  }
+  pthread_mutex_unlock(&shm->drain_lock);
+  return drained;
+}
+
+static void* collector_main(void* arg) {
+  LogShm* shm = (LogShm*)arg;
+
+  pthread_mutex_lock(&shm->wait_lock);
+  while (!shm->stop) {
+    pthread_mutex_unlock(&shm->wait_lock);
+    size_t drained = log_shm_drain(shm, shm->target);
+    pthread_mutex_lock(&shm->wait_lock);
+    if (drained || shm->stop) continue;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)shm->interval_ms * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    pthread_cond_timedwait(&shm->wait_cond, &shm->wait_lock, &deadline);
+  }
+  pthread_mutex_unlock(&shm->wait_lock);
+  log_shm_drain(shm, shm->target);
+  return NULL;
+}
+
+int log_shm_start_collector(LogShm* shm, Logger* target, unsigned interval_ms) {
+  assert(shm != NULL && target != NULL);
+
+  if (shm->collecting) {
+    fprintf(stderr, "Failed to start log collector: already running\n");
+    return -1;
+  }
+  shm->target = target;
+  shm->interval_ms = interval_ms ? interval_ms : SHM_DEFAULT_INTERVAL_MS;
+  shm->stop = false;
+  int result = pthread_create(&shm->collector, NULL, collector_main, shm);
+  if (result != 0) {
+    fprintf(stderr, "Failed to start log collector: %s\n", strerror(result));
+    return -1;
+  }
+  shm->collecting = true;
+  shm->collector_pid = getpid();
+  return 0;
+}
+
+void log_shm_stop_collector(LogShm* shm) {
+  assert(shm != NULL);
+
+  if (!shm->collecting || shm->collector_pid != getpid()) return;
+  pthread_mutex_lock(&shm->wait_lock);
+  shm->stop = true;
+  pthread_cond_signal(&shm->wait_cond);
+  pthread_mutex_unlock(&shm->wait_lock);
+  pthread_join(shm->collector, NULL);
+  shm->collecting = false;
+}
+
+void log_shm_close(LogShm* shm) {
+  assert(shm != NULL);
+
+  // a fork child inherits the handle but neither the thread nor the name
+  log_shm_stop_collector(shm);
+  if (shm->creator == getpid()) shm_unlink(shm->name);
+  shm_release(shm);
+}
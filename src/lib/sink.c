@@ -0,0 +1,317 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "./logger_internal.h"
+
+//####################
+// FORMATTERS
+//####################
+
+static int format_prefixed(const LogRecord* record, char* buff, size_t size, bool colored) {
+  return pattern_render(log_pattern_default(), record, colored, NULL, NULL, buff, size);
+}
+
+int log_formatter_plain(const LogRecord* record, char* buff, size_t size) {
+  assert(record != NULL && buff != NULL);
+
+  return format_prefixed(record, buff, size, false);
+}
+
+int log_formatter_color(const LogRecord* record, char* buff, size_t size) {
+  assert(record != NULL && buff != NULL);
+
+  return format_prefixed(record, buff, size, true);
+}
+
+int log_formatter_message(const LogRecord* record, char* buff, size_t size) {
+  assert(record != NULL && buff != NULL);
+
+  if (size > 0) {
+    size_t copied = record->message_len < size - 1 ? record->message_len : size - 1;
+    memcpy(buff, record->message, copied);
+    buff[copied] = '\0';
+  }
+  return (int)record->message_len;
+}
+
+//####################
+// SINKS
+//####################
+
+// A rendered line: lines that fit live in the caller's stack buffer, longer
+// ones are rendered again into a heap buffer released by line_release.
+typedef struct Line {
+  char* text;
+  size_t len;
+  bool heap;
+} Line;
+
+// The logger's own pattern, when set, stands in for a NULL formatter.
+typedef struct Layout {
+  const LogPattern* pattern;
+  bool colored;
+} Layout;
+
+static int layout_render(const Layout* layout, LogFormatter formatter, const LogRecord* record, char* buff, size_t size) {
+  if (formatter) return formatter(record, buff, size);
+  return pattern_render(layout->pattern, record, layout->colored, NULL, NULL, buff, size);
+}
+
+static int line_render(Line* line, const Layout* layout, LogFormatter formatter, const LogRecord* record, char* stack, size_t size) {
+  int needed = layout_render(layout, formatter, record, stack, size);
+  if (needed < 0) return -1;
+
+  line->text = stack;
+  line->len = (size_t)needed;
+  line->heap = false;
+  if ((size_t)needed < size) return 0;
+
+  char* buff = (char*)malloc((size_t)needed + 1);
+  if (!buff) {
+    line->len = size - 1;
+    return 0;
+  }
+  layout_render(layout, formatter, record, buff, (size_t)needed + 1);
+  line->text = buff;
+  line->heap = true;
+  return 0;
+}
+
+static void line_release(Line* line) {
+  if (line->heap) free(line->text);
+  line->heap = false;
+}
+
+int logger_add_sink(Logger* logger, const LogSinkOps* ops, void* ctx, LogLevel level, LogFormatter formatter) {
+  assert(logger != NULL && ops != NULL && ops->write != NULL);
+
+  if (logger->async || logger->shards || logger->binary || logger->direct_max || logger->shm) {
+    fprintf(stderr, "Failed to add log sink: async, sharded, binary, direct and shared-memory loggers do not take sinks\n");
+    return -1;
+  }
+  if (logger->sink_count == LOGGER_MAX_SINKS) {
+    fprintf(stderr, "Failed to add log sink: at most %d sinks per logger\n", LOGGER_MAX_SINKS);
+    return -1;
+  }
+
+  pthread_mutex_lock(&logger->lock);
+  logger->sinks[logger->sink_count++] = (LogSink){
+    .ops = ops, .ctx = ctx, .level = level, .formatter = formatter ? formatter : log_formatter_plain
+  };
+  // without a primary destination the logger's level only gates the sinks
+  bool primary = logger->out || logger->err || logger->mmap;
+  if (!primary && level > logger->level) __atomic_store_n(&logger->level, level, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&logger->lock);
+  return 0;
+}
+
+static void stream_sink_write(void* ctx, const LogRecord* record, const char* line, size_t len) {
+  (void)record;
+  fwrite(line, 1, len, (FILE*)ctx);
+}
+
+static void stream_sink_flush(void* ctx) {
+  fflush((FILE*)ctx);
+}
+
+static const LogSinkOps STREAM_SINK_OPS = { stream_sink_write, stream_sink_flush, stream_sink_flush };
+
+int logger_add_stream_sink(Logger* logger, FILE* stream, LogLevel level, LogFormatter formatter) {
+  assert(logger != NULL && stream != NULL);
+
+  return logger_add_sink(logger, &STREAM_SINK_OPS, stream, level, formatter);
+}
+
+void sinks_log(const Logger* logger, LogLevel level, const char* message, va_list args) {
+  assert(logger != NULL && message != NULL);
+
+  LogRecord record;
+  record.level = level;
+  record.precision = logger->ts_precision;
+  record.category = logger_record_category;
+  record.sample = logger_record_sample;
+  clock_gettime(logger->ts_clock, &record.time);
+  // the message is formatted once, sinks only differ by their prefix
+  record.message = logger_format_message(message, args, &record.message_len);
+  if (!record.message) return;
+
+  char stack[BUFF_SIZE_RECORD];
+  Line line = { NULL, 0, false };
+  LogFormatter rendered = NULL;
+
+  FILE* stream = logger->out || logger->err ? logger_stream(logger, level) : NULL;
+  bool colored = stream && logger_is_colored(logger, level);
+  Layout layout = { logger->pattern, colored };
+  if (stream || logger->mmap) {
+    if (!logger->pattern) rendered = colored ? log_formatter_color : log_formatter_plain;
+    if (line_render(&line, &layout, rendered, &record, stack, sizeof(stack)) != 0) return;
+  }
+  if (logger->mmap) {
+    mmap_sink_write(logger->mmap, line.text, line.len);
+    if (logger->flush.sync_errors && level <= ERROR) mmap_sink_sync(logger->mmap);
+  }
+
+  if (logger_lock(logger) != 0) {
+    line_release(&line);
+    return;
+  }
+  size_t len = line.len;
+  if (stream) {
+    if (logger->rotator) {
+      rotator_before_write((Logger*)logger, line.len);
+      stream = logger_stream(logger, level);
+    }
+    fwrite(line.text, 1, line.len, stream);
+  }
+
+  for (size_t i = 0; i < logger->sink_count; ++i) {
+    const LogSink* sink = &logger->sinks[i];
+    if (level > sink->level) continue;
+    // consecutive sinks sharing a formatter share the rendered line
+    if (sink->formatter != rendered) {
+      line_release(&line);
+      if (line_render(&line, &layout, sink->formatter, &record, stack, sizeof(stack)) != 0) continue;
+      rendered = sink->formatter;
+    }
+    sink->ops->write(sink->ctx, &record, line.text, line.len);
+    if (len == 0) len = line.len;
+  }
+
+  if (logger->stats) stats_bytes(logger->stats, len);
+  flush_after_write((Logger*)logger, stream, level, len);
+  logger_unlock(logger);
+  line_release(&line);
+}
+
+void sinks_write_line(const Logger* logger, LogLevel level, const char* line, size_t len) {
+  assert(logger != NULL && line != NULL);
+
+  LogRecord record;
+  record.level = level;
+  record.precision = logger->ts_precision;
+  record.category = logger_record_category;
+  record.sample = logger_record_sample;
+  clock_gettime(logger->ts_clock, &record.time);
+  record.message = line;
+  record.message_len = len;
+
+  if (logger->mmap) {
+    mmap_sink_write(logger->mmap, line, len);
+    if (logger->flush.sync_errors && level <= ERROR) mmap_sink_sync(logger->mmap);
+  }
+
+  if (logger_lock(logger) != 0) return;
+  FILE* stream = logger->out || logger->err ? logger_stream(logger, level) : NULL;
+  if (stream) {
+    if (logger->rotator) {
+      rotator_before_write((Logger*)logger, len);
+      stream = logger_stream(logger, level);
+    }
+    fwrite(line, 1, len, stream);
+  }
+  for (size_t i = 0; i < logger->sink_count; ++i) {
+    const LogSink* sink = &logger->sinks[i];
+    if (level <= sink->level) sink->ops->write(sink->ctx, &record, line, len);
+  }
+  if (logger->stats) stats_bytes(logger->stats, len);
+  flush_after_write((Logger*)logger, stream, level, len);
+  logger_unlock(logger);
+}
+
+void sinks_flush(Logger* logger) {
+  assert(logger != NULL);
+
+  for (size_t i = 0; i < logger->sink_count; ++i) {
+    if (logger->sinks[i].ops->flush) logger->sinks[i].ops->flush(logger->sinks[i].ctx);
+  }
+}
+
+void sinks_close(Logger* logger) {
+  assert(logger != NULL);
+
+  for (size_t i = 0; i < logger->sink_count; ++i) {
+    if (logger->sinks[i].ops->close) logger->sinks[i].ops->close(logger->sinks[i].ctx);
+  }
+  logger->sink_count = 0;
+}
+
+//####################
+// RING
+//####################
+
+struct LogRing {
+  pthread_mutex_t lock;
+  char* data;
+  size_t capacity;
+  size_t written; // total bytes ever written, the head is written % capacity
+};
+
+LogRing* log_ring_new(size_t capacity) {
+  assert(capacity > 0);
+
+  LogRing* ring = (LogRing*)malloc(sizeof(LogRing));
+  if (!ring) return NULL;
+
+  ring->data = (char*)malloc(capacity);
+  if (!ring->data) {
+    free(ring);
+    return NULL;
+  }
+  pthread_mutex_init(&ring->lock, NULL);
+  ring->capacity = capacity;
+  ring->written = 0;
+  return ring;
+}
+
+void log_ring_free(LogRing* ring) {
+  assert(ring != NULL);
+
+  pthread_mutex_destroy(&ring->lock);
+  free(ring->data);
+  free(ring);
+}
+
+static void ring_sink_write(void* ctx, const LogRecord* record, const char* line, size_t len) {
+  LogRing* ring = (LogRing*)ctx;
+  (void)record;
+
+  pthread_mutex_lock(&ring->lock);
+  if (len > ring->capacity) {
+    // only the tail of an oversized line survives anyway
+    ring->written += len - ring->capacity;
+    line += len - ring->capacity;
+    len = ring->capacity;
+  }
+  size_t head = ring->written % ring->capacity;
+  size_t first = ring->capacity - head < len ? ring->capacity - head : len;
+  memcpy(ring->data + head, line, first);
+  memcpy(ring->data, line + first, len - first);
+  ring->written += len;
+  pthread_mutex_unlock(&ring->lock);
+}
+
+static const LogSinkOps RING_SINK_OPS = { ring_sink_write, NULL, NULL };
+
+size_t log_ring_read(LogRing* ring, char* buff, size_t size) {
+  assert(ring != NULL && buff != NULL);
+
+  pthread_mutex_lock(&ring->lock);
+  size_t held = ring->written < ring->capacity ? ring->written : ring->capacity;
+  size_t count = held < size ? held : size;
+  // the oldest bytes are dropped when buff is too small for the whole ring
+  size_t start = (ring->written - count) % ring->capacity;
+  size_t first = ring->capacity - start < count ? ring->capacity - start : count;
+  memcpy(buff, ring->data + start, first);
+  memcpy(buff + first, ring->data, count - first);
+  pthread_mutex_unlock(&ring->lock);
+  return count;
+}
+
+int logger_add_ring_sink(Logger* logger, LogRing* ring, LogLevel level, LogFormatter formatter) {
+  assert(logger != NULL && ring != NULL);
+
+  return logger_add_sink(logger, &RING_SINK_OPS, ring, level, formatter);
+}
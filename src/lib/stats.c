@@ -0,0 +1,238 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./logger_internal.h"
+
+//####################
+// STATISTICS
+//####################
+
+// Every thread counts into a block of its own, found through a pthread key,
+// and is its only writer: increments are a relaxed load and store, no locked
+// instruction and no shared cache line. logger_stats sums the blocks with
+// relaxed loads. Blocks outlive their thread and are handed to the next
+// thread that starts logging, their totals are kept.
+
+#define CACHE_LINE 64
+#define STATS_FIRST_BUCKET_SHIFT 6
+#define STATS_FIELDS (sizeof(LoggerStats) / sizeof(uint64_t))
+
+_Static_assert(sizeof(LoggerStats) % sizeof(uint64_t) == 0, "LoggerStats must only hold uint64_t counters");
+
+typedef struct StatsBlock {
+  LoggerStats counts;
+  int owned; // 1 while a live thread counts into it
+  struct StatsBlock* next;
+} __attribute__((aligned(CACHE_LINE))) StatsBlock;
+
+struct StatsSet {
+  StatsBlock* blocks; // pushed at the front, never unlinked before stats_set_free
+  pthread_key_t key;
+};
+
+#define BUMP(counter, n) __atomic_store_n(&(counter), __atomic_load_n(&(counter), __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED)
+
+static void block_release(void* arg) {
+  StatsBlock* block = (StatsBlock*)arg;
+  __atomic_store_n(&block->owned, 0, __ATOMIC_RELEASE);
+}
+
+static StatsBlock* block_claim(StatsSet* set) {
+  for (StatsBlock* block = __atomic_load_n(&set->blocks, __ATOMIC_ACQUIRE); block; block = block->next) {
+    int free_block = 0;
+    if (__atomic_compare_exchange_n(&block->owned, &free_block, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return block;
+    }
+  }
+
+  StatsBlock* block = NULL;
+  if (posix_memalign((void**)&block, CACHE_LINE, sizeof(StatsBlock)) != 0) return NULL;
+  memset(block, 0, sizeof(StatsBlock));
+  block->owned = 1;
+  block->next = __atomic_load_n(&set->blocks, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&set->blocks, &block->next, block, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  return block;
+}
+
+static StatsBlock* thread_block(StatsSet* set) {
+  StatsBlock* block = (StatsBlock*)pthread_getspecific(set->key);
+  if (block) return block;
+
+  block = block_claim(set);
+  if (!block) return NULL;
+  pthread_setspecific(set->key, block);
+  return block;
+}
+
+int logger_enable_stats(Logger* logger) {
+  assert(logger != NULL);
+
+  if (logger->stats) return 0;
+
+  StatsSet* set = (StatsSet*)malloc(sizeof(StatsSet));
+  if (!set) return -1;
+  set->blocks = NULL;
+  int result = pthread_key_create(&set->key, block_release);
+  if (result != 0) {
+    fprintf(stderr, "Failed to create stats key: %s\n", strerror(result));
+    free(set);
+    return -1;
+  }
+  logger->stats = set;
+  return 0;
+}
+
+void stats_set_free(StatsSet* set) {
+  assert(set != NULL);
+
+  pthread_key_delete(set->key);
+  StatsBlock* block = set->blocks;
+  while (block) {
+    StatsBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  free(set);
+}
+
+uint64_t stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+//------------------------------
+// Counters
+//------------------------------
+
+void stats_emitted(StatsSet* set, LogLevel level) {
+  StatsBlock* block = thread_block(set);
+  if (block) BUMP(block->counts.emitted[level], 1);
+}
+
+void stats_filtered(StatsSet* set, LogLevel level) {
+  StatsBlock* block = thread_block(set);
+  if (block) BUMP(block->counts.filtered[level], 1);
+}
+
+void stats_call(StatsSet* set, uint64_t ns) {
+  StatsBlock* block = thread_block(set);
+  if (!block) return;
+
+  // bucket i holds the calls under 2^(i + 6) ns
+  int bits = ns ? 64 - __builtin_clzll(ns) : 0;
+  int bucket = bits > STATS_FIRST_BUCKET_SHIFT ? bits - STATS_FIRST_BUCKET_SHIFT : 0;
+  if (bucket >= LOGGER_STATS_BUCKETS) bucket = LOGGER_STATS_BUCKETS - 1;
+
+  BUMP(block->counts.calls, 1);
+  BUMP(block->counts.call_ns, ns);
+  BUMP(block->counts.latency[bucket], 1);
+}
+
+void stats_bytes(StatsSet* set, size_t bytes) {
+  StatsBlock* block = thread_block(set);
+  if (block) BUMP(block->counts.bytes, bytes);
+}
+
+void stats_flush(StatsSet* set) {
+  StatsBlock* block = thread_block(set);
+  if (block) BUMP(block->counts.flushes, 1);
+}
+
+void stats_lock_wait(StatsSet* set, uint64_t ns) {
+  StatsBlock* block = thread_block(set);
+  if (!block) return;
+
+  BUMP(block->counts.lock_contended, 1);
+  BUMP(block->counts.lock_wait_ns, ns);
+}
+
+void logger_stats(const Logger* logger, LoggerStats* stats) {
+  assert(logger != NULL && stats != NULL);
+
+  memset(stats, 0, sizeof(LoggerStats));
+  if (!logger->stats) return;
+
+  uint64_t* total = (uint64_t*)stats;
+  for (StatsBlock* block = __atomic_load_n(&logger->stats->blocks, __ATOMIC_ACQUIRE); block; block = block->next) {
+    uint64_t* counts = (uint64_t*)&block->counts;
+    for (size_t i = 0; i < STATS_FIELDS; ++i) {
+      total[i] += __atomic_load_n(&counts[i], __ATOMIC_RELAXED);
+    }
+  }
+}
+
+//------------------------------
+// Prometheus
+//------------------------------
+
+static const char* LEVEL_LABELS[] = {
+  "fatal", "error", "warn", "info", "debug", "trace", "verbose"
+};
+
+static void write_counter(FILE* stream, const char* name, const char* help, uint64_t value) {
+  fprintf(stream, "# HELP c_logger_%s %s\n# TYPE c_logger_%s counter\nc_logger_%s %llu\n",
+    name, help, name, name, (unsigned long long)value);
+}
+
+int logger_stats_write_prometheus(const LoggerStats* stats, FILE* stream) {
+  assert(stats != NULL && stream != NULL);
+
+  fprintf(stream, "# HELP c_logger_records_total Records passed to the logger by level and outcome.\n");
+  fprintf(stream, "# TYPE c_logger_records_total counter\n");
+  for (int level = FATAL; level <= VERBOSE; ++level) {
+    fprintf(stream, "c_logger_records_total{level=\"%s\",outcome=\"emitted\"} %llu\n",
+      LEVEL_LABELS[level], (unsigned long long)stats->emitted[level]);
+    fprintf(stream, "c_logger_records_total{level=\"%s\",outcome=\"filtered\"} %llu\n",
+      LEVEL_LABELS[level], (unsigned long long)stats->filtered[level]);
+  }
+
+  write_counter(stream, "bytes_total", "Bytes written to the logger's destinations.", stats->bytes);
+  write_counter(stream, "flushes_total", "Flushes of the logger's destinations.", stats->flushes);
+  write_counter(stream, "lock_contended_total", "Acquisitions of the logger lock that had to wait.", stats->lock_contended);
+  fprintf(stream, "# HELP c_logger_lock_wait_seconds_total Time spent waiting for the logger lock.\n");
+  fprintf(stream, "# TYPE c_logger_lock_wait_seconds_total counter\n");
+  fprintf(stream, "c_logger_lock_wait_seconds_total %.9f\n", (double)stats->lock_wait_ns / 1e9);
+
+  fprintf(stream, "# HELP c_logger_call_duration_seconds Time spent inside log_* calls.\n");
+  fprintf(stream, "# TYPE c_logger_call_duration_seconds histogram\n");
+  uint64_t cumulative = 0;
+  for (int i = 0; i < LOGGER_STATS_BUCKETS - 1; ++i) {
+    cumulative += stats->latency[i];
+    double bound = (double)(1ULL << (i + STATS_FIRST_BUCKET_SHIFT)) / 1e9;
+    fprintf(stream, "c_logger_call_duration_seconds_bucket{le=\"%.9g\"} %llu\n", bound, (unsigned long long)cumulative);
+  }
+  fprintf(stream, "c_logger_call_duration_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)stats->calls);
+  fprintf(stream, "c_logger_call_duration_seconds_sum %.9f\n", (double)stats->call_ns / 1e9);
+  fprintf(stream, "c_logger_call_duration_seconds_count %llu\n", (unsigned long long)stats->calls);
+
+  return ferror(stream) ? -1 : 0;
+}
+
+int logger_stats_export(const Logger* logger, const char* path) {
+  assert(logger != NULL && path != NULL);
+
+  LoggerStats stats;
+  logger_stats(logger, &stats);
+
+  // written aside then renamed over path, scrapers never see half a file
+  char tmp[4096];
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return -1;
+  FILE* file = fopen(tmp, "w");
+  if (!file) {
+    fprintf(stderr, "Failed to open %s: %s\n", tmp, strerror(errno));
+    return -1;
+  }
+  int result = logger_stats_write_prometheus(&stats, file);
+  if (fclose(file) != 0) result = -1;
+  if (result == 0 && rename(tmp, path) != 0) {
+    fprintf(stderr, "Failed to rename %s: %s\n", tmp, strerror(errno));
+    result = -1;
+  }
+  if (result != 0) unlink(tmp);
+  return result;
+}
@@ -0,0 +1,69 @@
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include "./logger_internal.h"
+
+//####################
+// TIMESTAMP
+//####################
+
+// "%Y-%m-%d %H:%M:%S" only changes once a second, so every thread keeps the
+// last rendered second and only patches in the sub-second digits. localtime_r
+// and strftime run on a cache miss, i.e. at most once per second per thread.
+
+#define STAMP_SECONDS_LEN 19
+
+static __thread time_t cached_sec = (time_t)-1;
+static __thread char cached_stamp[STAMP_SECONDS_LEN + 1];
+
+static void write_digits(char* buff, unsigned long value, int width) {
+  for (int i = width - 1; i >= 0; --i) {
+    buff[i] = (char)('0' + value % 10);
+    value /= 10;
+  }
+}
+
+size_t timestamp_format(char* buff, const struct timespec* now, TimestampPrecision precision) {
+  assert(buff != NULL && now != NULL);
+
+  if (now->tv_sec != cached_sec) {
+    struct tm tm;
+    localtime_r(&now->tv_sec, &tm);
+    strftime(cached_stamp, sizeof(cached_stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    cached_sec = now->tv_sec;
+  }
+  memcpy(buff, cached_stamp, STAMP_SECONDS_LEN);
+
+  size_t len = STAMP_SECONDS_LEN;
+  switch (precision) {
+    case TS_MILLIS:
+      buff[len++] = '.';
+      write_digits(buff + len, (unsigned long)now->tv_nsec / 1000000UL, 3);
+      len += 3;
+      break;
+    case TS_MICROS:
+      buff[len++] = '.';
+      write_digits(buff + len, (unsigned long)now->tv_nsec / 1000UL, 6);
+      len += 6;
+      break;
+    case TS_SECONDS:
+      break;
+  }
+  buff[len] = '\0';
+  return len;
+}
+
+void timestamp(char* buff, size_t size) {
+  assert(buff != NULL);
+
+  struct timespec now;
+  clock_gettime(TIMESTAMP_DEFAULT_CLOCK, &now);
+
+  char stamp[BUFF_SIZE_TIMESTAMP];
+  size_t len = timestamp_format(stamp, &now, TS_SECONDS);
+  if (size == 0) return;
+  if (len >= size) len = size - 1;
+  memcpy(buff, stamp, len);
+  buff[len] = '\0';
+}
@@ -0,0 +1,71 @@
+#define _XOPEN_SOURCE 700 // strptime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+
+static const char* LEVELS[] = { "FATAL", "ERROR", "WARN", "INFO", "DEBUG", "TRACE", "VERBOSE" };
+
+// "YYYY-MM-DD HH:MM:SS" in local time, as the logger prints it, or "@seconds".
+static int parse_time(const char* text, struct timespec* time) {
+  if (text[0] == '@') {
+    char* end = NULL;
+    time->tv_sec = (time_t)strtoll(text + 1, &end, 10);
+    return *end == '\0' ? 0 : -1;
+  }
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  const char* end = strptime(text, "%Y-%m-%d %H:%M:%S", &tm);
+  if (end == NULL || *end != '\0') return -1;
+  tm.tm_isdst = -1;
+  time->tv_sec = mktime(&tm);
+  return 0;
+}
+
+static int parse_level(const char* text, LogLevel* level) {
+  for (int i = FATAL; i <= VERBOSE; ++i) {
+    if (strcasecmp(text, LEVELS[i]) == 0) {
+      *level = (LogLevel)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Prints the records of an indexed log in a time range and at or above a level:
+//   query [-f from] [-t to] [-l level] file
+int main(int argc, char** argv) {
+  LogQuery query = { { 0, 0 }, { 0, 0 }, VERBOSE };
+  int opt;
+  while ((opt = getopt(argc, argv, "f:t:l:")) != -1) {
+    int result = -1;
+    switch (opt) {
+      case 'f':
+        result = parse_time(optarg, &query.from);
+        break;
+      case 't':
+        result = parse_time(optarg, &query.to);
+        // the whole last second
+        if (result == 0) query.to.tv_nsec = 999999999L;
+        break;
+      case 'l':
+        result = parse_level(optarg, &query.level);
+        break;
+    }
+    if (result != 0) {
+      fprintf(stderr, "usage: %s [-f \"YYYY-MM-DD HH:MM:SS\" | -f @seconds] [-t ...] [-l level] file\n", argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: %s [-f from] [-t to] [-l level] file\n", argv[0]);
+    return 1;
+  }
+
+  return log_index_query(argv[optind], &query, stdout) < 0 ? 1 : 0;
+}
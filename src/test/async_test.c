@@ -0,0 +1,124 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+#define FILE_ERR "test_async_%s.err"
+#define FILE_OUT "test_async_%s.out"
+
+#define NUM_THREADS 8
+#define MESSAGES_PER_THREAD 1000
+
+static void* thread_log_function(void* arg) {
+    Logger* logger = (Logger*)arg;
+    for (int i = 0; i < MESSAGES_PER_THREAD; i++) {
+        log_info(logger, "Async message %d\n", i);
+    }
+    return NULL;
+}
+
+Test(logger_async, drains_on_free) {
+	char err_file[1024] = {0};
+	char out_file[1024] = {0};
+
+	snprintf(err_file, 1024, FILE_ERR, "drains_on_free");
+	snprintf(out_file, 1024, FILE_OUT, "drains_on_free");
+
+	FILE* err = fopen(err_file, "w+");
+	FILE* out = fopen(out_file, "w+");
+    cr_assert(err != NULL && out != NULL, "Should open output files");
+
+    // small capacity so producers have to wait on the writer
+    Logger* logger = logger_new_async(INFO, out, err, 16);
+    cr_assert(logger != NULL, "Async logger should be created");
+
+    pthread_t threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, thread_log_function, logger);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    log_error(logger, "Async error\n");
+    log_debug(logger, "Async debug\n");
+    logger_free(logger);
+
+    cr_assert_eq(count_lines(out, "[INFO] "), NUM_THREADS * MESSAGES_PER_THREAD, "All records should be written");
+    cr_assert_eq(count_lines(err, "Async error"), 1, "ERROR should go to err");
+    cr_assert_eq(count_lines(out, "Async debug"), 0, "DEBUG should be filtered");
+
+	fclose(err);
+	fclose(out);
+	remove(err_file);
+	remove(out_file);
+}
+
+Test(logger_async, oversized_record) {
+	char err_file[1024] = {0};
+	char out_file[1024] = {0};
+
+	snprintf(err_file, 1024, FILE_ERR, "oversized_record");
+	snprintf(out_file, 1024, FILE_OUT, "oversized_record");
+
+	FILE* err = fopen(err_file, "w+");
+	FILE* out = fopen(out_file, "w+");
+
+    Logger* logger = logger_new_async(INFO, out, err, 0);
+
+    char long_msg[ASYNC_SLOT_SIZE * 4];
+    memset(long_msg, 'a', sizeof(long_msg) - 1);
+    long_msg[sizeof(long_msg) - 1] = '\0';
+    log_info(logger, "%s\n", long_msg);
+    logger_free(logger);
+
+    char output[ASYNC_SLOT_SIZE * 8] = {0};
+    rewind(out);
+    size_t bytes = fread(output, 1, sizeof(output) - 1, out);
+    output[bytes] = '\0';
+    cr_assert(strstr(output, long_msg) != NULL, "Oversized record should not be truncated");
+
+	fclose(err);
+	fclose(out);
+	remove(err_file);
+	remove(out_file);
+}
+
+Test(logger_async, batched) {
+	char err_file[1024] = {0};
+	char out_file[1024] = {0};
+
+	snprintf(err_file, 1024, FILE_ERR, "batched");
+	snprintf(out_file, 1024, FILE_OUT, "batched");
+
+	FILE* err = fopen(err_file, "w+");
+	FILE* out = fopen(out_file, "w+");
+
+    BatchPolicy policy = { .max_records = 64, .max_latency_us = 200 };
+    Logger* logger = logger_new_batched(INFO, out, err, 256, policy);
+    cr_assert(logger != NULL, "Batched logger should be created");
+
+    pthread_t threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, thread_log_function, logger);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    char long_msg[ASYNC_SLOT_SIZE * 2];
+    memset(long_msg, 'x', sizeof(long_msg) - 1);
+    long_msg[sizeof(long_msg) - 1] = '\0';
+    log_warn(logger, "%s\n", long_msg);
+    logger_free(logger);
+
+    cr_assert_eq(count_lines(out, "[INFO] "), NUM_THREADS * MESSAGES_PER_THREAD, "All records should be written");
+    cr_assert_eq(count_lines(out, "Async message 999\n"), NUM_THREADS, "Records should be written whole");
+    cr_assert_eq(count_lines(err, long_msg), 1, "Oversized records should be written to err");
+
+	fclose(err);
+	fclose(out);
+	remove(err_file);
+	remove(out_file);
+}
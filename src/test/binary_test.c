@@ -0,0 +1,130 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+
+#define FILE_BIN "test_binary_%s.bin"
+
+// Message part of every decoded line, i.e. what follows "(timestamp) -- ".
+static int decoded_messages(FILE* decoded, char messages[][256], int max) {
+    char line[1024];
+    int count = 0;
+    rewind(decoded);
+    while (count < max && fgets(line, sizeof(line), decoded) != NULL) {
+        char* body = strstr(line, ") -- ");
+        if (body == NULL) continue;
+        snprintf(messages[count++], 256, "%s", body + 5);
+    }
+    return count;
+}
+
+Test(logger_binary, round_trip) {
+	char bin_file[1024] = {0};
+	snprintf(bin_file, 1024, FILE_BIN, "round_trip");
+
+	FILE* bin = fopen(bin_file, "w+b");
+    cr_assert(bin != NULL, "Should open binary file");
+
+    Logger* logger = logger_new_binary(DEBUG, bin);
+    const char* name = "worker";
+    const char* null_name = NULL;
+
+    LOG_BINARY(logger, INFO, "plain\n");
+    LOG_BINARY(logger, INFO, "int %d unsigned %u hex %#x char %c\n", -42, 42u, 255, 'z');
+    LOG_BINARY(logger, WARN, "long %ld llong %lld size %zu\n", -7L, 1LL << 40, (size_t)99);
+    LOG_BINARY(logger, ERROR, "double %.3f %g %Le 100%%\n", 3.14159, 0.5, 2.5L);
+    LOG_BINARY(logger, DEBUG, "str [%s] [%-8s] [%.*s] [%.2s] [%s]\n", name, name, 3, name, name, null_name);
+    LOG_BINARY(logger, DEBUG, "width [%*d]\n", 6, 17);
+    LOG_BINARY(logger, TRACE, "filtered %d\n", 1);
+    log_info(logger, "text %d\n", 5);
+    LOG_BINARY(logger, INFO, "errno %m\n");
+
+    logger_free(logger);
+
+    FILE* decoded = tmpfile();
+    rewind(bin);
+    cr_assert_eq(logger_decode_binary(bin, decoded), 0, "Decoding should succeed");
+
+    char expected[8][256];
+    snprintf(expected[0], 256, "plain\n");
+    snprintf(expected[1], 256, "int %d unsigned %u hex %#x char %c\n", -42, 42u, 255, 'z');
+    snprintf(expected[2], 256, "long %ld llong %lld size %zu\n", -7L, 1LL << 40, (size_t)99);
+    snprintf(expected[3], 256, "double %.3f %g %Le 100%%\n", 3.14159, 0.5, 2.5L);
+    snprintf(expected[4], 256, "str [%s] [%-8s] [%.*s] [%.2s] [(null)]\n", name, name, 3, name, name);
+    snprintf(expected[5], 256, "width [%*d]\n", 6, 17);
+    snprintf(expected[6], 256, "text %d\n", 5);
+
+    char messages[16][256];
+    int count = decoded_messages(decoded, messages, 16);
+    cr_assert_eq(count, 8, "Every enabled record should be decoded");
+    for (int i = 0; i < 7; i++) {
+        cr_assert_str_eq(messages[i], expected[i], "Decoded message should match printf output");
+    }
+    cr_assert(strncmp(messages[7], "errno ", 6) == 0, "Unpackable formats should fall back to text");
+
+	fclose(decoded);
+	fclose(bin);
+	remove(bin_file);
+}
+
+Test(logger_binary, text_logger_fallback) {
+    FILE* out = tmpfile();
+    FILE* err = tmpfile();
+    Logger* logger = logger_new(INFO, out, err);
+
+    LOG_BINARY(logger, INFO, "formatted %d\n", 7);
+    logger_free(logger);
+
+    char output[1024] = {0};
+    rewind(out);
+    size_t bytes = fread(output, 1, sizeof(output) - 1, out);
+    output[bytes] = '\0';
+    cr_assert(strstr(output, "[INFO] (") != NULL, "Text loggers should render LOG_BINARY as text");
+    cr_assert(strstr(output, "formatted 7\n") != NULL, "Text loggers should format the message");
+
+	fclose(out);
+	fclose(err);
+}
+
+Test(logger_binary, rejects_truncated_file) {
+    FILE* bin = tmpfile();
+    Logger* logger = logger_new_binary(INFO, bin);
+    LOG_BINARY(logger, INFO, "value %d\n", 1);
+    logger_free(logger);
+
+    long size = ftell(bin);
+    cr_assert_eq(ftruncate(fileno(bin), size - 3), 0);
+
+    FILE* decoded = tmpfile();
+    rewind(bin);
+    cr_assert_eq(logger_decode_binary(bin, decoded), -1, "Truncated records should be reported");
+
+	fclose(decoded);
+	fclose(bin);
+}
+
+Test(logger_binary, category_where_text_puts_it) {
+    FILE* bin = tmpfile();
+    Logger* logger = logger_new_binary(INFO, bin);
+    LogCategory* net = logger_category(logger, "net");
+    log_category(net, WARN, "peer %d gone\n", 3);
+    log_info(logger, "no category\n");
+    logger_free(logger);
+
+    FILE* decoded = tmpfile();
+    rewind(bin);
+    cr_assert_eq(logger_decode_binary(bin, decoded), 0, "Decoding should succeed");
+
+    char line[1024];
+    rewind(decoded);
+    cr_assert_not_null(fgets(line, sizeof(line), decoded));
+    cr_assert(strncmp(line, "[WARN] (", 8) == 0, "Decoded line: %s", line);
+    cr_assert(strstr(line, ") [net] -- peer 3 gone\n") != NULL, "The category should follow the timestamp: %s", line);
+    cr_assert_not_null(fgets(line, sizeof(line), decoded));
+    cr_assert(strstr(line, ") -- no category\n") != NULL, "Decoded line: %s", line);
+
+	fclose(decoded);
+	fclose(bin);
+}
@@ -0,0 +1,135 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+#define FILE_COMPRESS "test_compress_%s.log.clz"
+
+#define NUM_THREADS 4
+#define MESSAGES_PER_THREAD 5000
+
+static void* thread_log_function(void* arg) {
+    Logger* logger = (Logger*)arg;
+    for (int i = 0; i < MESSAGES_PER_THREAD; i++) {
+        log_info(logger, "Compressed message %d from a worker thread\n", i);
+    }
+    return NULL;
+}
+
+// Decompresses path into a temporary file, returns log_decompress's result.
+static int decompress(const char* path, FILE* out) {
+    FILE* in = fopen(path, "rb");
+    cr_assert(in != NULL, "Compressed log should exist");
+    int result = log_decompress(in, out);
+    fclose(in);
+    return result;
+}
+
+static long file_size(const char* path) {
+    struct stat st;
+    cr_assert_eq(stat(path, &st), 0);
+    return (long)st.st_size;
+}
+
+Test(logger_compress, concurrent_writers_round_trip) {
+    char path[1024];
+    snprintf(path, sizeof(path), FILE_COMPRESS, "round_trip");
+    remove(path);
+
+    // small blocks so writers hand many of them to the compressor
+    LogCompressSink* sink = log_compress_sink_new(path, 16 * 1024, 0);
+    cr_assert_not_null(sink);
+    Logger* logger = logger_new_sinks();
+    cr_assert_eq(logger_add_compress_sink(logger, sink, INFO, NULL), 0);
+
+    pthread_t threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, thread_log_function, logger);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    log_debug(logger, "filtered\n");
+    logger_free(logger);
+    log_compress_sink_free(sink);
+
+    FILE* out = tmpfile();
+    cr_assert_eq(decompress(path, out), 0);
+    cr_assert(whole_lines(out), "Lines should be complete");
+    fseek(out, 0, SEEK_END);
+    long raw_size = ftell(out);
+    cr_assert_eq(count_lines(out, "Compressed message"), NUM_THREADS * MESSAGES_PER_THREAD);
+    cr_assert_eq(count_lines(out, "filtered"), 0);
+    cr_assert_lt(file_size(path) * 4, raw_size, "Log lines should compress at least 4:1");
+
+    fclose(out);
+    remove(path);
+}
+
+Test(logger_compress, torn_block_is_skipped) {
+    char path[1024];
+    snprintf(path, sizeof(path), FILE_COMPRESS, "torn");
+    remove(path);
+
+    LogCompressSink* sink = log_compress_sink_new(path, 4096, 0);
+    cr_assert_not_null(sink);
+    Logger* logger = logger_new_sinks();
+    cr_assert_eq(logger_add_compress_sink(logger, sink, INFO, log_formatter_message), 0);
+    for (int i = 0; i < 10000; i++) {
+        log_info(logger, "record %d\n", i);
+    }
+    logger_free(logger);
+    log_compress_sink_free(sink);
+
+    // a crash mid-block, then a restarted process appending more blocks
+    long size = file_size(path);
+    cr_assert_eq(truncate(path, size - 10), 0);
+    sink = log_compress_sink_new(path, 4096, 0);
+    cr_assert_not_null(sink);
+    logger = logger_new_sinks();
+    cr_assert_eq(logger_add_compress_sink(logger, sink, INFO, log_formatter_message), 0);
+    log_info(logger, "after restart\n");
+    logger_free(logger);
+    log_compress_sink_free(sink);
+
+    FILE* out = tmpfile();
+    cr_assert_eq(decompress(path, out), -1, "The torn block should be reported");
+    cr_assert(whole_lines(out), "Lines should be complete");
+    int records = count_lines(out, "record ");
+    // a 4096 byte block holds fewer than 4096 / 8 records
+    cr_assert(records > 10000 - 4096 / 8 && records < 10000, "Only the torn block should be lost, kept %d", records);
+    cr_assert_eq(count_lines(out, "record 0\n"), 1);
+    cr_assert_eq(count_lines(out, "after restart"), 1, "Blocks after the torn one should be read");
+
+    fclose(out);
+    remove(path);
+}
+
+Test(logger_compress, partial_block_written_after_interval) {
+    char path[1024];
+    snprintf(path, sizeof(path), FILE_COMPRESS, "interval");
+    remove(path);
+
+    LogCompressSink* sink = log_compress_sink_new(path, 0, 20);
+    cr_assert_not_null(sink);
+    Logger* logger = logger_new_sinks();
+    cr_assert_eq(logger_add_compress_sink(logger, sink, INFO, NULL), 0);
+    log_warn(logger, "lonely record\n");
+
+    for (int i = 0; i < 100 && file_size(path) == 0; i++) {
+        usleep(10000);
+    }
+    FILE* out = tmpfile();
+    cr_assert_eq(decompress(path, out), 0);
+    cr_assert_eq(count_lines(out, "lonely record"), 1, "The record should be on disk before the sink is freed");
+
+    logger_free(logger);
+    log_compress_sink_free(sink);
+    fclose(out);
+    remove(path);
+}
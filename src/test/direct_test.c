@@ -0,0 +1,99 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+#define FILE_DIRECT "test_direct.log"
+#define PROCESSES 4
+#define PROCESS_MESSAGES 500
+#define PADDING 200
+
+static int open_append(void) {
+    return open(FILE_DIRECT, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+}
+
+Test(logger_direct, writes) {
+    int fd = open_append();
+    cr_assert_geq(fd, 0);
+    Logger* logger = logger_new_direct(INFO, fd, fd, 0);
+
+    log_info(logger, "info %d\n", 1);
+    log_error(logger, "error %d\n", 2);
+    log_debug(logger, "hidden\n");
+    cr_assert_eq(logger_add_stream_sink(logger, stdout, INFO, NULL), -1, "Direct loggers should not take sinks");
+    logger_free(logger);
+    close(fd);
+
+    FILE* file = fopen(FILE_DIRECT, "r");
+    cr_assert_eq(count_lines(file, "[INFO] ("), 1);
+    cr_assert_eq(count_lines(file, ") -- info 1"), 1);
+    cr_assert_eq(count_lines(file, ") -- error 2"), 1);
+    cr_assert_eq(count_lines(file, "hidden"), 0);
+    fclose(file);
+    unlink(FILE_DIRECT);
+}
+
+Test(logger_direct, oversized_records) {
+    int fd = open_append();
+    Logger* logger = logger_new_direct(INFO, fd, fd, 64);
+
+    char padding[PADDING + 1];
+    memset(padding, 'x', PADDING);
+    padding[PADDING] = '\0';
+    log_info(logger, "long %s end\n", padding);
+    log_info(logger, "short\n");
+    logger_free(logger);
+    close(fd);
+
+    FILE* file = fopen(FILE_DIRECT, "r");
+    cr_assert_eq(count_lines(file, padding), 1, "Records over the limit should be written whole");
+    cr_assert_eq(count_lines(file, "x end\n"), 1);
+    cr_assert_eq(count_lines(file, ") -- short"), 1);
+    fclose(file);
+    unlink(FILE_DIRECT);
+}
+
+Test(logger_direct, processes) {
+    int fd = open_append();
+    char padding[PADDING + 1];
+    memset(padding, 'y', PADDING);
+    padding[PADDING] = '\0';
+
+    pid_t children[PROCESSES];
+    for (int i = 0; i < PROCESSES; ++i) {
+        children[i] = fork();
+        cr_assert_neq(children[i], -1);
+        if (children[i] == 0) {
+            Logger* logger = logger_new_direct(INFO, fd, fd, 0);
+            for (int j = 0; j < PROCESS_MESSAGES; ++j) {
+                log_info(logger, "process %d %s %d\n", i, padding, j);
+            }
+            logger_free(logger);
+            _exit(0);
+        }
+    }
+    for (int i = 0; i < PROCESSES; ++i) {
+        int status = 0;
+        waitpid(children[i], &status, 0);
+        cr_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    close(fd);
+
+    // every line is one whole record
+    FILE* file = fopen(FILE_DIRECT, "r");
+    char line[1024];
+    int lines = 0;
+    while (fgets(line, sizeof(line), file)) {
+        cr_assert(strncmp(line, "[INFO] (", 8) == 0 && strstr(line, padding) != NULL, "Interleaved record: %s", line);
+        ++lines;
+    }
+    cr_assert_eq(lines, PROCESSES * PROCESS_MESSAGES);
+    fclose(file);
+    unlink(FILE_DIRECT);
+}
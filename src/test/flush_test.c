@@ -0,0 +1,109 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+
+#define FILE_ERR "test_flush_%s.err"
+#define FILE_OUT "test_flush_%s.out"
+
+// Reads what actually reached the file, bypassing the logger's stdio buffer.
+static size_t on_disk(const char* path, char* buff, size_t size) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return 0;
+    size_t bytes = fread(buff, 1, size - 1, file);
+    buff[bytes] = '\0';
+    fclose(file);
+    return bytes;
+}
+
+Test(logger_flush, every_n_records) {
+	char err_file[1024] = {0};
+	char out_file[1024] = {0};
+
+	snprintf(err_file, 1024, FILE_ERR, "every_n_records");
+	snprintf(out_file, 1024, FILE_OUT, "every_n_records");
+
+	FILE* err = fopen(err_file, "w");
+	FILE* out = fopen(out_file, "w");
+
+    Logger* logger = logger_new(INFO, out, err);
+    FlushPolicy policy = { .mode = FLUSH_EVERY_N_RECORDS, .threshold = 3 };
+    cr_assert_eq(logger_set_flush_policy(logger, policy), 0);
+
+    char output[4096];
+    log_info(logger, "first\n");
+    log_info(logger, "second\n");
+    cr_assert_eq(on_disk(out_file, output, sizeof(output)), 0, "Nothing should be flushed before the threshold");
+
+    log_info(logger, "third\n");
+    on_disk(out_file, output, sizeof(output));
+    cr_assert(strstr(output, "third") != NULL, "Records should be flushed at the threshold");
+
+    logger_free(logger);
+	fclose(err);
+	fclose(out);
+	remove(err_file);
+	remove(out_file);
+}
+
+Test(logger_flush, on_level) {
+	char err_file[1024] = {0};
+	char out_file[1024] = {0};
+
+	snprintf(err_file, 1024, FILE_ERR, "on_level");
+	snprintf(out_file, 1024, FILE_OUT, "on_level");
+
+	FILE* err = fopen(err_file, "w");
+	FILE* out = fopen(out_file, "w");
+
+    Logger* logger = logger_new(INFO, out, err);
+    FlushPolicy policy = { .mode = FLUSH_ON_LEVEL, .level = ERROR, .sync_errors = true };
+    cr_assert_eq(logger_set_flush_policy(logger, policy), 0);
+
+    char output[4096];
+    log_info(logger, "buffered\n");
+    cr_assert_eq(on_disk(out_file, output, sizeof(output)), 0, "INFO should stay buffered");
+
+    log_error(logger, "synced\n");
+    on_disk(err_file, output, sizeof(output));
+    cr_assert(strstr(output, "synced") != NULL, "ERROR should be flushed immediately");
+
+    logger_free(logger);
+    on_disk(out_file, output, sizeof(output));
+    cr_assert(strstr(output, "buffered") != NULL, "logger_free should flush pending records");
+
+	fclose(err);
+	fclose(out);
+	remove(err_file);
+	remove(out_file);
+}
+
+Test(logger_flush, interval_timer) {
+	char err_file[1024] = {0};
+	char out_file[1024] = {0};
+
+	snprintf(err_file, 1024, FILE_ERR, "interval_timer");
+	snprintf(out_file, 1024, FILE_OUT, "interval_timer");
+
+	FILE* err = fopen(err_file, "w");
+	FILE* out = fopen(out_file, "w");
+
+    Logger* logger = logger_new(INFO, out, err);
+    FlushPolicy policy = { .mode = FLUSH_INTERVAL, .threshold = 10 };
+    cr_assert_eq(logger_set_flush_policy(logger, policy), 0);
+
+    log_info(logger, "timed\n");
+    usleep(100 * 1000);
+
+    char output[4096];
+    on_disk(out_file, output, sizeof(output));
+    cr_assert(strstr(output, "timed") != NULL, "Timer thread should flush pending records");
+
+    logger_free(logger);
+	fclose(err);
+	fclose(out);
+	remove(err_file);
+	remove(out_file);
+}
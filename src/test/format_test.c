@@ -0,0 +1,66 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+// Logs the message alone and compares it with what snprintf makes of it.
+#define EXPECT_PRINTF(fmt, ...) do { \
+    FILE* out = tmpfile(); \
+    Logger* logger = logger_new(INFO, out, out); \
+    cr_assert_eq(logger_set_pattern(logger, "%m"), 0); \
+    log_info(logger, fmt, __VA_ARGS__); \
+    char expected[1024]; \
+    char actual[1024]; \
+    snprintf(expected, sizeof(expected), fmt, __VA_ARGS__); \
+    read_all(out, actual, sizeof(actual)); \
+    cr_assert_str_eq(actual, expected); \
+    logger_free(logger); \
+    fclose(out); \
+} while (0)
+
+Test(logger_format, integers) {
+    EXPECT_PRINTF("%d %i %u %x %X %o", -42, 7, 4000000000u, 0xbeef, 0xbeef, 8);
+    EXPECT_PRINTF("%ld %lu %lld %llu", (long)INT64_MIN, (unsigned long)UINT64_MAX, (long long)-1, (unsigned long long)1 << 63);
+    EXPECT_PRINTF("%zu %zd %hhd %hd %jd %td", (size_t)123, (ssize_t)-5, 300, 70000, (intmax_t)-9, (ptrdiff_t)-3);
+    EXPECT_PRINTF("[%5d] [%-5d] [%05d] [%+d] [% d] [%.3d] [%.0d]", 42, 42, -42, 42, 42, 7, 0);
+    EXPECT_PRINTF("[%#x] [%#o] [%#010x] [%*d] [%-*d]", 255, 8, 255, 6, 1, 6, 2);
+}
+
+Test(logger_format, strings_and_pointers) {
+    EXPECT_PRINTF("[%s] [%10s] [%-10s] [%.2s] [%.*s]", "abc", "abc", "abc", "abc", 3, "abcdef");
+    EXPECT_PRINTF("[%c] [%3c] [%%] [%p] [%p]", 'x', 'y', (void*)0x1234, (void*)NULL);
+}
+
+Test(logger_format, floating_point) {
+    EXPECT_PRINTF("%f %.0f %.2f %.9f", 3.14159, 2.5, 1.005, 1.0 / 3);
+    EXPECT_PRINTF("%f %.1f %.3f %+.2f", -0.0, 0.25, 2.0005, 1.995);
+    EXPECT_PRINTF("[%10.3f] [%-10.2f] [%010.2f]", -3.5, 2.25, -1.5);
+    EXPECT_PRINTF("%g %g %g %g %g", 0.0, 100000.0, 1000000.0, 0.0001, 0.00001);
+    EXPECT_PRINTF("%g %.3g %.1g %g %G", 3.14159, 2.71828, 0.95, 123456.5, 1e-10);
+    EXPECT_PRINTF("%f %g %e %a", 1e300, 1.0 / 0.0, 12345.678, 1.5);
+}
+
+Test(logger_format, long_messages) {
+    char long_text[3000];
+    memset(long_text, 'x', sizeof(long_text) - 1);
+    long_text[sizeof(long_text) - 1] = '\0';
+
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+    cr_assert_eq(logger_set_pattern(logger, "%m"), 0);
+    log_info(logger, "%s|%s|%d", long_text, long_text, 42);
+
+    char actual[8192];
+    read_all(out, actual, sizeof(actual));
+    cr_assert_eq(strlen(actual), 2 * strlen(long_text) + 4, "Records over the stack buffer should be formatted in full");
+    cr_assert_str_eq(actual + strlen(actual) - 4, "x|42");
+
+    logger_free(logger);
+    fclose(out);
+}
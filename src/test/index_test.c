@@ -0,0 +1,173 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+#define FILE_INDEX "test_index_%s.log"
+
+static void remove_log(const char* path) {
+    char sidecar[1100];
+    snprintf(sidecar, sizeof(sidecar), "%s.idx", path);
+    remove(path);
+    remove(sidecar);
+}
+
+static Logger* indexed_logger(LogIndexSink* sink) {
+    Logger* logger = logger_new_sinks();
+    cr_assert_eq(logger_add_index_sink(logger, sink, VERBOSE, NULL), 0);
+    return logger;
+}
+
+Test(logger_index, time_range) {
+    char path[1024];
+    snprintf(path, sizeof(path), FILE_INDEX, "time_range");
+    remove_log(path);
+
+    LogIndexSink* sink = log_index_sink_new(path, 256, 10);
+    cr_assert_not_null(sink);
+    Logger* logger = indexed_logger(sink);
+    for (int i = 0; i < 200; i++) {
+        log_info(logger, "before %d\n", i);
+    }
+    usleep(20000);
+    struct timespec middle;
+    clock_gettime(CLOCK_REALTIME, &middle);
+    usleep(20000);
+    for (int i = 0; i < 200; i++) {
+        log_info(logger, "after %d\n", i);
+    }
+    logger_free(logger);
+    log_index_sink_free(sink);
+
+    FILE* out = tmpfile();
+    LogQuery query = { middle, { 0, 0 }, VERBOSE };
+    cr_assert_gt(log_index_query(path, &query, out), 0);
+    cr_assert(whole_lines(out), "Runs should hold whole records");
+    cr_assert_eq(count_lines(out, "after "), 200);
+    cr_assert_eq(count_lines(out, "before "), 0, "Runs before the range should be skipped");
+    fclose(out);
+
+    out = tmpfile();
+    query = (LogQuery){ { 0, 0 }, middle, VERBOSE };
+    cr_assert_gt(log_index_query(path, &query, out), 0);
+    cr_assert(whole_lines(out), "Runs should hold whole records");
+    cr_assert_eq(count_lines(out, "before "), 200);
+    cr_assert_eq(count_lines(out, "after "), 0, "Runs after the range should be skipped");
+    fclose(out);
+
+    remove_log(path);
+}
+
+Test(logger_index, level_bitmap) {
+    char path[1024];
+    snprintf(path, sizeof(path), FILE_INDEX, "level_bitmap");
+    remove_log(path);
+
+    LogIndexSink* sink = log_index_sink_new(path, 1024, 0);
+    cr_assert_not_null(sink);
+    Logger* logger = indexed_logger(sink);
+    for (int i = 0; i < 1000; i++) {
+        if (i == 500) log_error(logger, "the incident\n");
+        log_debug(logger, "noise %d\n", i);
+    }
+    logger_free(logger);
+    log_index_sink_free(sink);
+
+    FILE* out = tmpfile();
+    LogQuery query = { { 0, 0 }, { 0, 0 }, WARN };
+    cr_assert_eq(log_index_query(path, &query, out), 1, "Only the run holding the error should be read");
+    cr_assert(whole_lines(out), "Runs should hold whole records");
+    cr_assert_eq(count_lines(out, "the incident"), 1);
+    cr_assert_lt(count_lines(out, "noise"), 1024 / 8);
+    fclose(out);
+
+    cr_assert_eq(log_index_query("missing.log", &query, stdout), -1);
+    remove_log(path);
+}
+
+Test(logger_index, unindexed_tail_and_reopen) {
+    char path[1024];
+    snprintf(path, sizeof(path), FILE_INDEX, "reopen");
+    remove_log(path);
+
+    LogIndexSink* sink = log_index_sink_new(path, 0, 0);
+    cr_assert_not_null(sink);
+    Logger* logger = indexed_logger(sink);
+    log_warn(logger, "first run\n");
+
+    // flushed after every record by default: the open run has no entry yet
+    // but is still found
+    FILE* out = tmpfile();
+    LogQuery query = { { 0, 0 }, { 0, 0 }, VERBOSE };
+    cr_assert_eq(log_index_query(path, &query, out), 1);
+    cr_assert(whole_lines(out), "Runs should hold whole records");
+    cr_assert_eq(count_lines(out, "first run"), 1);
+    fclose(out);
+    logger_free(logger);
+    log_index_sink_free(sink);
+
+    sink = log_index_sink_new(path, 0, 0);
+    cr_assert_not_null(sink);
+    logger = indexed_logger(sink);
+    log_warn(logger, "second run\n");
+    logger_free(logger);
+    log_index_sink_free(sink);
+
+    out = tmpfile();
+    cr_assert_eq(log_index_query(path, &query, out), 2, "Both runs should be indexed");
+    cr_assert(whole_lines(out), "Runs should hold whole records");
+    cr_assert_eq(count_lines(out, "first run"), 1);
+    cr_assert_eq(count_lines(out, "second run"), 1);
+    fclose(out);
+
+    remove_log(path);
+}
+
+Test(logger_index, records_of_a_crashed_run) {
+    char path[1024];
+    snprintf(path, sizeof(path), FILE_INDEX, "crash");
+    remove_log(path);
+
+    fflush(NULL);
+    pid_t child = fork();
+    cr_assert_neq(child, -1);
+    if (child == 0) {
+        // dies with its run open: the records are on disk, their entry is not
+        LogIndexSink* sink = log_index_sink_new(path, 0, 0);
+        Logger* logger = indexed_logger(sink);
+        log_info(logger, "before crash\n");
+        _exit(0);
+    }
+    int status = 0;
+    cr_assert_eq(waitpid(child, &status, 0), child);
+
+    LogIndexSink* sink = log_index_sink_new(path, 0, 0);
+    cr_assert_not_null(sink);
+    Logger* logger = indexed_logger(sink);
+    log_info(logger, "after restart\n");
+    logger_free(logger);
+    log_index_sink_free(sink);
+
+    FILE* out = tmpfile();
+    LogQuery query = { { 0, 0 }, { 0, 0 }, VERBOSE };
+    cr_assert_eq(log_index_query(path, &query, out), 2);
+    cr_assert(whole_lines(out), "Runs should hold whole records");
+    cr_assert_eq(count_lines(out, "before crash"), 1, "Records of the crashed run should stay reachable");
+    cr_assert_eq(count_lines(out, "after restart"), 1);
+    fclose(out);
+
+    // the crashed run's levels are unknown, it matches any level
+    out = tmpfile();
+    query.level = ERROR;
+    cr_assert_eq(log_index_query(path, &query, out), 1);
+    cr_assert(whole_lines(out), "Runs should hold whole records");
+    cr_assert_eq(count_lines(out, "before crash"), 1);
+    fclose(out);
+
+    remove_log(path);
+}
@@ -0,0 +1,92 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+Test(logger_kv, json) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+
+    log_info_kv(logger, "request done",
+        KV_STR("user", "bob"), KV_INT("latency_us", -1234567), KV_UINT("bytes", 18446744073709551615ULL),
+        KV_FLOAT("ratio", 12.25), KV_BOOL("cached", true), KV_STR("missing", NULL));
+    log_debug_kv(logger, "filtered", KV_INT("n", 1));
+    logger_free(logger);
+
+    char output[1024];
+    read_all(out, output, sizeof(output));
+    cr_assert(strncmp(output, "{\"time\":\"", 9) == 0, "Got: %s", output);
+    const char* rest = strstr(output, "\",\"level\":\"INFO\"");
+    cr_assert(rest != NULL, "Got: %s", output);
+    cr_assert_str_eq(rest + strlen("\",\"level\":\"INFO\""),
+        ",\"msg\":\"request done\",\"user\":\"bob\",\"latency_us\":-1234567,\"bytes\":18446744073709551615,"
+        "\"ratio\":12.25,\"cached\":true,\"missing\":null}\n");
+    fclose(out);
+}
+
+Test(logger_kv, logfmt) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+    logger_set_kv_encoding(logger, LOG_ENCODING_LOGFMT);
+
+    log_warn_kv(logger, "disk low", KV_STR("path", "/var/log"), KV_STR("note", "a b=c"), KV_FLOAT("free", 0.5));
+    logger_free(logger);
+
+    char output[1024];
+    read_all(out, output, sizeof(output));
+    const char* rest = strstr(output, "\" level=WARN");
+    cr_assert(strncmp(output, "time=\"", 6) == 0 && rest != NULL, "Got: %s", output);
+    cr_assert_str_eq(rest, "\" level=WARN msg=\"disk low\" path=/var/log note=\"a b=c\" free=0.5\n");
+    fclose(out);
+}
+
+Test(logger_kv, escaping) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+
+    // past the first 16 bytes so the vectorized scan finds them too
+    log_info_kv(logger, "m", KV_STR("s", "0123456789abcdefghij\"quoted\"\\\n\t\x01 caf\xc3\xa9"));
+    logger_free(logger);
+
+    char output[1024];
+    read_all(out, output, sizeof(output));
+    cr_assert(strstr(output, ",\"s\":\"0123456789abcdefghij\\\"quoted\\\"\\\\\\n\\t\\u0001 caf\xc3\xa9\"}\n") != NULL,
+        "Got: %s", output);
+    fclose(out);
+}
+
+Test(logger_kv, oversized_record) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+
+    char value[4000];
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    log_info_kv(logger, "big", KV_STR("value", value), KV_INT("after", 7));
+    logger_free(logger);
+
+    char output[8192];
+    size_t len = read_all(out, output, sizeof(output));
+    cr_assert(len > sizeof(value), "The record should not be truncated");
+    cr_assert(strstr(output, value) != NULL);
+    cr_assert(strcmp(output + len - strlen(",\"after\":7}\n"), ",\"after\":7}\n") == 0, "Got: %s", output);
+    fclose(out);
+}
+
+Test(logger_kv, floats_keep_their_digits) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+    logger_set_kv_encoding(logger, LOG_ENCODING_LOGFMT);
+
+    log_info_kv(logger, "m", KV_FLOAT("small", 0.00012345), KV_FLOAT("tiny", 1e-7), KV_FLOAT("sum", 0.1 + 0.2),
+        KV_FLOAT("large", 1234567890123.456), KV_FLOAT("huge", -1e300), KV_FLOAT("plain", -2.5), KV_FLOAT("zero", 0.0));
+    logger_free(logger);
+
+    char output[1024];
+    read_all(out, output, sizeof(output));
+    cr_assert(strstr(output, " small=0.00012345 tiny=1e-07 sum=0.30000000000000004 large=1234567890123.456"
+        " huge=-1e+300 plain=-2.5 zero=0\n") != NULL, "Got: %s", output);
+    fclose(out);
+}
@@ -0,0 +1,81 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+#define FILE_LEVELS "test_levels_%s.conf"
+
+Test(logger_levels, set_level) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+
+    LOG_DEBUG(logger, "hidden\n");
+    logger_set_level(logger, DEBUG);
+    cr_assert_eq(logger_get_level(logger), DEBUG);
+    LOG_DEBUG(logger, "shown\n");
+
+    cr_assert_eq(count_lines(out, "hidden"), 0);
+    cr_assert_eq(count_lines(out, "shown"), 1);
+    logger_free(logger);
+    fclose(out);
+}
+
+Test(logger_levels, categories) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+    cr_assert_eq(logger_set_levels(logger, "warn, net=debug,DB=Error"), 0);
+    cr_assert_eq(logger_get_level(logger), WARN);
+
+    LogCategory* net = logger_category(logger, "net");
+    cr_assert_eq(net, logger_category(logger, "net"), "Lookups should return the same handle");
+    cr_assert_eq(log_category_get_level(net), DEBUG);
+
+    LOG_CAT_DEBUG(net, "connected %d\n", 1);
+    LOG_CAT_TRACE(net, "bytes\n");
+    LOG_IN(logger, "DB", WARN, "slow query\n");
+    LOG_IN(logger, "DB", ERROR, "deadlock\n");
+    LOG_INFO(logger, "plain\n");
+
+    cr_assert_eq(count_lines(out, ") [net] -- connected 1"), 1);
+    cr_assert_eq(count_lines(out, "bytes"), 0);
+    cr_assert_eq(count_lines(out, "slow query"), 0);
+    cr_assert_eq(count_lines(out, ") [DB] -- deadlock"), 1);
+    cr_assert_eq(count_lines(out, "plain"), 0);
+
+    cr_assert_eq(logger_set_levels(logger, "net=loud"), -1);
+    cr_assert_eq(log_category_get_level(net), DEBUG, "A malformed spec should not be applied");
+    logger_free(logger);
+    fclose(out);
+}
+
+Test(logger_levels, reload_on_sighup) {
+    char path[1024] = {0};
+    snprintf(path, 1024, FILE_LEVELS, "sighup");
+    FILE* conf = fopen(path, "w");
+    fprintf(conf, "# reloaded on SIGHUP\ninfo\nnet=error\n");
+    fclose(conf);
+
+    setenv("TEST_LOG_LEVELS", "debug,net=trace", 1);
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(WARN, out, out);
+    LogCategory* net = logger_category(logger, "net");
+
+    cr_assert_eq(logger_load_levels(logger, "TEST_LOG_LEVELS", NULL), 0);
+    cr_assert_eq(logger_get_level(logger), DEBUG);
+    cr_assert_eq(log_category_get_level(net), TRACE);
+
+    cr_assert_eq(logger_reload_on_sighup(logger, NULL, path), 0);
+    raise(SIGHUP);
+    for (int i = 0; i < 100 && log_category_get_level(net) != ERROR; ++i) usleep(10 * 1000);
+    cr_assert_eq(log_category_get_level(net), ERROR);
+    cr_assert_eq(logger_get_level(logger), INFO);
+
+    logger_free(logger);
+    fclose(out);
+    remove(path);
+}
@@ -0,0 +1,81 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+static void flood(const Logger* logger, int calls) {
+    for (int i = 0; i < calls; ++i) {
+        LOG_RATE_LIMITED(logger, ERROR, 10, 5, "dependency down %d\n", i);
+    }
+}
+
+Test(logger_limit, rate_limited) {
+    FILE* err = tmpfile();
+    Logger* logger = logger_new(INFO, err, err);
+
+    flood(logger, 1000);
+    cr_assert_eq(count_lines(err, "dependency down"), 5, "Only the burst should get through");
+    cr_assert_eq(count_lines(err, "suppressed"), 0);
+
+    usleep(150 * 1000);
+    flood(logger, 1);
+    cr_assert_eq(count_lines(err, "dependency down"), 6, "A token should be back after one interval");
+    cr_assert_eq(count_lines(err, ": 995 messages suppressed"), 1, "The suppressed count should be reported");
+
+    logger_free(logger);
+    fclose(err);
+}
+
+static void repeat(const Logger* logger, const char* message) {
+    LOG_DEDUP(logger, WARN, 60000, "retrying %s\n", message);
+}
+
+Test(logger_limit, dedup) {
+    FILE* err = tmpfile();
+    Logger* logger = logger_new(INFO, err, err);
+
+    for (int i = 0; i < 100; ++i) repeat(logger, "db");
+    cr_assert_eq(count_lines(err, "retrying db"), 1);
+    cr_assert_eq(count_lines(err, "repeated"), 0, "Repeats are reported when the message changes");
+
+    repeat(logger, "cache");
+    cr_assert_eq(count_lines(err, "last message repeated 99 times"), 1);
+    cr_assert_eq(count_lines(err, "retrying cache"), 1);
+
+    logger_free(logger);
+    fclose(err);
+}
+
+static void outage(const Logger* logger, int calls) {
+    for (int i = 0; i < calls; ++i) {
+        LOG_RATE_LIMITED(logger, ERROR, 20, 1, "upstream down %d\n", i);
+    }
+}
+
+Test(logger_limit, quiet_sites_report_pending_counts) {
+    // the reporter writes from its own thread: read through a second stream
+    char path[] = "/tmp/c_logger_limit_XXXXXX";
+    FILE* err = fdopen(mkstemp(path), "w");
+    FILE* log = fopen(path, "r");
+    cr_assert(err != NULL && log != NULL);
+    Logger* logger = logger_new(INFO, err, err);
+
+    // the flood stops: no admitted call is left to report the count
+    outage(logger, 100);
+    for (int i = 0; i < 40 && count_lines(log, "99 messages suppressed") == 0; ++i) usleep(100 * 1000);
+    cr_assert_eq(count_lines(log, "upstream down"), 1);
+    cr_assert_eq(count_lines(log, ": 99 messages suppressed"), 1, "The count should be reported once the site is quiet");
+
+    outage(logger, 10);
+    for (int i = 0; i < 10; ++i) repeat(logger, "queue");
+    logger_free(logger);
+    cr_assert_eq(count_lines(log, ": 9 messages suppressed"), 1, "logger_free should report pending counts");
+    cr_assert_eq(count_lines(log, "last message repeated 9 times"), 1);
+    fclose(log);
+    fclose(err);
+    unlink(path);
+}
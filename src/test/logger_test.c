@@ -139,7 +139,10 @@ Test(logger_edge_cases, empty_error_message) {
 
     Logger* logger = logger_new(ERROR, out, err);
     
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-zero-length"
     log_error(logger, "");
+#pragma GCC diagnostic pop
     
     char stderr_output[4096] = {0};
     rewind(err);
@@ -211,7 +214,10 @@ Test(logger_edge_cases, empty_message) {
 
     Logger* logger = logger_new(INFO, out, err);
     
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-zero-length"
     log_info(logger, "");
+#pragma GCC diagnostic pop
     
     char stdout_output[4096] = {0};
     rewind(out);
@@ -408,3 +414,90 @@ Test(logger_thread_safety, multiple_threads) {
 	remove(err_file);
 	remove(out_file);
 }
+
+Test(logger_edge_cases, oversized_message) {
+	char err_file[1024] = {0};
+	char out_file[1024] = {0};
+
+	snprintf(err_file, 1024, FILE_ERR, "oversized_message");
+	snprintf(out_file, 1024, FILE_OUT, "oversized_message");
+
+	FILE* err = fopen(err_file, "a+");
+	FILE* out = fopen(out_file, "a+");
+    if (err == NULL) {
+        perror("Failed to open err");
+    }
+    if (out == NULL) {
+        perror("Failed to open out");
+    }
+
+    Logger* logger = logger_new(INFO, out, err);
+
+    // larger than the per-thread record buffer, goes through the arena
+    static char long_msg[16384];
+    memset(long_msg, 'b', sizeof(long_msg) - 1);
+    long_msg[sizeof(long_msg) - 1] = '\0';
+
+    log_info(logger, "%s\n", long_msg);
+    log_info(logger, "%s\n", long_msg);
+
+    static char stdout_output[40960] = {0};
+    rewind(out);
+    size_t bytes = fread(stdout_output, 1, sizeof(stdout_output) - 1, out);
+    stdout_output[bytes] = '\0';
+
+    char* first = strstr(stdout_output, long_msg);
+    cr_assert(first != NULL, "Oversized message should be logged in full");
+    cr_assert(strstr(first + 1, long_msg) != NULL, "Arena should be reused for the next record");
+
+    logger_free(logger);
+	fclose(err);
+	fclose(out);
+	remove(err_file);
+	remove(out_file);
+}
+
+Test(logger_timestamp, sub_second_precision) {
+	char err_file[1024] = {0};
+	char out_file[1024] = {0};
+
+	snprintf(err_file, 1024, FILE_ERR, "sub_second_precision");
+	snprintf(out_file, 1024, FILE_OUT, "sub_second_precision");
+
+	FILE* err = fopen(err_file, "a+");
+	FILE* out = fopen(out_file, "a+");
+    if (err == NULL) {
+        perror("Failed to open err");
+    }
+    if (out == NULL) {
+        perror("Failed to open out");
+    }
+
+    Logger* logger = logger_new(INFO, out, err);
+    logger_set_timestamp(logger, TS_MILLIS, CLOCK_REALTIME);
+    log_info(logger, "Millis\n");
+    logger_set_timestamp(logger, TS_MICROS, CLOCK_REALTIME);
+    log_info(logger, "Micros\n");
+
+    char stdout_output[4096] = {0};
+    rewind(out);
+    size_t bytes = fread(stdout_output, 1, sizeof(stdout_output) - 1, out);
+    stdout_output[bytes] = '\0';
+
+    // YYYY-MM-DD HH:MM:SS.mmm
+    char* millis_start = strchr(stdout_output, '(');
+    char* millis_end = strchr(millis_start, ')');
+    cr_assert_eq(millis_end - millis_start - 1, 23, "Millisecond timestamp should be 23 chars");
+    cr_assert_eq(millis_start[20], '.', "Seconds and fraction should be separated by a dot");
+
+    // YYYY-MM-DD HH:MM:SS.uuuuuu
+    char* micros_start = strchr(millis_end, '(');
+    char* micros_end = strchr(micros_start, ')');
+    cr_assert_eq(micros_end - micros_start - 1, 26, "Microsecond timestamp should be 26 chars");
+
+    logger_free(logger);
+	fclose(err);
+	fclose(out);
+	remove(err_file);
+	remove(out_file);
+}
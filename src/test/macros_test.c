@@ -0,0 +1,62 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+
+// everything more verbose than INFO compiles out of this file
+#undef C_LOGGER_MIN_LEVEL
+#define C_LOGGER_MIN_LEVEL INFO
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+static int evaluations = 0;
+
+static int side_effect(void) {
+    return ++evaluations;
+}
+
+Test(logger_macros, skips_argument_evaluation) {
+    FILE* out = tmpfile();
+    FILE* err = tmpfile();
+    Logger* logger = logger_new(WARN, out, err);
+
+    evaluations = 0;
+    LOG_INFO(logger, "info %d\n", side_effect());
+    cr_assert_eq(evaluations, 0, "Arguments of filtered statements should not be evaluated");
+
+    LOG_WARN(logger, "warn %d\n", side_effect());
+    LOG_ERROR(logger, "no arguments\n");
+    cr_assert_eq(evaluations, 1, "Arguments of enabled statements should be evaluated once");
+
+    char output[4096];
+    read_all(err, output, sizeof(output));
+    cr_assert(strstr(output, "[WARN] ") != NULL && strstr(output, "warn 1\n") != NULL, "LOG_WARN should log");
+    cr_assert(strstr(output, "no arguments\n") != NULL, "Macros should accept a bare format");
+
+    logger_free(logger);
+	fclose(out);
+	fclose(err);
+}
+
+Test(logger_macros, compiled_out_below_min_level) {
+    FILE* out = tmpfile();
+    FILE* err = tmpfile();
+    Logger* logger = logger_new(VERBOSE, out, err);
+
+    evaluations = 0;
+    LOG_INFO(logger, "kept\n");
+    LOG_DEBUG(logger, "debug %d\n", side_effect());
+    LOG_TRACE(logger, "trace %d\n", side_effect());
+    LOG_VERBOSE(logger, "verbose %d\n", side_effect());
+    LOG_BINARY(logger, TRACE, "binary %d\n", side_effect());
+
+    char output[4096];
+    read_all(out, output, sizeof(output));
+    cr_assert(strstr(output, "kept") != NULL, "LOG_INFO should log");
+    cr_assert(strstr(output, "debug") == NULL && strstr(output, "trace") == NULL, "Compiled out levels should not log");
+    cr_assert(strstr(output, "verbose") == NULL && strstr(output, "binary") == NULL, "Compiled out levels should not log");
+    cr_assert_eq(evaluations, 0, "Compiled out statements should not evaluate arguments");
+
+    logger_free(logger);
+	fclose(out);
+	fclose(err);
+}
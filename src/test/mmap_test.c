@@ -0,0 +1,130 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+#define FILE_MMAP "test_mmap_%s.log"
+
+#define NUM_THREADS 4
+#define MESSAGES_PER_THREAD 2000
+
+static void* thread_log_function(void* arg) {
+    Logger* logger = (Logger*)arg;
+    for (int i = 0; i < MESSAGES_PER_THREAD; i++) {
+        log_info(logger, "Mmap message %d\n", i);
+    }
+    return NULL;
+}
+
+// Size of the log, which must hold whole lines: no NUL bytes left from the
+// preallocated tail.
+static long checked_size(const char* path) {
+    FILE* file = fopen(path, "r");
+    cr_assert(file != NULL, "Log file should exist");
+    cr_assert(whole_lines(file), "Lines should be complete");
+    fclose(file);
+    struct stat st;
+    cr_assert_eq(stat(path, &st), 0);
+    return (long)st.st_size;
+}
+
+Test(logger_mmap, concurrent_writers_and_growth) {
+	char log_file[1024] = {0};
+	snprintf(log_file, 1024, FILE_MMAP, "concurrent_writers_and_growth");
+    remove(log_file);
+
+    // one page chunks so the file is extended many times while threads write
+    Logger* logger = logger_new_mmap(INFO, log_file, 4096, 0);
+    cr_assert(logger != NULL, "Mmap logger should be created");
+
+    pthread_t threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, thread_log_function, logger);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    log_error(logger, "Mmap error\n");
+    logger_free(logger);
+
+    cr_assert_eq(count_file_lines(log_file, "[INFO] "), NUM_THREADS * MESSAGES_PER_THREAD, "All records should be written");
+    cr_assert_eq(count_file_lines(log_file, "Mmap error"), 1, "Every level goes to the same file");
+    cr_assert_gt(checked_size(log_file), 0, "Unused tail should be trimmed");
+
+	remove(log_file);
+}
+
+Test(logger_mmap, appends_and_drops_past_max_size) {
+	char log_file[1024] = {0};
+	snprintf(log_file, 1024, FILE_MMAP, "appends_and_drops_past_max_size");
+    remove(log_file);
+
+    Logger* logger = logger_new_mmap(INFO, log_file, 0, 0);
+    log_info(logger, "First run\n");
+    logger_free(logger);
+
+    logger = logger_new_mmap(INFO, log_file, 4096, 4096);
+    for (int i = 0; i < 200; i++) {
+        log_info(logger, "Bounded message %d\n", i);
+    }
+    logger_free(logger);
+
+    cr_assert_eq(count_file_lines(log_file, "First run"), 1, "Existing contents should be kept");
+    int bounded = count_file_lines(log_file, "Bounded message");
+    cr_assert(bounded > 0 && bounded < 200, "Records past max_size should be dropped");
+    cr_assert(checked_size(log_file) <= 4096, "File should not grow past max_size");
+
+	remove(log_file);
+}
+
+Test(logger_mmap, reopen_without_records_keeps_contents) {
+	char log_file[1024] = {0};
+	snprintf(log_file, 1024, FILE_MMAP, "reopen_without_records_keeps_contents");
+    remove(log_file);
+
+    Logger* logger = logger_new_mmap(INFO, log_file, 0, 0);
+    log_info(logger, "First run\n");
+    logger_free(logger);
+
+    logger = logger_new_mmap(INFO, log_file, 0, 0);
+    log_debug(logger, "Filtered\n");
+    logger_free(logger);
+
+    cr_assert_eq(count_file_lines(log_file, "First run"), 1, "Existing contents should survive a run without records");
+    cr_assert_gt(checked_size(log_file), 0);
+
+	remove(log_file);
+}
+
+Test(logger_mmap, reopen_after_crash_drops_zero_tail) {
+	char log_file[1024] = {0};
+	snprintf(log_file, 1024, FILE_MMAP, "reopen_after_crash_drops_zero_tail");
+    remove(log_file);
+
+    // what a crash leaves: records followed by the rest of a preallocated chunk
+    FILE* file = fopen(log_file, "w");
+    cr_assert(file != NULL);
+    fputs("Before crash\n", file);
+    while (ftell(file) < 4096) fputc('\0', file);
+    fclose(file);
+
+    Logger* logger = logger_new_mmap(INFO, log_file, 4096, 0);
+    log_info(logger, "After restart\n");
+    logger_free(logger);
+
+    char contents[16384];
+    file = fopen(log_file, "r");
+    size_t bytes = fread(contents, 1, sizeof(contents), file);
+    fclose(file);
+    cr_assert(memchr(contents, '\0', bytes) == NULL, "The zero tail should not stay in the log");
+
+    cr_assert_gt(checked_size(log_file), 0);
+    cr_assert_eq(count_file_lines(log_file, "Before crash"), 1);
+    cr_assert_eq(count_file_lines(log_file, "After restart"), 1);
+
+	remove(log_file);
+}
@@ -0,0 +1,189 @@
+#include <arpa/inet.h>
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+
+// Local receiver standing in for the logging agent.
+typedef struct Receiver {
+    int fd;
+    char path[108];
+    char address[128];
+} Receiver;
+
+static void receiver_open_unix(Receiver* receiver, int type) {
+    memset(receiver, 0, sizeof(Receiver));
+    snprintf(receiver->path, sizeof(receiver->path), "/tmp/c_logger_net_%d_%d.sock", (int)getpid(), type);
+    unlink(receiver->path);
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    strcpy(address.sun_path, receiver->path);
+    receiver->fd = socket(AF_UNIX, type, 0);
+    cr_assert_geq(receiver->fd, 0);
+    cr_assert_eq(bind(receiver->fd, (struct sockaddr*)&address, sizeof(address)), 0);
+    if (type == SOCK_STREAM) cr_assert_eq(listen(receiver->fd, 1), 0);
+    strcpy(receiver->address, receiver->path);
+}
+
+static void receiver_open_udp(Receiver* receiver) {
+    memset(receiver, 0, sizeof(Receiver));
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = 0 };
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    receiver->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    cr_assert_geq(receiver->fd, 0);
+    cr_assert_eq(bind(receiver->fd, (struct sockaddr*)&address, sizeof(address)), 0);
+
+    socklen_t len = sizeof(address);
+    getsockname(receiver->fd, (struct sockaddr*)&address, &len);
+    snprintf(receiver->address, sizeof(receiver->address), "127.0.0.1:%d", ntohs(address.sin_port));
+}
+
+static void receiver_close(Receiver* receiver) {
+    close(receiver->fd);
+    if (receiver->path[0]) unlink(receiver->path);
+}
+
+// Returns the size of the next datagram, -1 once none is left.
+static int receive(int fd, char* buff, size_t size) {
+    ssize_t len = recv(fd, buff, size - 1, MSG_DONTWAIT);
+    if (len < 0) return -1;
+    buff[len] = '\0';
+    return (int)len;
+}
+
+static int count_char(const char* s, char c) {
+    int count = 0;
+    for (; *s; ++s) count += *s == c;
+    return count;
+}
+
+Test(logger_net, unix_datagrams_batch_records) {
+    Receiver receiver;
+    receiver_open_unix(&receiver, SOCK_DGRAM);
+
+    NetSinkPolicy policy = { LOG_TRANSPORT_UNIX_DGRAM, receiver.address, false, 0, NULL, 0, 0 };
+    LogNetSink* sink = log_net_sink_new(&policy);
+    cr_assert_not_null(sink);
+    Logger* logger = logger_new_sinks();
+    cr_assert_eq(logger_add_net_sink(logger, sink, INFO, log_formatter_message), 0);
+    cr_assert_eq(logger_set_flush_policy(logger, (FlushPolicy){ FLUSH_EVERY_N_RECORDS, 25, FATAL, false }), 0);
+
+    for (int i = 0; i < 100; ++i) {
+        log_info(logger, "record %d", i);
+    }
+    logger_free(logger);
+
+    char buff[65536];
+    int datagrams = 0;
+    int lines = 0;
+    while (receive(receiver.fd, buff, sizeof(buff)) >= 0) {
+        ++datagrams;
+        lines += count_char(buff, '\n');
+    }
+    cr_assert_eq(lines, 100, "Records should be newline terminated");
+    cr_assert_eq(datagrams, 4, "Records should be sent one datagram per flush");
+    cr_assert_eq(log_net_sink_dropped(sink), 0);
+
+    log_net_sink_free(sink);
+    receiver_close(&receiver);
+}
+
+Test(logger_net, udp_syslog_framing) {
+    Receiver receiver;
+    receiver_open_udp(&receiver);
+
+    NetSinkPolicy policy = { LOG_TRANSPORT_UDP, receiver.address, true, 0, "net_test", 0, 0 };
+    LogNetSink* sink = log_net_sink_new(&policy);
+    cr_assert_not_null(sink);
+    Logger* logger = logger_new_sinks();
+    cr_assert_eq(logger_add_net_sink(logger, sink, INFO, log_formatter_message), 0);
+
+    log_warn(logger, "disk %s\n", "full");
+    log_info(logger, "second");
+
+    char buff[4096];
+    cr_assert_gt(receive(receiver.fd, buff, sizeof(buff)), 0);
+    cr_assert(strncmp(buff, "<12>1 ", 6) == 0, "WARN should map to user.warning: %s", buff);
+    cr_assert(strchr(buff, 'Z') != NULL && strstr(buff, " net_test ") != NULL, "Unexpected header: %s", buff);
+    cr_assert(strstr(buff, " - - disk full") != NULL && buff[strlen(buff) - 1] == 'l', "Unexpected message: %s", buff);
+    cr_assert_gt(receive(receiver.fd, buff, sizeof(buff)), 0);
+    cr_assert(strncmp(buff, "<14>1 ", 6) == 0, "One record per datagram: %s", buff);
+
+    logger_free(logger);
+    log_net_sink_free(sink);
+    receiver_close(&receiver);
+}
+
+Test(logger_net, stream_octet_counting) {
+    Receiver receiver;
+    receiver_open_unix(&receiver, SOCK_STREAM);
+
+    NetSinkPolicy policy = { LOG_TRANSPORT_UNIX_STREAM, receiver.address, true, 16, "net_test", 0, 0 };
+    LogNetSink* sink = log_net_sink_new(&policy);
+    cr_assert_not_null(sink);
+    int peer = accept(receiver.fd, NULL, NULL);
+    cr_assert_geq(peer, 0);
+
+    Logger* logger = logger_new_sinks();
+    cr_assert_eq(logger_add_net_sink(logger, sink, INFO, log_formatter_message), 0);
+    for (int i = 0; i < 3; ++i) {
+        log_error(logger, "message %d\n", i);
+    }
+    logger_free(logger);
+    log_net_sink_free(sink);
+
+    char buff[4096];
+    size_t len = 0;
+    ssize_t n;
+    while ((n = recv(peer, buff + len, sizeof(buff) - 1 - len, MSG_DONTWAIT)) > 0) len += (size_t)n;
+    buff[len] = '\0';
+
+    // "LEN SP MSG" repeated, local0.err is <131>
+    const char* p = buff;
+    for (int i = 0; i < 3; ++i) {
+        char* end = NULL;
+        long frame = strtol(p, &end, 10);
+        cr_assert(frame > 0 && *end == ' ', "Bad frame at: %s", p);
+        p = end + 1;
+        cr_assert(strncmp(p, "<131>1 ", 7) == 0, "Bad message: %s", p);
+        char expected[16];
+        snprintf(expected, sizeof(expected), "message %d", i);
+        cr_assert(strncmp(p + frame - strlen(expected), expected, strlen(expected)) == 0, "Bad frame length");
+        p += frame;
+    }
+    cr_assert_eq(*p, '\0');
+
+    close(peer);
+    receiver_close(&receiver);
+}
+
+Test(logger_net, slow_receiver_never_blocks) {
+    Receiver receiver;
+    receiver_open_unix(&receiver, SOCK_DGRAM);
+
+    NetSinkPolicy policy = { LOG_TRANSPORT_UNIX_DGRAM, receiver.address, false, 0, NULL, 1024, 4096 };
+    LogNetSink* sink = log_net_sink_new(&policy);
+    cr_assert_not_null(sink);
+    Logger* logger = logger_new_sinks();
+    cr_assert_eq(logger_add_net_sink(logger, sink, INFO, log_formatter_message), 0);
+
+    // the receiver never reads: its queue fills, then the sink's
+    for (int i = 0; i < 20000; ++i) {
+        log_error(logger, "record %d with some padding to fill the queues\n", i);
+    }
+    cr_assert_gt(log_net_sink_dropped(sink), 0, "Records past the queue should be dropped");
+
+    char buff[65536];
+    cr_assert_gt(receive(receiver.fd, buff, sizeof(buff)), 0);
+    cr_assert(strncmp(buff, "record 0 ", 9) == 0, "The oldest records should have been sent first");
+
+    logger_free(logger);
+    log_net_sink_free(sink);
+    receiver_close(&receiver);
+}
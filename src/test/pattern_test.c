@@ -0,0 +1,82 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+Test(logger_pattern, custom_pattern) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+    cr_assert_eq(logger_set_pattern(logger, "%d{%H:%M:%S.%ms} %-5L|%5L| %F:%l %m%n"), 0);
+
+    int line = __LINE__ + 1;
+    LOG_INFO(logger, "hello %d", 42);
+    log_warn(logger, "direct call");
+    fflush(out);
+
+    char expected[128];
+    snprintf(expected, sizeof(expected), " INFO | INFO| %s:%d hello 42\n", __FILE__, line);
+    cr_assert_eq(count_lines(out, expected), 1, "Fields should be padded and the call site recorded");
+    cr_assert_eq(count_lines(out, " WARN | WARN| : direct call\n"), 1, "Direct calls should have no call site");
+
+    char first[128];
+    rewind(out);
+    cr_assert_not_null(fgets(first, sizeof(first), out));
+    cr_assert(first[2] == ':' && first[5] == ':' && first[8] == '.' && first[12] == ' ', "Unexpected time: %s", first);
+
+    logger_free(logger);
+    fclose(out);
+}
+
+Test(logger_pattern, invalid_pattern) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+    cr_assert_eq(logger_set_pattern(logger, "%m %m"), -1, "The message should only appear once");
+    cr_assert_eq(logger_set_pattern(logger, "%q"), -1);
+    cr_assert_eq(logger_set_pattern(logger, "%d{%H"), -1);
+
+    log_info(logger, "kept\n");
+    cr_assert_eq(count_lines(out, "[INFO] ("), 1, "The default pattern should be kept");
+    cr_assert_eq(count_lines(out, ") -- kept"), 1);
+
+    logger_free(logger);
+    fclose(out);
+}
+
+Test(logger_pattern, no_color_off_terminal) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+    cr_assert_eq(logger_set_pattern(logger, "%^%L%$ %c %m"), 0);
+
+    log_info(logger, "plain\n");
+    cr_assert_eq(count_lines(out, "\x1b["), 0, "Files should not be colored");
+    cr_assert_eq(count_lines(out, "INFO  plain"), 1);
+
+    logger_free(logger);
+    fclose(out);
+}
+
+Test(logger_pattern, replaced_time_format) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+
+    // patterns of the same shape land where earlier ones were freed
+    for (int i = 0; i < 10; i++) {
+        char pattern[64];
+        snprintf(pattern, sizeof(pattern), "%%d{run%d %%S} %%m%%n", i);
+        cr_assert_eq(logger_set_pattern(logger, pattern), 0);
+        log_info(logger, "record");
+    }
+    fflush(out);
+
+    for (int i = 0; i < 10; i++) {
+        char label[16];
+        snprintf(label, sizeof(label), "run%d ", i);
+        cr_assert_eq(count_lines(out, label), 1, "Each record should use the time format set when it was logged");
+    }
+
+    logger_free(logger);
+    fclose(out);
+}
@@ -0,0 +1,109 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// TRACE statements must not compile out of release builds of this file
+#undef C_LOGGER_MIN_LEVEL
+#define C_LOGGER_MIN_LEVEL VERBOSE
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+Test(logger_recorder, dump_on_fatal) {
+    FILE* out = tmpfile();
+    FILE* err = tmpfile();
+    Logger* logger = logger_new(WARN, out, err);
+    cr_assert_eq(logger_set_flight_recorder(logger, 16, TRACE), 0);
+    cr_assert_eq(logger_set_flight_recorder(logger, 16, TRACE), -1, "The recorder should only be set once");
+
+    log_debug(logger, "context %d\n", 1);
+    LOG_TRACE(logger, "context %d\n", 2);
+    LOG_VERBOSE(logger, "too verbose\n");
+    log_warn(logger, "warning\n");
+    cr_assert_eq(count_lines(out, "context"), 0, "Recorded records should not be emitted");
+    cr_assert_eq(count_lines(err, "context"), 0);
+
+    log_fatal(logger, "boom\n");
+    cr_assert_eq(count_lines(err, "---- flight recorder ----"), 1);
+    cr_assert_eq(count_lines(err, "[DEBUG] ("), 1);
+    cr_assert_eq(count_lines(err, ") -- context 2"), 1);
+    cr_assert_eq(count_lines(err, "too verbose"), 0);
+    cr_assert_eq(count_lines(err, "warning"), 2, "Emitted records should be recorded too");
+    cr_assert_eq(count_lines(err, "boom"), 2);
+    cr_assert_eq(count_lines(err, "---- end of flight recorder ----"), 1);
+
+    logger_free(logger);
+    fclose(out);
+    fclose(err);
+}
+
+Test(logger_recorder, keeps_last_records) {
+    FILE* err = tmpfile();
+    Logger* logger = logger_new(ERROR, err, err);
+    cr_assert_eq(logger_set_flight_recorder(logger, 3, DEBUG), 0);
+
+    for (int i = 0; i < 10; ++i) {
+        log_debug(logger, "record %d", i);
+    }
+    logger_dump_flight_recorder(logger);
+
+    cr_assert_eq(count_lines(err, "record 5\n"), 0);
+    cr_assert_eq(count_lines(err, "-- record"), 4, "The ring should be rounded up to 4 records");
+    cr_assert_eq(count_lines(err, "record 9\n"), 1, "Records should end with a newline");
+
+    logger_free(logger);
+    fclose(err);
+}
+
+Test(logger_recorder, dump_on_crash) {
+    FILE* err = tmpfile();
+    fflush(NULL);
+
+    pid_t child = fork();
+    cr_assert_neq(child, -1);
+    if (child == 0) {
+        Logger* logger = logger_new(ERROR, err, err);
+        if (logger_set_flight_recorder(logger, 0, DEBUG) != 0 || logger_dump_on_crash(logger) != 0) _exit(1);
+        log_info(logger, "before crash\n");
+        abort();
+    }
+
+    int status = 0;
+    cr_assert_eq(waitpid(child, &status, 0), child);
+    cr_assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "The previous disposition should run");
+    cr_assert_eq(count_lines(err, "[INFO] ("), 1);
+    cr_assert_eq(count_lines(err, "before crash"), 1);
+    fclose(err);
+}
+
+// Recurses until the stack runs out; depth only keeps the compiler from
+// calling it infinite.
+static int overflow(volatile char* previous, unsigned long depth) {
+    volatile char frame[4096];
+    frame[0] = previous ? previous[0] : 0;
+    if (depth == 0) return frame[0];
+    return overflow(frame, depth - 1) + frame[1];
+}
+
+Test(logger_recorder, dump_on_stack_overflow) {
+    FILE* err = tmpfile();
+    fflush(NULL);
+
+    pid_t child = fork();
+    cr_assert_neq(child, -1);
+    if (child == 0) {
+        Logger* logger = logger_new(ERROR, err, err);
+        if (logger_set_flight_recorder(logger, 0, DEBUG) != 0 || logger_dump_on_crash(logger) != 0) _exit(1);
+        log_info(logger, "before overflow\n");
+        _exit(overflow(NULL, (unsigned long)-1));
+    }
+
+    int status = 0;
+    cr_assert_eq(waitpid(child, &status, 0), child);
+    cr_assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV, "The previous disposition should run");
+    cr_assert_eq(count_lines(err, "before overflow"), 1, "The handler should run on its own stack");
+    fclose(err);
+}
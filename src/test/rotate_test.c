@@ -0,0 +1,118 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+#define FILE_LOG "test_rotate_%s.log"
+
+static void remove_rotated(const char* path, int max) {
+    char name[1100];
+    remove(path);
+    for (int i = 1; i <= max; i++) {
+        snprintf(name, sizeof(name), "%s.%d", path, i);
+        remove(name);
+        snprintf(name, sizeof(name), "%s.%d.gz", path, i);
+        remove(name);
+    }
+    snprintf(name, sizeof(name), "%s.next", path);
+    remove(name);
+}
+
+Test(logger_rotate, by_size_with_retention) {
+	char log_file[1024] = {0};
+	snprintf(log_file, 1024, FILE_LOG, "by_size_with_retention");
+    remove_rotated(log_file, 5);
+
+    RotationPolicy policy = { .max_bytes = 256, .retention = 2 };
+    Logger* logger = logger_new_rotating(INFO, log_file, policy);
+    cr_assert(logger != NULL, "Rotating logger should be created");
+
+    for (int i = 0; i < 40; i++) {
+        log_info(logger, "Rotated message %d\n", i);
+        // give the worker time to prepare the next file
+        usleep(2000);
+    }
+    logger_free(logger);
+
+    char name[1100];
+    snprintf(name, sizeof(name), "%s.1", log_file);
+    cr_assert(access(name, F_OK) == 0, "First rotated file should exist");
+    snprintf(name, sizeof(name), "%s.2", log_file);
+    cr_assert(access(name, F_OK) == 0, "Second rotated file should exist");
+    snprintf(name, sizeof(name), "%s.3", log_file);
+    cr_assert(access(name, F_OK) != 0, "Files past the retention count should be deleted");
+    snprintf(name, sizeof(name), "%s.next", log_file);
+    cr_assert(access(name, F_OK) != 0, "The prepared next file should be removed");
+
+    cr_assert(count_file_lines(log_file, "Rotated message 39") == 1, "Latest record should be in the current file");
+    cr_assert(count_file_lines(log_file, "Rotated message") <= 256 / 40 + 1, "Current file should respect max_bytes");
+
+    remove_rotated(log_file, 5);
+}
+
+Test(logger_rotate, compresses_rotated_files) {
+	char log_file[1024] = {0};
+	snprintf(log_file, 1024, FILE_LOG, "compresses_rotated_files");
+    remove_rotated(log_file, 5);
+
+    RotationPolicy policy = { .max_bytes = 64, .retention = 1, .compress = true };
+    Logger* logger = logger_new_rotating(INFO, log_file, policy);
+    log_info(logger, "Before rotation, long enough to exceed the size limit\n");
+    usleep(20000);
+    log_info(logger, "After rotation\n");
+    logger_free(logger);
+
+    char name[1100];
+    snprintf(name, sizeof(name), "%s.1.gz", log_file);
+    cr_assert(access(name, F_OK) == 0, "Rotated file should be compressed");
+    cr_assert_eq(count_file_lines(log_file, "After rotation"), 1, "Current file should hold the new record");
+
+    remove_rotated(log_file, 5);
+}
+
+static void write_file(const char* path, const char* text) {
+    FILE* file = fopen(path, "w");
+    cr_assert(file != NULL);
+    fputs(text, file);
+    fclose(file);
+}
+
+Test(logger_rotate, keeps_records_left_by_a_crash) {
+	char log_file[1024] = {0};
+	snprintf(log_file, 1024, FILE_LOG, "keeps_records_left_by_a_crash");
+    char next[1100];
+    snprintf(next, sizeof(next), "%s.next", log_file);
+    remove_rotated(log_file, 5);
+
+    // crashed after moving the old file away: the current file is still .next
+    write_file(next, "Orphaned record\n");
+    Logger* logger = logger_new_rotating(INFO, log_file, (RotationPolicy){ .max_bytes = 4096, .retention = 2 });
+    cr_assert(logger != NULL, "Rotating logger should be created");
+    log_info(logger, "Fresh record\n");
+    logger_free(logger);
+    cr_assert_eq(count_file_lines(log_file, "Orphaned record"), 1, "The orphaned file should be promoted");
+    cr_assert_eq(count_file_lines(log_file, "Fresh record"), 1);
+
+    // crashed while records went to .next and the old file was still in place
+    write_file(next, "Pending record\n");
+    logger = logger_new_rotating(INFO, log_file, (RotationPolicy){ .max_bytes = 128, .retention = 5 });
+    cr_assert(logger != NULL, "Rotating logger should be created");
+    for (int i = 0; i < 10; i++) {
+        log_info(logger, "Rotated message %d\n", i);
+        usleep(2000);
+    }
+    logger_free(logger);
+
+    char name[1100];
+    int pending = count_file_lines(log_file, "Pending record") + count_file_lines(next, "Pending record");
+    for (int i = 1; i <= 5; i++) {
+        snprintf(name, sizeof(name), "%s.%d", log_file, i);
+        pending += count_file_lines(name, "Pending record");
+    }
+    cr_assert_eq(pending, 1, "Records left in .next should not be truncated");
+
+    remove_rotated(log_file, 5);
+}
@@ -0,0 +1,75 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+#include <unistd.h>
+
+// TRACE statements must not compile out of release builds of this file
+#undef C_LOGGER_MIN_LEVEL
+#define C_LOGGER_MIN_LEVEL VERBOSE
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+Test(logger_sample, every_n) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(VERBOSE, out, out);
+
+    for (int i = 0; i < 100; ++i) {
+        LOG_EVERY_N(logger, DEBUG, 10, "tick %d\n", i);
+    }
+    cr_assert_eq(count_lines(out, "tick"), 10);
+    cr_assert_eq(count_lines(out, ") sample=10 -- tick 0\n"), 1, "Records should carry their sampling factor");
+    cr_assert_eq(count_lines(out, "tick 90\n"), 1);
+
+    logger_free(logger);
+    fclose(out);
+}
+
+Test(logger_sample, first_n) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(VERBOSE, out, out);
+
+    for (int i = 0; i < 100; ++i) {
+        LOG_FIRST_N(logger, INFO, 3, "startup %d\n", i);
+    }
+    cr_assert_eq(count_lines(out, "startup"), 3);
+    cr_assert_eq(count_lines(out, "sample="), 0, "First-n records are not a sample");
+
+    logger_free(logger);
+    fclose(out);
+}
+
+static void poll(const Logger* logger) {
+    LOG_EVERY_MS(logger, TRACE, 100, "poll\n");
+}
+
+Test(logger_sample, every_ms) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(VERBOSE, out, out);
+
+    for (int i = 0; i < 1000; ++i) poll(logger);
+    cr_assert_eq(count_lines(out, "poll"), 1);
+
+    usleep(150 * 1000);
+    poll(logger);
+    cr_assert_eq(count_lines(out, "poll"), 2);
+    cr_assert_eq(count_lines(out, ") sample=1000 -- poll"), 1, "The record should stand for the skipped calls");
+
+    logger_free(logger);
+    fclose(out);
+}
+
+Test(logger_sample, level_rate) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(VERBOSE, out, out);
+    logger_set_sampling(logger, DEBUG, 4);
+
+    for (int i = 0; i < 4000; ++i) log_debug(logger, "sampled\n");
+    for (int i = 0; i < 10; ++i) log_info(logger, "kept\n");
+
+    int sampled = count_lines(out, "sample=4 -- sampled");
+    cr_assert(sampled > 800 && sampled < 1200, "Expected about 1000 debug records, got %d", sampled);
+    cr_assert_eq(count_lines(out, ") -- kept"), 10, "Other levels should not be sampled");
+
+    logger_free(logger);
+    fclose(out);
+}
@@ -0,0 +1,59 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+
+#include "../lib/c_logger.h"
+
+#define NUM_THREADS 8
+#define MESSAGES_PER_THREAD 2000
+
+static void* thread_log_function(void* arg) {
+    Logger* logger = (Logger*)arg;
+    for (int i = 0; i < MESSAGES_PER_THREAD; i++) {
+        log_info(logger, "Sharded message %d\n", i);
+    }
+    return NULL;
+}
+
+Test(logger_sharded, merges_in_timestamp_order) {
+    FILE* out = tmpfile();
+    FILE* err = tmpfile();
+
+    // small rings so producers have to wait on the merger
+    Logger* logger = logger_new_sharded(INFO, out, err, 16, 50000);
+    cr_assert(logger != NULL, "Sharded logger should be created");
+    logger_set_timestamp(logger, TS_MICROS, CLOCK_REALTIME);
+
+    pthread_t threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, thread_log_function, logger);
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    // rings of exited threads are reused
+    pthread_create(&threads[0], NULL, thread_log_function, logger);
+    pthread_join(threads[0], NULL);
+    log_error(logger, "Sharded error\n");
+    logger_free(logger);
+
+    char line[256];
+    char previous[32] = "";
+    int count = 0;
+    rewind(out);
+    while (fgets(line, sizeof(line), out)) {
+        // "[INFO] (YYYY-MM-DD HH:MM:SS.uuuuuu) -- ..." sorts as text
+        char* stamp = strchr(line, '(');
+        cr_assert(stamp != NULL);
+        stamp[27] = '\0';
+        cr_assert(strcmp(previous, stamp + 1) <= 0, "Records out of order: %s after %s", stamp + 1, previous);
+        strcpy(previous, stamp + 1);
+        ++count;
+    }
+    cr_assert_eq(count, (NUM_THREADS + 1) * MESSAGES_PER_THREAD, "All records should be written");
+
+    rewind(err);
+    cr_assert(fgets(line, sizeof(line), err) != NULL && strstr(line, "Sharded error") != NULL);
+    fclose(out);
+    fclose(err);
+}
@@ -0,0 +1,123 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+#include "./utils.h"
+
+#define WORKERS 4
+#define RECORDS_PER_WORKER 500
+
+static void ring_name(char* buff, size_t size, const char* test) {
+    snprintf(buff, size, "/c_logger_%s_%d", test, (int)getpid());
+}
+
+Test(logger_shm, forked_workers) {
+    char name[64];
+    ring_name(name, sizeof(name), "workers");
+    LogShm* shm = log_shm_create(name, WORKERS * RECORDS_PER_WORKER);
+    cr_assert_not_null(shm);
+
+    FILE* out = tmpfile();
+    Logger* collector = logger_new(VERBOSE, out, out);
+    cr_assert_eq(log_shm_start_collector(shm, collector, 1), 0);
+    fflush(NULL);
+
+    pid_t workers[WORKERS];
+    for (int w = 0; w < WORKERS; ++w) {
+        workers[w] = fork();
+        cr_assert_neq(workers[w], -1);
+        if (workers[w] == 0) {
+            Logger* logger = logger_new_shm(INFO, shm);
+            for (int i = 0; i < RECORDS_PER_WORKER; ++i) {
+                log_info(logger, "worker %d record %d\n", w, i);
+            }
+            log_debug(logger, "filtered\n");
+            logger_free(logger);
+            _exit(0);
+        }
+    }
+    for (int w = 0; w < WORKERS; ++w) {
+        int status = 0;
+        cr_assert_eq(waitpid(workers[w], &status, 0), workers[w]);
+        cr_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    log_shm_stop_collector(shm);
+    cr_assert_eq(log_shm_dropped(shm), 0);
+    cr_assert_eq(count_lines(out, "[INFO] ("), WORKERS * RECORDS_PER_WORKER, "Every record should arrive whole");
+    for (int w = 0; w < WORKERS; ++w) {
+        char needle[32];
+        snprintf(needle, sizeof(needle), "-- worker %d record", w);
+        cr_assert_eq(count_lines(out, needle), RECORDS_PER_WORKER);
+    }
+    cr_assert_eq(count_lines(out, "filtered"), 0);
+
+    log_shm_close(shm);
+    logger_free(collector);
+    fclose(out);
+}
+
+Test(logger_shm, full_ring_drops) {
+    char name[64];
+    ring_name(name, sizeof(name), "full");
+    LogShm* shm = log_shm_create(name, 4);
+    cr_assert_not_null(shm);
+    Logger* logger = logger_new_shm(INFO, shm);
+
+    for (int i = 0; i < 10; ++i) {
+        log_warn(logger, "record %d\n", i);
+    }
+    cr_assert_eq(log_shm_dropped(shm), 6, "Records past the capacity should be dropped");
+
+    FILE* out = tmpfile();
+    FILE* err = tmpfile();
+    Logger* collector = logger_new(INFO, out, err);
+    cr_assert_eq(log_shm_drain(shm, collector), 4);
+    cr_assert_eq(log_shm_drain(shm, collector), 0);
+    cr_assert_eq(count_lines(err, "[WARN] ("), 4, "Records should keep their level");
+    cr_assert_eq(count_lines(err, "-- record 3"), 1);
+
+    // drained slots are reusable
+    log_warn(logger, "again\n");
+    cr_assert_eq(log_shm_drain(shm, collector), 1);
+
+    logger_free(logger);
+    log_shm_close(shm);
+    logger_free(collector);
+    fclose(out);
+    fclose(err);
+}
+
+Test(logger_shm, open_by_name) {
+    char name[64];
+    ring_name(name, sizeof(name), "open");
+    LogShm* shm = log_shm_create(name, 0);
+    cr_assert_not_null(shm);
+    cr_assert_null(log_shm_open("/c_logger_missing_ring"));
+
+    LogShm* attached = log_shm_open(name);
+    cr_assert_not_null(attached);
+    Logger* logger = logger_new_shm(INFO, attached);
+    char long_message[3000];
+    memset(long_message, 'x', sizeof(long_message) - 1);
+    long_message[sizeof(long_message) - 1] = '\0';
+    log_info(logger, "%s", long_message);
+    logger_free(logger);
+    log_shm_close(attached);
+
+    FILE* out = tmpfile();
+    Logger* collector = logger_new(INFO, out, out);
+    cr_assert_eq(log_shm_drain(shm, collector), 1);
+    fflush(out);
+    cr_assert_eq(ftell(out), SHM_SLOT_SIZE, "Long records should be cut to a slot");
+    cr_assert_eq(count_lines(out, "xxx\n"), 1, "Cut records should still end the line");
+
+    log_shm_close(shm);
+    cr_assert_null(log_shm_open(name), "The creator should remove the name");
+    logger_free(collector);
+    fclose(out);
+}
@@ -0,0 +1,88 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <string.h>
+
+#include "../lib/c_logger.h"
+
+typedef struct Capture {
+    int writes;
+    const char* messages[4];
+    char last[256];
+} Capture;
+
+static void capture_write(void* ctx, const LogRecord* record, const char* line, size_t len) {
+    Capture* capture = (Capture*)ctx;
+    capture->messages[capture->writes++ % 4] = record->message;
+    snprintf(capture->last, sizeof(capture->last), "%.*s", (int)len, line);
+}
+
+static const LogSinkOps CAPTURE_OPS = { capture_write, NULL, NULL };
+
+Test(logger_sinks, per_sink_level_and_formatter) {
+    FILE* plain = tmpfile();
+    FILE* message = tmpfile();
+
+    Logger* logger = logger_new_sinks();
+    cr_assert_eq(logger_add_stream_sink(logger, plain, VERBOSE, NULL), 0);
+    cr_assert_eq(logger_add_stream_sink(logger, message, WARN, log_formatter_message), 0);
+    cr_assert_eq(logger->level, VERBOSE, "The logger level should follow its most verbose sink");
+
+    log_debug(logger, "debug %d\n", 1);
+    log_error(logger, "error %d\n", 2);
+    logger_free(logger);
+
+    char output[1024] = {0};
+    rewind(plain);
+    fread(output, 1, sizeof(output) - 1, plain);
+    cr_assert(strstr(output, "[DEBUG] (") != NULL && strstr(output, ") -- debug 1\n") != NULL);
+    cr_assert(strstr(output, "[ERROR] (") != NULL && strstr(output, ") -- error 2\n") != NULL);
+
+    memset(output, 0, sizeof(output));
+    rewind(message);
+    fread(output, 1, sizeof(output) - 1, message);
+    cr_assert_str_eq(output, "error 2\n", "The WARN sink should only get the bare error message");
+
+    fclose(plain);
+    fclose(message);
+}
+
+Test(logger_sinks, message_formatted_once) {
+    FILE* out = tmpfile();
+    Capture first = {0};
+    Capture second = {0};
+
+    Logger* logger = logger_new(INFO, out, out);
+    cr_assert_eq(logger_add_sink(logger, &CAPTURE_OPS, &first, INFO, NULL), 0);
+    cr_assert_eq(logger_add_sink(logger, &CAPTURE_OPS, &second, INFO, log_formatter_message), 0);
+
+    log_info(logger, "shared %s", "text");
+    log_debug(logger, "filtered");
+    logger_free(logger);
+
+    cr_assert_eq(first.writes, 1);
+    cr_assert_eq(second.writes, 1);
+    cr_assert_eq(first.messages[0], second.messages[0], "Sinks should share the formatted message");
+    cr_assert_str_eq(second.last, "shared text");
+    cr_assert(strstr(first.last, "[INFO] (") == first.last);
+
+    char output[256] = {0};
+    rewind(out);
+    fread(output, 1, sizeof(output) - 1, out);
+    cr_assert_str_eq(output, first.last, "The primary stream should get the plain line too");
+    fclose(out);
+}
+
+Test(logger_sinks, ring_keeps_latest) {
+    LogRing* ring = log_ring_new(16);
+    Logger* logger = logger_new_sinks();
+    cr_assert_eq(logger_add_ring_sink(logger, ring, INFO, log_formatter_message), 0);
+
+    log_info(logger, "0123456789");
+    log_info(logger, "abcdefghij");
+    logger_free(logger);
+
+    char output[32] = {0};
+    cr_assert_eq(log_ring_read(ring, output, sizeof(output)), 16);
+    cr_assert_str_eq(output, "456789abcdefghij");
+    log_ring_free(ring);
+}
@@ -0,0 +1,114 @@
+#include <criterion/assert.h>
+#include <criterion/criterion.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../lib/c_logger.h"
+
+#define FILE_STATS "test_stats.prom"
+#define THREADS 4
+#define THREAD_MESSAGES 1000
+
+static bool file_contains(const char* path, const char* needle) {
+    char line[1024];
+    bool found = false;
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+    while (!found && fgets(line, sizeof(line), file)) {
+        found = strstr(line, needle) != NULL;
+    }
+    fclose(file);
+    return found;
+}
+
+static uint64_t histogram_total(const LoggerStats* stats) {
+    uint64_t total = 0;
+    for (int i = 0; i < LOGGER_STATS_BUCKETS; ++i) total += stats->latency[i];
+    return total;
+}
+
+Test(logger_stats, counts) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+    LoggerStats stats;
+    logger_stats(logger, &stats);
+    cr_assert_eq(stats.calls, 0, "Stats should be zero until enabled");
+    cr_assert_eq(logger_enable_stats(logger), 0);
+
+    log_info(logger, "one\n");
+    log_warn(logger, "two\n");
+    log_error(logger, "three\n");
+    log_debug(logger, "hidden\n");
+    LOG_DEBUG(logger, "not counted\n");
+
+    logger_stats(logger, &stats);
+    cr_assert_eq(stats.emitted[INFO], 1);
+    cr_assert_eq(stats.emitted[WARN], 1);
+    cr_assert_eq(stats.emitted[ERROR], 1);
+    cr_assert_eq(stats.filtered[DEBUG], 1, "Only log_debug should reach the logger");
+    cr_assert_eq(stats.bytes, (uint64_t)ftell(out));
+    cr_assert_eq(stats.flushes, 3);
+    cr_assert_eq(stats.calls, 3, "Calls rejected by the level check should not be timed");
+    cr_assert_eq(histogram_total(&stats), 3);
+
+    logger_free(logger);
+    fclose(out);
+}
+
+static void* log_messages(void* arg) {
+    Logger* logger = (Logger*)arg;
+    for (int i = 0; i < THREAD_MESSAGES; ++i) {
+        log_info(logger, "message %d\n", i);
+    }
+    return NULL;
+}
+
+Test(logger_stats, threads) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(INFO, out, out);
+    cr_assert_eq(logger_enable_stats(logger), 0);
+
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_create(&threads[i], NULL, log_messages, logger);
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    // blocks of exited threads are reused, not lost
+    pthread_create(&threads[0], NULL, log_messages, logger);
+    pthread_join(threads[0], NULL);
+
+    LoggerStats stats;
+    logger_stats(logger, &stats);
+    cr_assert_eq(stats.emitted[INFO], (THREADS + 1) * THREAD_MESSAGES);
+    cr_assert_eq(stats.calls, (THREADS + 1) * THREAD_MESSAGES);
+    cr_assert_eq(histogram_total(&stats), stats.calls);
+    cr_assert_eq(stats.bytes, (uint64_t)ftell(out));
+    cr_assert(stats.lock_wait_ns > 0 || stats.lock_contended == 0);
+
+    logger_free(logger);
+    fclose(out);
+}
+
+Test(logger_stats, prometheus) {
+    FILE* out = tmpfile();
+    Logger* logger = logger_new(WARN, out, out);
+    cr_assert_eq(logger_enable_stats(logger), 0);
+    log_error(logger, "failed\n");
+    log_info(logger, "hidden\n");
+    log_info(logger, "hidden\n");
+
+    cr_assert_eq(logger_stats_export(logger, FILE_STATS), 0);
+    cr_assert(file_contains(FILE_STATS, "c_logger_records_total{level=\"error\",outcome=\"emitted\"} 1\n"));
+    cr_assert(file_contains(FILE_STATS, "c_logger_records_total{level=\"info\",outcome=\"filtered\"} 2\n"));
+    cr_assert(file_contains(FILE_STATS, "# TYPE c_logger_call_duration_seconds histogram\n"));
+    cr_assert(file_contains(FILE_STATS, "c_logger_call_duration_seconds_bucket{le=\"+Inf\"} 1\n"));
+    cr_assert(file_contains(FILE_STATS, "c_logger_call_duration_seconds_count 1\n"));
+    cr_assert_eq(access(FILE_STATS ".tmp", F_OK), -1, "The temporary file should be renamed");
+
+    unlink(FILE_STATS);
+    logger_free(logger);
+    fclose(out);
+}
@@ -1,7 +1,46 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "../lib/c_logger.h"
+#include "./utils.h"
+
+#define LINE_SIZE 4096
 
 int add(int a, int b) {
   return a + b; 
 }
+
+int count_lines(FILE* file, const char* needle) {
+  char line[LINE_SIZE];
+  int count = 0;
+  rewind(file);
+  while (fgets(line, sizeof(line), file)) {
+    if (strstr(line, needle)) ++count;
+  }
+  return count;
+}
+
+int count_file_lines(const char* path, const char* needle) {
+  FILE* file = fopen(path, "r");
+  if (!file) return 0;
+  int count = count_lines(file, needle);
+  fclose(file);
+  return count;
+}
+
+bool whole_lines(FILE* file) {
+  char line[LINE_SIZE];
+  rewind(file);
+  while (fgets(line, sizeof(line), file)) {
+    size_t len = strlen(line);
+    if (len == 0 || line[len - 1] != '\n') return false;
+  }
+  return true;
+}
+
+size_t read_all(FILE* file, char* buff, size_t size) {
+  rewind(file);
+  size_t bytes = fread(buff, 1, size - 1, file);
+  buff[bytes] = '\0';
+  return bytes;
+}
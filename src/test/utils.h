@@ -1,6 +1,19 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
 int add(int, int);
 
+// Number of lines of file, read from the start, that hold needle.
+int count_lines(FILE* file, const char* needle);
+// Same for the file at path, 0 when there is none.
+int count_file_lines(const char* path, const char* needle);
+// Whether every line of file ends with a newline: no torn record, no NUL byte.
+bool whole_lines(FILE* file);
+// Reads file from the start into buff, NUL-terminated. Returns the bytes read.
+size_t read_all(FILE* file, char* buff, size_t size);
+
 #endif